@@ -14,442 +14,3281 @@
 #include <soundio/soundio.h>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <span>
+#include <functional>
+#include "SpscQueue.h"
+#include "SampleKernels.h"
+#include "SlotMap.h"
+#include "Resampler.h"
+#include "WavStream.h"
+#include "GainRamp.h"
+#include "Profiler.h"
+#include "BufferFormat.h"
+#include "ChannelMap.h"
+#include "WavWriter.h"
+#include "Reclaimer.h"
+#include "PcmAllocator.h"
+#include "CompressedPcm.h"
+#include "EffectChain.h"
 
 
 namespace audio
 {
   
+  // Device sample formats the mixer can write natively.
+  template<SoundIoFormat F>
+  struct SampleFormat;
+  
+  template<>
+  struct SampleFormat<SoundIoFormatS16NE>
+  {
+    using type = int16_t;
+    static void convert(const float* src, type* dst, int count) { kernels::convert_f32_to_s16(src, dst, count); }
+  };
+  
+  template<>
+  struct SampleFormat<SoundIoFormatS32NE>
+  {
+    using type = int32_t;
+    static void convert(const float* src, type* dst, int count) { kernels::convert_f32_to_s32(src, dst, count); }
+  };
+  
+  template<>
+  struct SampleFormat<SoundIoFormatFloat32NE>
+  {
+    using type = float;
+    static void convert(const float* src, type* dst, int count) { kernels::convert_f32_to_f32(src, dst, count); }
+  };
+  
+  template<>
+  struct SampleFormat<SoundIoFormatFloat64NE>
+  {
+    using type = double;
+    static void convert(const float* src, type* dst, int count) { kernels::convert_f32_to_f64(src, dst, count); }
+  };
+  
   class AudioLibSwitcher_libsoundio final : IAudioLibSwitcher
   {
+  public:
+    // How much audio is queued ahead in the device buffer.
+    //   Lower latency reacts faster to commands but underflows more easily.
+    struct LatencyPolicy
+    {
+      // Requested software latency in seconds. 0 leaves the choice to the backend,
+      //   unless min_periods is set.
+      double target_seconds = 0.0;
+      // Bounds on the request in units of mix blocks (InitParams::mix_block_frames).
+      //   0 means unbounded.
+      int min_periods = 0;
+      int max_periods = 0;
+    };
+    
+    struct InitParams
+    {
+      // SoundIoBackendNone lets libsoundio pick the first available backend.
+      //   Use SoundIoBackendDummy to run without sound hardware.
+      SoundIoBackend backend = SoundIoBackendNone;
+      // Output device id and/or name. With both empty the default output device is used,
+      //   and playback follows it whenever the default changes.
+      std::string device_id;
+      std::string device_name;
+      // Output sample format. SoundIoFormatInvalid picks the device's native format if it is
+      //   one of S16NE, S32NE, Float32NE or Float64NE, and otherwise the first of those supported.
+      SoundIoFormat format = SoundIoFormatInvalid;
+      // Requested mix rate. The nearest rate supported by the device is used.
+      //   0 mixes at the device's current rate. Buffers are resampled to the mix rate.
+      int sample_rate = 0;
+      // Default interpolation used for pitch shifting and buffer-to-device rate conversion.
+      ResamplerQuality resampler_quality = ResamplerQuality::Cubic;
+      // Number of frames the mixer sums per inner block of the write callback.
+      int mix_block_frames = 512;
+      // Size of the voice pool, i.e. the maximum number of simultaneously playing or paused
+      //   sources. Voices are allocated at init(). See set_source_priority() for stealing.
+      size_t max_voices = 256;
+      // Size of the bus pool, the master bus included, see create_bus(). Each bus holds one
+      //   mix block of the output layout, allocated whenever the output is (re)opened.
+      size_t max_buses = 32;
+      // Capacity of the command and event queues between the API thread and the callback.
+      //   Must be a power of two. Commands beyond it wait on the API side rather than block
+      //   until the event thread, poll_device_events() or the next command moves them on,
+      //   see CommandLatencyStats::num_deferred_commands.
+      size_t command_queue_capacity = 4096;
+      // Smoothing of volume and pan changes. The time constant only applies to Exponential.
+      GainSmoothing gain_smoothing = GainSmoothing::Linear;
+      float gain_smoothing_ms = 5.f;
+      LatencyPolicy latency;
+      // Waits for libsoundio's events on an internal thread, so device changes, backend
+      //   disconnects and failed streams are picked up without the caller polling. With it
+      //   enabled, do not call soundio_flush_events() or soundio_wait_events() on
+      //   get_soundio() yourself.
+      //   Without it, call poll_device_events() regularly instead.
+      bool event_thread = true;
+      // Invoked from the event thread, or from poll_device_events() without it.
+      std::function<void()> on_devices_change;
+      std::function<void(int err)> on_backend_disconnect;
+      // Renders without a device: libsoundio is not used at all and the mix only advances
+      //   when render() or render_to_wav() pulls it, as fast as the CPU allows. Streaming
+      //   sources are refilled on the rendering thread. The output is bit-exact from run to
+      //   run for the same sequence of calls on the same build. Mixes at sample_rate, or
+      //   48000 if that is 0, in offline_layout. The device fields above are ignored.
+      bool offline = false;
+      SoundIoChannelLayout offline_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+      // Holds the PCM data of buffers uploaded by copy. nullptr uses a PoolPcmAllocator.
+      //   Moved, shared and adopted data stays where the caller put it.
+      std::shared_ptr<IPcmAllocator> pcm_allocator;
+      // Soft limit on the PCM bytes of all buffers, 0 for none. An upload that would exceed
+      //   it first calls on_evict_buffer for the least recently used buffers that no source
+      //   holds, until the upload fits. The hook evicts by destroying the buffer or giving
+      //   it smaller data; if it does neither, the next candidate is tried. Invoked on the
+      //   uploading thread.
+      size_t audio_memory_budget = 0;
+      std::function<void(unsigned int buf_id, size_t num_bytes)> on_evict_buffer;
+    };
+    
+    // PCM memory of one buffer, see get_buffer_memory().
+    struct BufferMemoryInfo
+    {
+      unsigned int buf_id = 0;
+      size_t num_bytes = 0;
+      // Attached to a source, so destroying it would not free the memory yet.
+      bool is_in_use = false;
+    };
+    
+    struct AudioMemoryStats
+    {
+      // PCM bytes alive. This includes data of destroyed or replaced buffers that sources
+      //   still play or that the callback may still read. A block shared by several
+      //   buffers counts once per buffer.
+      size_t resident_bytes = 0;
+      size_t budget_bytes = 0;
+      size_t num_buffers = 0;
+      // Calls of on_evict_buffer.
+      uint64_t num_evictions = 0;
+      // Uploads that still exceeded the budget after asking for evictions.
+      uint64_t num_budget_overruns = 0;
+      // Only filled in for the default PoolPcmAllocator.
+      PcmAllocatorStats allocator;
+    };
+    
+    // Latency between submitting a command and the callback applying it,
+    //   measured in callback periods.
+    struct CommandLatencyStats
+    {
+      uint64_t num_commands = 0;
+      double mean_periods = 0.0;
+      uint64_t max_periods = 0;
+      // Scheduled starts and stops whose device frame had already been mixed when they
+      //   arrived. They take effect at once instead.
+      uint64_t num_late_schedules = 0;
+      // Commands that found the queue full, because the callback fell behind or was not
+      //   running, and waited to be pushed on. The periods above count from when a command
+      //   got into the queue; the longest wait before that is max_deferred_periods.
+      uint64_t num_deferred_commands = 0;
+      uint64_t max_deferred_periods = 0;
+    };
+    
+    // Where a source is in its data, and when on the device frame clock it got there.
+    struct SourcePosition
+    {
+      // Seconds into the buffer at the end of the last mixed block. Wraps around when looping.
+      //   For streaming sources, seconds since the source started.
+      double seconds = 0.0;
+      // The get_device_frame() value at which the source reached seconds.
+      uint64_t device_frame = 0;
+      // False while the source is not playing or has not reached its start frame yet.
+      bool is_valid = false;
+    };
+    
+    struct OutputStats
+    {
+      // Number of times the device ran out of frames, from the underflow callback.
+      uint64_t num_underflows = 0;
+      // Errors that did not fit into the error ring before check_error() drained it.
+      uint64_t num_dropped_errors = 0;
+      // Set once the stream has hit an unrecoverable error and stopped producing audio.
+      bool failed = false;
+    };
+    
+    struct LatencyInfo
+    {
+      // The software latency asked for after applying the policy and the device's range.
+      //   0 if it was left to the backend.
+      double requested_seconds = 0.0;
+      // outstream->software_latency as negotiated by soundio_outstream_open().
+      double negotiated_seconds = 0.0;
+      // Time until the next frame written becomes audible, as reported by
+      //   soundio_outstream_get_latency() at the end of each callback. Use the smoothed
+      //   value to compensate output latency, e.g. for lip sync.
+      double measured_seconds = 0.0;
+      double smoothed_seconds = 0.0;
+      uint64_t num_measurements = 0;
+    };
+    
+    // Id of the master bus, which every other bus feeds in the end.
+    static constexpr unsigned int c_master_bus = 0;
+    
+  private:
     SoundIo* m_soundio = nullptr;
-    SoundIoDevice* m_device = nullptr;
+    // The parameters init() was called with. The device and backend fields are updated by
+    //   select_output_device(), so that reconnecting returns to the device last selected.
+    InitParams m_params;
+    
+    // How often the event thread tries to reconnect while the backend is gone. Connected, it
+    //   sleeps in soundio_wait_events() until there is something to do.
+    static constexpr auto c_reconnect_interval = std::chrono::milliseconds(100);
+    // A soundio_wakeup() made while the event thread is not waiting is lost, so callers that
+    //   wait for the event thread wake it again at this interval.
+    static constexpr auto c_wake_retry_interval = std::chrono::milliseconds(10);
+    static constexpr int c_offline_sample_rate = 48000;
+    // Frames per render() call made by render_to_wav().
+    static constexpr int c_render_chunk_frames = 4096;
+    
+    std::thread m_event_thread;
+    std::atomic<bool> m_quit_events { false };
+    // Set under m_request_mutex once run_events() has returned.
+    bool m_events_stopped = false;
+    // Held while connecting and disconnecting, so that wake_events() only calls
+    //   soundio_wakeup() with a backend connected.
+    std::mutex m_backend_mutex;
+    std::atomic<uint64_t> m_num_device_changes { 0 };
+    std::atomic<bool> m_backend_connected { false };
+    std::function<void()> m_on_devices_change;
+    std::function<void(int)> m_on_backend_disconnect;
+    // Errors raised on the event thread. Unlike the callback's errors these may take a lock.
+    std::mutex m_event_errors_mutex;
+    std::vector<std::string> m_event_errors;
+    
+    // Device selections made on the API thread, carried out by the event thread, which is
+    //   the only thread that talks to libsoundio once it is running.
+    struct DeviceRequest
+    {
+      std::string device_id;
+      std::string device_name;
+      SoundIoBackend backend = SoundIoBackendNone;
+      std::promise<void> done;
+    };
+    std::mutex m_request_mutex;
+    std::condition_variable m_request_cv;
+    std::vector<std::shared_ptr<DeviceRequest>> m_device_requests;
+    std::atomic<bool> m_devices_changed { false };
+    std::atomic<uint64_t> m_num_device_switches { 0 };
+    // Set after a failed attempt to restore the output, so that retries are not reported again.
+    bool m_restore_failed = false;
+    
+    static void on_devices_change(SoundIo* soundio)
+    {
+      auto* self = static_cast<AudioLibSwitcher_libsoundio*>(soundio->userdata);
+      self->m_num_device_changes.fetch_add(1, std::memory_order_relaxed);
+      self->m_devices_changed.store(true, std::memory_order_release);
+      if (self->m_on_devices_change)
+        self->m_on_devices_change();
+    }
+    
+    // Replaces libsoundio's default handler, which aborts the process.
+    static void on_backend_disconnect(SoundIo* soundio, int err)
+    {
+      auto* self = static_cast<AudioLibSwitcher_libsoundio*>(soundio->userdata);
+      self->m_backend_connected.store(false, std::memory_order_release);
+      {
+        std::scoped_lock lock(self->m_event_errors_mutex);
+        self->m_event_errors.emplace_back("Backend disconnected: " + std::string(soundio_strerror(err)));
+      }
+      if (self->m_on_backend_disconnect)
+        self->m_on_backend_disconnect(err);
+    }
+    
+    // Sleeps in soundio_wait_events() between events. Device requests and finish() wake it
+    //   through wake_events(), a failed stream through soundio_wakeup() from its callback.
+    //   Without a backend there is nothing to wait on, so it waits for a request instead
+    //   and tries to reconnect every c_reconnect_interval.
+    void run_events()
+    {
+      for (;;)
+      {
+        poll_events();
+        {
+          std::unique_lock lock(m_request_mutex);
+          auto has_work = [this]
+          {
+            return m_quit_events.load(std::memory_order_acquire) || !m_device_requests.empty();
+          };
+          if (has_work())
+          {
+            if (!m_quit_events.load(std::memory_order_acquire))
+              continue;
+            m_events_stopped = true;
+            break;
+          }
+          if (m_soundio->current_backend == SoundIoBackendNone)
+          {
+            m_request_cv.wait_for(lock, c_reconnect_interval, has_work);
+            continue;
+          }
+        }
+        soundio_wait_events(m_soundio);
+      }
+      m_request_cv.notify_all();
+    }
+    
+    // Any thread but the callbacks. Gets the event thread out of soundio_wait_events(), or
+    //   out of its wait for a reconnect.
+    void wake_events()
+    {
+      {
+        std::scoped_lock lock(m_backend_mutex);
+        if (m_soundio->current_backend != SoundIoBackendNone)
+          soundio_wakeup(m_soundio);
+      }
+      m_request_cv.notify_all();
+    }
+    
+    void stop_event_thread()
+    {
+      if (!m_event_thread.joinable())
+        return;
+      {
+        std::unique_lock lock(m_request_mutex);
+        m_quit_events.store(true, std::memory_order_release);
+        // Woken until it is out, as a wakeup made while it is busy is lost.
+        do
+        {
+          lock.unlock();
+          wake_events();
+          lock.lock();
+        }
+        while (!m_request_cv.wait_for(lock, c_wake_retry_interval, [this] { return m_events_stopped; }));
+      }
+      m_event_thread.join();
+      // Unserved requests fail with std::future_error (broken_promise).
+      m_device_requests.clear();
+    }
+    
+    static const SoundIoChannelLayout& get_stereo_layout()
+    {
+      return *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+    }
+    
+    static int check_effect_slot(int slot)
+    {
+      if (slot < 0 || slot >= c_max_effects)
+        throw std::runtime_error("Effect slot out of range, there are " + std::to_string(c_max_effects) + ".");
+      return slot;
+    }
+    
+    static EffectParams make_filter_effect(FilterType type, float frequency, float q, float gain_db)
+    {
+      EffectParams params;
+      params.type = EffectType::Filter;
+      params.filter = { type, frequency, q, gain_db };
+      return params;
+    }
+    
+    // The managers fill in the Convolver.
+    static EffectParams make_reverb_effect(const std::shared_ptr<const ImpulseResponse>& ir, float wet, float dry)
+    {
+      if (ir == nullptr)
+        throw std::runtime_error("No impulse response passed for the reverb.");
+      EffectParams params;
+      params.type = EffectType::Reverb;
+      params.wet = wet;
+      params.dry = dry;
+      return params;
+    }
+    
+    void push_event_error(std::string message)
+    {
+      std::scoped_lock lock(m_event_errors_mutex);
+      m_event_errors.emplace_back(std::move(message));
+    }
     
     // Buffer class
     struct Buffer
     {
-      // Define your buffer structure here
-      // For example:
-      std::vector<short> data;
-      // Other necessary members
+      // Keeps the PCM block alive. Depending on how the data was uploaded this owns a
+      //   copied or moved std::vector, shares a block with other buffers, or invokes the
+      //   caller's release callback when the last reference goes away.
+      std::shared_ptr<const void> storage;
+      // Interleaved frames in layout order.
+      const void* samples = nullptr;
+      size_t num_frames = 0;
+      SampleType sample_type = SampleType::S16;
+      SoundIoChannelLayout layout = *soundio_channel_layout_get_default(1);
       int sample_rate = 44100;
+      size_t num_bytes = 0;
+      // For picking eviction candidates. Only touched on the API thread.
+      mutable int64_t last_use = 0;
+      
+      int get_channel_count() const { return layout.channel_count; }
+      
+      void touch() const { last_use = std::chrono::steady_clock::now().time_since_epoch().count(); }
+      
+      // Converts frame_count frames starting at frame into floats, channel c at dst + c * stride.
+      //   cursor speeds up sequential reads of ADPCM data and may be nullptr.
+      void read(size_t frame, int frame_count, float* dst, int stride, AdpcmCursor* cursor = nullptr) const
+      {
+        const int channel_count = layout.channel_count;
+        const size_t offset = frame * channel_count;
+        switch (sample_type)
+        {
+          case SampleType::S16:
+            kernels::deinterleave_s16_to_f32(static_cast<const int16_t*>(samples) + offset, channel_count,
+                                             dst, stride, frame_count, 1.f / 32768.f);
+            break;
+          case SampleType::S32:
+            kernels::deinterleave_s32_to_f32(static_cast<const int32_t*>(samples) + offset, channel_count,
+                                             dst, stride, frame_count, 1.f / 2147483648.f);
+            break;
+          case SampleType::F32:
+            kernels::deinterleave_f32(static_cast<const float*>(samples) + offset, channel_count,
+                                      dst, stride, frame_count, 1.f);
+            break;
+          case SampleType::MuLaw:
+            kernels::deinterleave_mulaw_to_f32(static_cast<const uint8_t*>(samples) + offset, channel_count,
+                                               dst, stride, frame_count, 1.f / 32768.f);
+            break;
+          case SampleType::ImaAdpcm:
+            decode_ima_adpcm(static_cast<const uint8_t*>(samples), channel_count, frame, frame_count,
+                             dst, stride, 1.f / 32768.f, cursor);
+            break;
+        }
+      }
     };
     
-    // Source class
-    struct Source
+    // Per-stream settings the voices need to apply their gains.
+    struct GainParams
+    {
+      GainSmoothing smoothing = GainSmoothing::Linear;
+      float tau_frames = 0.f;
+      // Side of each output channel for panning, see get_pan_gain().
+      const int8_t* channel_sides = nullptr;
+    };
+    
+    // Block scratch shared by all voices, one plane per source channel.
+    struct MixScratch
+    {
+      // Resampler input: c_history floats of history followed by the new input frames.
+      float* window = nullptr;
+      int window_stride = 0;
+      // Pulled or resampled output frames.
+      float* planes = nullptr;
+      int plane_stride = 0;
+    };
+    
+    // The bulky part of a voice: only read when it resamples or has more than one channel.
+    //   Kept in a table next to the voices so that the Voice table stays small.
+    struct VoiceDsp
+    {
+      // One per source channel. They advance in lockstep.
+      ResamplerState resamplers[c_max_buffer_channels];
+      // How the source channels land on the output channels.
+      ChannelMap channel_map;
+      AdpcmCursor adpcm_cursor;
+      // Runs on the source channels before the gains, see SourceManager::set_effect().
+      EffectChain<c_max_buffer_channels> effects;
+      
+      void reset_resamplers()
+      {
+        for (auto& resampler : resamplers)
+          resampler.reset();
+      }
+    };
+    
+    // Playback state of one source as seen by the audio thread.
+    //   Only the mixer callback reads or writes a Voice. The functions that need the
+    //   voice's VoiceDsp take it as an argument.
+    struct Voice
     {
-      Buffer* buffer = nullptr;
+      // Bounds the pitch/rate ratio so the input scratch of the mixer can be sized up front.
+      static constexpr double c_max_step = 8.0;
+      static constexpr double c_min_step = 1.0 / 256.0;
+      static constexpr uint64_t c_no_frame = ~uint64_t(0);
+      
+      // Kept alive by the source, see Reclaimer.
+      const Buffer* buffer = nullptr;
+      // Streaming voices read from a WavStream instead of a Buffer.
+      WavStream* stream = nullptr;
+      uint32_t stream_epoch = 0;
       size_t position = 0;
       bool is_playing = false;
       bool looping = false;
       float volume = 1.f;
-      float pitch = 0.f;
+      float pan = 0.f;
+      float pitch = 1.f;
       bool want_pause = false;
       double seconds_offset = 0.0;
-      SoundIoOutStream* outstream = nullptr;
-      std::string m_stream_name;
+      uint32_t play_serial = 0;
+      // Bus slot the voice is mixed into, see MixBus.
+      uint32_t bus = 0;
+      
+      // Device frames on which the voice starts and stops, see Mixer::mix_voices().
+      //   A nonzero group holds the start or stop until the ReleaseGroup with that group.
+      uint64_t start_frame = 0;
+      uint64_t stop_frame = c_no_frame;
+      uint32_t start_group = 0;
+      uint32_t stop_group = 0;
+      
+      // Volume and pan as applied at the end of the previous block, chasing the targets above.
+      SmoothedValue applied_volume { 1.f };
+      SmoothedValue applied_pan;
+      Fade fade;
       
-      void write_sample_s16ne(char *ptr, short sample)
+      // Input frames per output frame. Exactly 1 means the buffer is copied straight through.
+      double step = 1.0;
+      bool direct = true;
+      ResamplerQuality quality = ResamplerQuality::Cubic;
+      // Silent frames read past the end of a non-looping buffer.
+      int padded_frames = 0;
+      // Source channels. Mono sources bypass the channel map and play at full gain on every
+      //   output channel, as they always have.
+      int channel_count = 1;
+      
+      bool has_data() const { return buffer != nullptr || stream != nullptr; }
+      
+      int get_data_sample_rate() const
       {
-        int16_t *buf = (int16_t *)ptr;
-        //double range = (double)INT16_MAX - (double)INT16_MIN;
-        //double val = sample * range / 2.0;
-        //*buf = val;
-        *buf = sample;
+        if (buffer != nullptr)
+          return buffer->sample_rate;
+        if (stream != nullptr)
+          return stream->get_sample_rate();
+        return 0;
       }
       
-      static void write_func_proxy(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max)
+      SoundIoChannelLayout get_data_layout() const
       {
-        write_callback_static(outstream, frame_count_min, frame_count_max, static_cast<Source*>(outstream->userdata));
-      };
+        if (buffer != nullptr)
+          return buffer->layout;
+        if (stream != nullptr)
+          return get_layout_from_channel_mask(stream->get_channel_mask(), stream->get_channel_count());
+        return *soundio_channel_layout_get_default(1);
+      }
       
-      static void write_callback_static(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max, Source* source)
+      // Call whenever the data or the output layout changes.
+      void update_channel_map(VoiceDsp& dsp, const SoundIoChannelLayout& output_layout)
       {
-        //std::cout << "source: " << source << std::endl;
-        if (source != nullptr)
-          source->write_callback(outstream, frame_count_min, frame_count_max);
+        auto layout = get_data_layout();
+        channel_count = std::clamp(layout.channel_count, 1, c_max_buffer_channels);
+        if (channel_count > 1)
+          dsp.channel_map = make_channel_map(layout, output_layout);
+      }
+      
+      void update_step(VoiceDsp& dsp, int device_rate)
+      {
+        if (!has_data() || device_rate <= 0)
+          return;
+        double new_step = std::clamp(static_cast<double>(get_data_sample_rate()) / device_rate * pitch,
+                                     c_min_step, c_max_step);
+        if (direct && new_step != 1.0 && stream != nullptr)
+        {
+          // Streams cannot look back, so they start over with a silent history.
+          direct = false;
+          dsp.reset_resamplers();
+        }
+        else if (direct && new_step != 1.0)
+        {
+          // Seed the history with the frames just played so the switch is seamless.
+          direct = false;
+          dsp.reset_resamplers();
+          const long long num_frames = static_cast<long long>(buffer->num_frames);
+          float frame[c_max_buffer_channels];
+          for (int j = 0; j < ResamplerState::c_history; ++j)
+          {
+            long long idx = static_cast<long long>(position) - ResamplerState::c_history + j;
+            if (idx < 0 && looping)
+              idx += num_frames;
+            if (idx >= 0 && idx < num_frames)
+            {
+              buffer->read(static_cast<size_t>(idx), 1, frame, 1, &dsp.adpcm_cursor);
+              for (int c = 0; c < channel_count; ++c)
+                dsp.resamplers[c].history[j] = frame[c];
+            }
+          }
+        }
+        step = new_step;
       }
       
-      void write_callback(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max)
+      // Converts the next frame_count frames of the buffer into dst, channel c at
+      //   dst + c * stride, wrapping around at the end when looping, or padding with
+      //   silence otherwise.
+      void pull(float* dst, int stride, int frame_count, AdpcmCursor& cursor)
       {
-        if (buffer == nullptr || !is_playing)
+        if (stream != nullptr)
+        {
+          padded_frames += stream->read(dst, stride, frame_count, stream_epoch);
+          position += frame_count;
           return;
+        }
         
-        double sample_rate = outstream->sample_rate;
-        double seconds_per_frame = 1.0 / sample_rate;
-        //std::cout << "dur: " << buffer->data.size() / sample_rate << '\n';
-        double elapsed_seconds = seconds_offset;  // Start from the current offset
+        const size_t num_frames = buffer->num_frames;
+        int frames_done = 0;
+        while (frames_done < frame_count)
+        {
+          if (position >= num_frames)
+          {
+            if (looping && num_frames > 0)
+              position = 0;
+            else
+            {
+              for (int c = 0; c < channel_count; ++c)
+                std::fill(dst + c * stride + frames_done, dst + c * stride + frame_count, 0.f);
+              padded_frames += frame_count - frames_done;
+              break;
+            }
+          }
+          int run = static_cast<int>(std::min<size_t>(frame_count - frames_done, num_frames - position));
+          buffer->read(position, run, dst + frames_done, stride, &cursor);
+          position += run;
+          frames_done += run;
+        }
+      }
+      
+      // Ramps the planes from the previous block's gains to this block's and adds them onto
+      //   the bus. Returns true once a fade with stop_at_end has completed.
+      bool apply_gains(float* bus, const ChannelMap& channel_map, const MixScratch& scratch, int frame_count,
+                       int out_channels, const GainParams& params)
+      {
+        const float fade0 = fade.get_value();
+        const float fade1 = fade.advance(frame_count);
+        const float volume0 = applied_volume.current;
+        const float volume1 = applied_volume.next(volume, params.smoothing, params.tau_frames, frame_count);
+        const float pan0 = applied_pan.current;
+        const float pan1 = applied_pan.next(pan, params.smoothing, params.tau_frames, frame_count);
+        const float gain0 = volume0 * fade0;
+        const float gain1 = volume1 * fade1;
         
-        struct SoundIoChannelArea *areas;
-        int err;
-        int frames_left = frame_count_max;
+        if (gain0 == 0.f && gain1 == 0.f)
+          return fade.stop_at_end && fade.is_done();
         
-        while (frames_left > 0 && elapsed_seconds < buffer->data.size() / sample_rate)
+        float* planes = scratch.planes;
+        float channel_gains0[SOUNDIO_MAX_CHANNELS];
+        float channel_gains1[SOUNDIO_MAX_CHANNELS];
+        auto get_pan_gains = [&](float* gains0, float* gains1)
         {
-          int frame_count = frames_left;
-          if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
+          for (int c = 0; c < out_channels; ++c)
           {
-            fprintf(stderr, "unrecoverable stream error: %s\n", soundio_strerror(err));
-            exit(1);
+            int side = params.channel_sides != nullptr ? params.channel_sides[c] : 0;
+            gains0[c] = gain0 * get_pan_gain(pan0, side);
+            gains1[c] = gain1 * get_pan_gain(pan1, side);
           }
-          if (!frame_count)
-            break;
-          
-          const SoundIoChannelLayout* layout = &outstream->layout;
-          for (int frame = 0; frame < frame_count; ++frame)
+        };
+        
+        if (channel_count == 1)
+        {
+          if ((pan0 == 0.f && pan1 == 0.f) || params.channel_sides == nullptr)
           {
-            if (position >= buffer->data.size())
-            {
-              if (looping)
-                position = 0;
-              else
-              {
-                is_playing = false;
-                break;
-              }
-            }
-            short sample = buffer->data[position++];
-            for (int channel = 0; channel < layout->channel_count; ++channel)
+            if (gain0 == gain1)
+              kernels::mix_mono_to_interleaved(planes, bus, frame_count, out_channels, gain0);
+            else
             {
-              write_sample_s16ne(areas[channel].ptr, sample);
-              areas[channel].ptr += areas[channel].step;
+              kernels::apply_gain_ramp(planes, frame_count, 1, gain0, gain1);
+              kernels::mix_mono_to_interleaved(planes, bus, frame_count, out_channels, 1.f);
             }
           }
-          
-          elapsed_seconds += seconds_per_frame * frame_count;
-          
-          if ((err = soundio_outstream_end_write(outstream)))
+          else
           {
-            if (err == SoundIoErrorUnderflow)
-              return;
-            fprintf(stderr, "unrecoverable stream error: %s\n", soundio_strerror(err));
-            exit(1);
+            get_pan_gains(channel_gains0, channel_gains1);
+            kernels::mix_mono_to_interleaved_ramp(planes, bus, frame_count, out_channels, channel_gains0, channel_gains1);
           }
-          
-          frames_left -= frame_count;
-          if (frames_left <= 0)
+          return fade.stop_at_end && fade.is_done();
+        }
+        
+        get_pan_gains(channel_gains0, channel_gains1);
+        if (channel_map.is_stereo_passthrough)
+          kernels::mix_stereo_to_stereo_ramp(planes, planes + scratch.plane_stride, bus, frame_count,
+                                             channel_gains0, channel_gains1);
+        else
+        {
+          float mapped_gains0[SOUNDIO_MAX_CHANNELS];
+          float mapped_gains1[SOUNDIO_MAX_CHANNELS];
+          for (int in = 0; in < channel_count; ++in)
           {
-            if (looping)
-              frames_left = frame_count;
-            else
+            bool audible = false;
+            for (int c = 0; c < out_channels; ++c)
             {
-              is_playing = false;
-              break;
+              mapped_gains0[c] = channel_gains0[c] * channel_map.gains[in][c];
+              mapped_gains1[c] = channel_gains1[c] * channel_map.gains[in][c];
+              audible = audible || channel_map.gains[in][c] != 0.f;
             }
+            if (audible)
+              kernels::mix_mono_to_interleaved_ramp(planes + in * scratch.plane_stride, bus, frame_count, out_channels,
+                                                    mapped_gains0, mapped_gains1);
           }
         }
-        
-        soundio_outstream_pause(outstream, want_pause);
+        return fade.stop_at_end && fade.is_done();
       }
       
-      
-      static void underflow_callback(struct SoundIoOutStream *outstream)
+      // Adds frame_count frames of this voice onto the interleaved float bus.
+      //   Returns false when the voice ran out of data or faded out during this block.
+      bool mix(float* bus, VoiceDsp& dsp, const MixScratch& scratch, int frame_count, int out_channels,
+               const GainParams& params)
       {
-        static int count = 0;
-        fprintf(stderr, "underflow %d\n", count++);
+        if (!has_data() || !is_playing || want_pause)
+          return true;
+        
+        bool finished = false;
+        if (direct)
+        {
+          pull(scratch.planes, scratch.plane_stride, frame_count, dsp.adpcm_cursor);
+          finished = padded_frames > 0;
+        }
+        else
+        {
+          int input_frames = get_resampler_input_frames(dsp.resamplers[0], quality, step, frame_count);
+          pull(scratch.window + ResamplerState::c_history, scratch.window_stride, input_frames, dsp.adpcm_cursor);
+          for (int c = 0; c < channel_count; ++c)
+            resample(dsp.resamplers[c], quality, step, scratch.window + c * scratch.window_stride, input_frames,
+                     scratch.planes + c * scratch.plane_stride, frame_count);
+          // The resampler reads up to half its taps ahead of what it outputs.
+          finished = padded_frames > get_num_taps(quality) / 2 + 1;
+        }
+        dsp.effects.process(scratch.planes, scratch.plane_stride, channel_count, frame_count);
+        if (apply_gains(bus, dsp.channel_map, scratch, frame_count, out_channels, params))
+          finished = true;
+        
+        seconds_offset = static_cast<double>(position) / get_data_sample_rate();
+        if (finished)
+          is_playing = false;
+        return !finished;
       }
+    };
+    
+    // A submix bus as seen by the audio thread. Voices and other buses add onto its block,
+    //   which is then scaled by the bus gain once and added onto the bus it outputs to and
+    //   onto its sends. Only the master bus has no output; its block is the mix.
+    struct MixBus
+    {
+      static constexpr uint32_t c_no_bus = ~0u;
+      static constexpr int c_max_sends = 4;
       
-      Source(SoundIoDevice* device, std::string_view stream_name)
-        : m_stream_name(stream_name)
+      // Post-fader: a send carries the bus after its gain, scaled by the send level.
+      struct Send
       {
-        outstream = soundio_outstream_create(device);
-      }
+        uint32_t bus = c_no_bus;
+        float level = 0.f;
+        SmoothedValue applied_level;
+      };
+      
+      bool is_enabled = false;
+      // Something was mixed into the block this period. Blocks are only cleared on first use,
+      //   so idle buses cost nothing.
+      bool is_live = false;
+      uint32_t output = c_no_bus;
+      float gain = 1.f;
+      bool muted = false;
+      SmoothedValue applied_gain { 1.f };
+      Send sends[c_max_sends];
+      // Runs on the summed inputs before the gain, so sends carry the processed signal.
+      EffectChain<SOUNDIO_MAX_CHANNELS> effects;
+    };
+    
+    enum class SourceCommandType : uint8_t
+    {
+      Play,     // (Re)starts the voice from the beginning with the full source state.
+      Resume,
+      Pause,
+      Stop,     // Stops and releases the voice.
+      SetVolume,
+      SetPan,
+      SetPitch,
+      SetLooping,
+      SetBuffer,
+      SetResamplerQuality,
+      Fade,     // Fades the gain to value over duration, optionally stopping the voice at the end.
+      StopAt,   // Stops the voice on a device frame and reports it as finished.
+      ReleaseGroup, // Schedules the starts and stops held for group on frame.
+      SetBus,   // Moves the voice to another bus.
+      SetEffect,    // Sets one slot of the voice's effect chain.
+      AddBus,   // Enables a bus with unity gain and no sends.
+      RemoveBus,    // Disables a bus. Its voices and input buses move to target.
+      SetBusOutput,
+      SetBusGain,
+      SetBusMute,
+      SetBusSend,
+      SetBusEffect,
+    };
+    
+    // Sent from the API thread to the mixer callback.
+    struct SourceCommand
+    {
+      SourceCommandType type = SourceCommandType::Stop;
+      uint32_t voice = 0;
+      uint32_t play_serial = 0;
+      float value = 0.f;  // Volume for Play and SetVolume, pan for SetPan, pitch for SetPitch, target gain for Fade.
+      bool flag = false;  // Looping for Play and SetLooping, stop at the end for Fade.
+      const Buffer* buffer = nullptr;
+      WavStream* stream = nullptr; // Play only.
+      uint32_t stream_epoch = 0;   // Play only.
+      float pitch = 1.f;  // Play only.
+      ResamplerQuality quality = ResamplerQuality::Cubic; // Play and SetResamplerQuality.
+      float pan = 0.f;        // Play only.
+      float duration = 0.f;   // Fade length in seconds for Fade, fade-in length for Play.
+      FadeCurve curve = FadeCurve::Linear; // Play and Fade.
+      // Play only. When set, the voice with this play serial is faded out over the same
+      //   duration in the same block the new voice starts in, forming a crossfade.
+      uint32_t crossfade_voice = ~0u;
+      uint32_t crossfade_serial = 0;
+      // Play, Resume and StopAt: the device frame to act on, 0 for as soon as possible.
+      //   ReleaseGroup: the frame for every voice held for group.
+      uint64_t frame = 0;
+      // Play, Resume and StopAt: when nonzero, wait for the ReleaseGroup with this group.
+      uint32_t group = 0;
+      // Play and SetBus: the bus slot the voice feeds. Bus commands: the bus slot changed,
+      //   with the gain in value, mute in flag and the send index or effect slot in index.
+      uint32_t bus = 0;
+      // AddBus and SetBusOutput: the bus slot it outputs to. SetBusSend: the bus slot the
+      //   send feeds, or MixBus::c_no_bus to remove it. RemoveBus: where its inputs go.
+      uint32_t target = 0;
+      uint8_t index = 0;
+      // SetEffect and SetBusEffect.
+      EffectParams effect {};
+      uint64_t submit_period = 0;
+    };
+    
+    enum class StreamErrorSite : uint8_t
+    {
+      BeginWrite,
+      EndWrite,
+      Stream,   // Reported through SoundIoOutStream::error_callback.
+    };
+    
+    // Posted by the audio thread instead of printing, drained by check_error().
+    struct StreamError
+    {
+      StreamErrorSite site = StreamErrorSite::Stream;
+      int code = 0;
+      uint64_t period = 0;
+    };
+    
+    enum class SourceEventType : uint8_t
+    {
+      Finished,
+    };
+    
+    // Sent from the mixer callback back to the API thread.
+    struct SourceEvent
+    {
+      SourceEventType type = SourceEventType::Finished;
+      uint32_t voice = 0;
+      uint32_t play_serial = 0;
+    };
+    
+    // Device-independent half of the engine: the voices and the command/event queues.
+    //   The voices survive a change of output device, so playback carries on where it was.
+    // The API thread never touches the voices directly. It posts SourceCommands which the
+    //   audio thread drains at the start of each period, and it receives SourceEvents back.
+    // Only one OutputStream drives the mixer at a time. configure() is only called while
+    //   no stream is running.
+    class Mixer
+    {
+      static constexpr uint32_t c_inactive = ~0u;
       
-      ~Source()
+      // Indexed by voice.
+      std::vector<Voice> m_voices;
+      std::vector<VoiceDsp> m_voice_dsp;
+      // Voices that are playing or paused, in no particular order. The callback only visits
+      //   these, so idle voices cost nothing however many there are.
+      std::vector<uint32_t> m_active;
+      // Position of each voice in m_active, or c_inactive.
+      std::vector<uint32_t> m_active_slot;
+      
+      // Written by the callback after mixing a voice, read by get_voice_position() under a
+      //   sequence lock: the sequence is odd while an update is in progress.
+      struct PublishedPosition
       {
-        if (outstream != nullptr)
-          soundio_outstream_destroy(outstream);
-      }
+        std::atomic<uint32_t> sequence { 0 };
+        std::atomic<uint32_t> play_serial { 0 };
+        std::atomic<double> seconds { 0.0 };
+        std::atomic<uint64_t> device_frame { 0 };
+      };
+      std::vector<PublishedPosition> m_positions;
+      
+      // Frames mixed since the mixer was created, across device changes. The audio thread
+      //   owns m_frame and publishes it after every block.
+      uint64_t m_frame = 0;
+      std::atomic<uint64_t> m_published_frame { 0 };
+      
+      // Indexed by bus slot, slot 0 being the master bus.
+      std::vector<MixBus> m_buses;
+      // One interleaved block per bus slot, m_bus_stride floats apart.
+      std::vector<float> m_bus_frames;
+      size_t m_bus_stride = 0;
+      // Enabled buses in processing order: every bus comes after all buses feeding it, so
+      //   the master bus is last. Rebuilt without allocating when the routing changes.
+      std::vector<uint32_t> m_bus_order;
+      std::vector<uint32_t> m_bus_num_inputs;
+      bool m_bus_order_dirty = false;
+      // Planar copy of a bus block for its effects, m_block_frames floats per channel.
+      std::vector<float> m_effect_planes;
+      
+      std::vector<float> m_scratch;
+      std::vector<float> m_window;
+      MixScratch m_mix_scratch;
+      SoundIoChannelLayout m_layout {};
+      std::vector<int8_t> m_channel_sides;
+      GainParams m_gain_params;
+      float m_smoothing_ms = 0.f;
+      int m_block_frames = 512;
+      int m_sample_rate = 0;
+      int m_channel_count = 0;
       
-      void init()
+      SpscQueue<SourceCommand> m_commands;
+      SpscQueue<SourceEvent> m_events;
+      std::atomic<uint64_t> m_period { 0 };
+      // Commands posted by the API thread and applied by the audio thread, see Reclaimer.
+      uint64_t m_num_posted = 0;
+      std::atomic<uint64_t> m_num_applied { 0 };
+      // Commands that did not fit m_commands, oldest first. They go ahead of any newer one,
+      //   so the audio thread still sees every command in posting order. The mutex is only
+      //   taken while m_has_overflow is set: the API thread pushes straight into m_commands
+      //   otherwise, and nobody else does.
+      std::mutex m_overflow_mutex;
+      std::vector<SourceCommand> m_overflow;
+      std::atomic<bool> m_has_overflow { false };
+      std::atomic<uint64_t> m_num_deferred { 0 };
+      std::atomic<uint64_t> m_max_deferred_periods { 0 };
+      std::atomic<uint64_t> m_num_commands { 0 };
+      std::atomic<uint64_t> m_sum_command_latency { 0 };
+      std::atomic<uint64_t> m_max_command_latency { 0 };
+      std::atomic<uint64_t> m_num_dropped_events { 0 };
+      std::atomic<uint64_t> m_num_late_schedules { 0 };
+      
+      CallbackProfiler m_profiler;
+      
+      void push_event(const SourceEvent& event)
       {
-        //std::cout << "name: " << m_stream_name << std::endl;
-        outstream->underflow_callback = underflow_callback;
-        outstream->name = m_stream_name.c_str();
-        outstream->userdata = this; // Store pointer to this Source object
-        outstream->write_callback = write_func_proxy;
+        if (!m_events.try_push(event))
+          m_num_dropped_events.fetch_add(1, std::memory_order_relaxed);
       }
       
-      void set_buffer_data_mono_16(SoundIoDevice* device)
+      // m_active has room for every voice, so neither of these allocates.
+      void activate(uint32_t v)
       {
-        if (soundio_device_supports_format(device, SoundIoFormatS16NE))
-        {
-          outstream->format = SoundIoFormatS16NE;
-          //write_sample = write_sample_s16ne; // #FIXME: (?) Reimplement function pointer write_sample?
-        }
-        //else if (soundio_device_supports_format(device, SoundIoFormatFloat32NE))
-        //{
-        //  outstream->format = SoundIoFormatFloat32NE;
-        //  write_sample = write_sample_float32ne;
-        //}
-        //else if (soundio_device_supports_format(device, SoundIoFormatFloat64NE))
-        //{
-        //  outstream->format = SoundIoFormatFloat64NE;
-        //  write_sample = write_sample_float64ne;
-        //}
-        //else if (soundio_device_supports_format(device, SoundIoFormatS32NE))
-        //{
-        //  outstream->format = SoundIoFormatS32NE;
-        //  write_sample = write_sample_s32ne;
-        //}
-        else
-        {
-          throw std::runtime_error("No suitable device format available.");
-        }
+        if (m_active_slot[v] != c_inactive)
+          return;
+        m_active_slot[v] = static_cast<uint32_t>(m_active.size());
+        m_active.emplace_back(v);
       }
-    };
-    
-    class SourceManager
-    {
-    private:
-      std::vector<std::unique_ptr<Source>> m_sources;
-      SoundIo* m_soundio = nullptr;
-      
-    public:
-      SourceManager(SoundIo* soundio)
-        : m_soundio(soundio)
-      {}
       
-      size_t add_source(SoundIoDevice* device)
+      void deactivate(uint32_t v)
       {
-        auto src_id = m_sources.size();
-        m_sources.emplace_back(std::make_unique<Source>(device, "source-" + std::to_string(src_id)));
-        return src_id;
+        const uint32_t slot = m_active_slot[v];
+        if (slot == c_inactive)
+          return;
+        const uint32_t last = m_active.back();
+        m_active[slot] = last;
+        m_active_slot[last] = slot;
+        m_active.pop_back();
+        m_active_slot[v] = c_inactive;
       }
       
-      bool remove_source(size_t source_id)
+      // Frames before m_frame have been mixed already.
+      uint64_t resolve_frame(uint64_t frame)
       {
-        return stlutils::erase_at(m_sources, source_id);
+        if (frame == 0)
+          return m_frame;
+        if (frame < m_frame)
+          m_num_late_schedules.fetch_add(1, std::memory_order_relaxed);
+        return frame;
       }
       
-      bool is_playing(size_t source_id) const
+      void release_group(uint32_t group, uint64_t frame)
       {
-        if (source_id < m_sources.size())
+        frame = resolve_frame(frame);
+        for (uint32_t v : m_active)
         {
-          const auto& source = m_sources[source_id];
-          return source->is_playing;
+          auto& voice = m_voices[v];
+          if (voice.start_group == group)
+          {
+            voice.start_group = 0;
+            voice.start_frame = frame;
+          }
+          if (voice.stop_group == group)
+          {
+            voice.stop_group = 0;
+            voice.stop_frame = frame;
+          }
         }
-        else
-          return false;
       }
       
-      void play(size_t source_id)
+      void publish_position(uint32_t v, const Voice& voice, uint64_t device_frame)
       {
-        if (source_id < m_sources.size())
-        {
-          auto& source = m_sources[source_id];
-          source->is_playing = true;
-          
-          if (int err = soundio_outstream_start(source->outstream); err != 0)
-            throw std::runtime_error("unable to start device: " + std::string(soundio_strerror(err)));
-        }
+        auto& published = m_positions[v];
+        const uint32_t sequence = published.sequence.load(std::memory_order_relaxed);
+        published.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        published.play_serial.store(voice.play_serial, std::memory_order_relaxed);
+        published.seconds.store(voice.seconds_offset, std::memory_order_relaxed);
+        published.device_frame.store(device_frame, std::memory_order_relaxed);
+        published.sequence.store(sequence + 2, std::memory_order_release);
       }
       
-      void pause(size_t source_id)
+      // The API thread keeps the routing acyclic and the master bus's output unset.
+      void apply_bus_command(const SourceCommand& cmd)
       {
-        if (source_id < m_sources.size())
+        if (cmd.bus >= m_buses.size())
+          return;
+        auto& bus = m_buses[cmd.bus];
+        switch (cmd.type)
         {
-          m_sources[source_id]->want_pause = true;
-          // Code to pause the source using libsoundio
+          case SourceCommandType::AddBus:
+            bus = MixBus {};
+            bus.is_enabled = true;
+            bus.output = cmd.target;
+            m_bus_order_dirty = true;
+            break;
+          case SourceCommandType::RemoveBus:
+            bus.is_enabled = false;
+            for (uint32_t v : m_active)
+              if (m_voices[v].bus == cmd.bus)
+                m_voices[v].bus = cmd.target;
+            for (auto& other : m_buses)
+            {
+              if (other.output == cmd.bus)
+                other.output = cmd.target;
+              for (auto& send : other.sends)
+                if (send.bus == cmd.bus)
+                  send.bus = MixBus::c_no_bus;
+            }
+            m_bus_order_dirty = true;
+            break;
+          case SourceCommandType::SetBusOutput:
+            bus.output = cmd.target;
+            m_bus_order_dirty = true;
+            break;
+          case SourceCommandType::SetBusGain:
+            bus.gain = cmd.value;
+            break;
+          case SourceCommandType::SetBusMute:
+            bus.muted = cmd.flag;
+            break;
+          case SourceCommandType::SetBusSend:
+            if (cmd.index < MixBus::c_max_sends)
+            {
+              auto& send = bus.sends[cmd.index];
+              // A new send fades in rather than starting at its full level.
+              if (send.bus != cmd.target)
+                send.applied_level.current = 0.f;
+              send.bus = cmd.target;
+              send.level = cmd.value;
+              m_bus_order_dirty = true;
+            }
+            break;
+          case SourceCommandType::SetBusEffect:
+            bus.effects.set(cmd.index, cmd.effect, m_sample_rate);
+            break;
+          default:
+            break;
         }
       }
       
-      void stop(size_t source_id)
+      // Kahn's algorithm over the enabled buses, with m_bus_order doubling as the queue.
+      //   A bus only feeds buses processed after it, so each block is final by the time its
+      //   gain is applied.
+      void update_bus_order()
       {
-        if (source_id < m_sources.size())
+        m_bus_order_dirty = false;
+        std::fill(m_bus_num_inputs.begin(), m_bus_num_inputs.end(), 0u);
+        auto for_each_target = [this](const MixBus& bus, auto func)
         {
-          m_sources[source_id]->is_playing = false;
-          // Code to stop the source using libsoundio
+          if (bus.output < m_buses.size() && m_buses[bus.output].is_enabled)
+            func(bus.output);
+          for (const auto& send : bus.sends)
+            if (send.bus < m_buses.size() && m_buses[send.bus].is_enabled)
+              func(send.bus);
+        };
+        for (const auto& bus : m_buses)
+          if (bus.is_enabled)
+            for_each_target(bus, [this](uint32_t target) { m_bus_num_inputs[target]++; });
+        m_bus_order.clear();
+        for (uint32_t b = 0; b < m_buses.size(); ++b)
+          if (m_buses[b].is_enabled && m_bus_num_inputs[b] == 0)
+            m_bus_order.emplace_back(b);
+        for (size_t i = 0; i < m_bus_order.size(); ++i)
+          for_each_target(m_buses[m_bus_order[i]], [this](uint32_t target)
+          {
+            if (--m_bus_num_inputs[target] == 0)
+              m_bus_order.emplace_back(target);
+          });
+      }
+      
+      // Returns the block of the bus, cleared if nothing was mixed into it yet this period.
+      //   Voices on a disabled bus fall back to the master bus.
+      float* begin_bus(uint32_t b, int frame_count)
+      {
+        if (b >= m_buses.size() || !m_buses[b].is_enabled)
+          b = 0;
+        float* frames = m_bus_frames.data() + b * m_bus_stride;
+        if (!m_buses[b].is_live)
+        {
+          std::fill(frames, frames + frame_count * m_channel_count, 0.f);
+          m_buses[b].is_live = true;
+        }
+        return frames;
+      }
+      
+      void mix_into_bus(const float* src, uint32_t b, int frame_count, float gain0, float gain1)
+      {
+        if (gain0 == 0.f && gain1 == 0.f)
+          return;
+        float* dst = begin_bus(b, frame_count);
+        if (gain0 == gain1)
+          kernels::mix_gain(src, dst, frame_count * m_channel_count, gain0);
+        else
+          kernels::mix_gain_ramp(src, dst, frame_count, m_channel_count, gain0, gain1);
+      }
+      
+      // Applies each bus's gain once for the whole block and passes it on. Gains follow
+      //   their targets with the voices' smoothing, so gain and mute changes do not click.
+      void mix_buses(int frame_count)
+      {
+        for (uint32_t b : m_bus_order)
+        {
+          auto& bus = m_buses[b];
+          const float gain0 = bus.applied_gain.current;
+          const float gain1 = bus.applied_gain.next(bus.muted ? 0.f : bus.gain, m_gain_params.smoothing,
+                                                    m_gain_params.tau_frames, frame_count);
+          float levels0[MixBus::c_max_sends];
+          float levels1[MixBus::c_max_sends];
+          for (int s = 0; s < MixBus::c_max_sends; ++s)
+          {
+            auto& send = bus.sends[s];
+            levels0[s] = send.applied_level.current;
+            levels1[s] = send.applied_level.next(send.level, m_gain_params.smoothing, m_gain_params.tau_frames,
+                                                 frame_count);
+          }
+          // A reverb keeps ringing after its inputs have gone quiet.
+          if (!bus.is_live && bus.effects.has_tail())
+            begin_bus(b, frame_count);
+          if (!bus.is_live)
+            continue;
+          
+          float* frames = m_bus_frames.data() + b * m_bus_stride;
+          if (!bus.effects.is_empty())
+          {
+            float* planes = m_effect_planes.data();
+            kernels::deinterleave_f32(frames, m_channel_count, planes, m_block_frames, frame_count, 1.f);
+            bus.effects.process(planes, m_block_frames, m_channel_count, frame_count);
+            kernels::interleave_f32(planes, m_block_frames, m_channel_count, frames, frame_count);
+          }
+          if (bus.output == MixBus::c_no_bus)
+          {
+            if (gain0 != gain1)
+              kernels::apply_gain_ramp(frames, frame_count, m_channel_count, gain0, gain1);
+            else if (gain0 != 1.f)
+              kernels::apply_gain(frames, frame_count * m_channel_count, gain0);
+            continue;
+          }
+          mix_into_bus(frames, bus.output, frame_count, gain0, gain1);
+          for (int s = 0; s < MixBus::c_max_sends; ++s)
+            if (bus.sends[s].bus != MixBus::c_no_bus)
+              mix_into_bus(frames, bus.sends[s].bus, frame_count, gain0 * levels0[s], gain1 * levels1[s]);
+        }
+      }
+      
+      void apply_command(const SourceCommand& cmd)
+      {
+        if (cmd.type == SourceCommandType::ReleaseGroup)
+        {
+          release_group(cmd.group, cmd.frame);
+          return;
+        }
+        if (cmd.type >= SourceCommandType::AddBus)
+        {
+          apply_bus_command(cmd);
+          return;
+        }
+        if (cmd.voice >= m_voices.size())
+          return;
+        auto& voice = m_voices[cmd.voice];
+        auto& dsp = m_voice_dsp[cmd.voice];
+        const int fade_frames = static_cast<int>(cmd.duration * m_sample_rate);
+        switch (cmd.type)
+        {
+          case SourceCommandType::Play:
+            if (cmd.crossfade_voice < m_voices.size() && cmd.crossfade_voice != cmd.voice)
+            {
+              auto& outgoing = m_voices[cmd.crossfade_voice];
+              if (outgoing.is_playing && outgoing.play_serial == cmd.crossfade_serial)
+                outgoing.fade.start(outgoing.fade.get_value(), 0.f, fade_frames, cmd.curve, true);
+            }
+            voice = Voice {};
+            m_profiler.reset_voice(cmd.voice);
+            dsp.adpcm_cursor.reset();
+            dsp.effects.reset();
+            voice.buffer = cmd.buffer;
+            voice.stream = cmd.stream;
+            voice.stream_epoch = cmd.stream_epoch;
+            voice.volume = cmd.value;
+            voice.applied_volume.current = cmd.value;
+            voice.pan = cmd.pan;
+            voice.applied_pan.current = cmd.pan;
+            if (fade_frames > 0)
+              voice.fade.start(0.f, 1.f, fade_frames, cmd.curve, false);
+            voice.pitch = cmd.pitch;
+            voice.looping = cmd.flag;
+            voice.quality = cmd.quality;
+            voice.play_serial = cmd.play_serial;
+            voice.bus = cmd.bus;
+            voice.start_group = cmd.group;
+            if (cmd.group == 0)
+              voice.start_frame = resolve_frame(cmd.frame);
+            voice.update_channel_map(dsp, m_layout);
+            voice.update_step(dsp, m_sample_rate);
+            voice.is_playing = voice.has_data();
+            if (voice.is_playing)
+              activate(cmd.voice);
+            else
+            {
+              deactivate(cmd.voice);
+              push_event({ SourceEventType::Finished, cmd.voice, cmd.play_serial });
+            }
+            break;
+          case SourceCommandType::Resume:
+            voice.want_pause = false;
+            voice.start_group = cmd.group;
+            if (cmd.group == 0)
+              voice.start_frame = resolve_frame(cmd.frame);
+            break;
+          case SourceCommandType::Pause:
+            voice.want_pause = true;
+            break;
+          case SourceCommandType::Stop:
+            voice = Voice {};
+            deactivate(cmd.voice);
+            break;
+          case SourceCommandType::SetVolume:
+            voice.volume = cmd.value;
+            break;
+          case SourceCommandType::SetPan:
+            voice.pan = cmd.value;
+            break;
+          case SourceCommandType::SetPitch:
+            voice.pitch = cmd.value;
+            voice.update_step(dsp, m_sample_rate);
+            break;
+          case SourceCommandType::SetLooping:
+            voice.looping = cmd.flag;
+            break;
+          case SourceCommandType::SetBuffer:
+            voice.buffer = cmd.buffer;
+            voice.stream = nullptr;
+            voice.position = 0;
+            voice.padded_frames = 0;
+            dsp.reset_resamplers();
+            dsp.adpcm_cursor.reset();
+            voice.update_channel_map(dsp, m_layout);
+            voice.update_step(dsp, m_sample_rate);
+            if (voice.buffer == nullptr)
+            {
+              voice.is_playing = false;
+              deactivate(cmd.voice);
+            }
+            break;
+          case SourceCommandType::SetResamplerQuality:
+            voice.quality = cmd.quality;
+            break;
+          case SourceCommandType::Fade:
+            voice.fade.start(voice.fade.get_value(), cmd.value, fade_frames, cmd.curve, cmd.flag);
+            break;
+          case SourceCommandType::StopAt:
+            voice.stop_group = cmd.group;
+            if (cmd.group == 0)
+              voice.stop_frame = resolve_frame(cmd.frame);
+            break;
+          case SourceCommandType::SetBus:
+            voice.bus = cmd.bus;
+            break;
+          case SourceCommandType::SetEffect:
+            dsp.effects.set(cmd.index, cmd.effect, m_sample_rate);
+            break;
+          default:
+            break;
+        }
+      }
+      
+      void drain_commands(uint64_t period)
+      {
+        SourceCommand cmd;
+        uint64_t num_applied = 0;
+        while (m_commands.try_pop(cmd))
+        {
+          apply_command(cmd);
+          num_applied++;
+          
+          uint64_t latency = period - cmd.submit_period;
+          m_num_commands.fetch_add(1, std::memory_order_relaxed);
+          m_sum_command_latency.fetch_add(latency, std::memory_order_relaxed);
+          if (latency > m_max_command_latency.load(std::memory_order_relaxed))
+            m_max_command_latency.store(latency, std::memory_order_relaxed);
+        }
+        if (m_bus_order_dirty)
+          update_bus_order();
+        // Releases everything the voices read before the commands replaced it.
+        if (num_applied > 0)
+          m_num_applied.fetch_add(num_applied, std::memory_order_release);
+      }
+      
+      // A voice whose start frame lies inside the block is mixed from that frame on, and one
+      //   whose stop frame lies inside it up to that frame, so scheduled voices start and stop
+      //   sample-accurately and voices scheduled on the same frame stay in sync.
+      void mix_voices(int frame_count, int channel_count)
+      {
+        const uint64_t block_start = m_frame;
+        const uint64_t block_end = m_frame + frame_count;
+        // A finished voice is swapped out for the last one, which is then mixed in its place.
+        for (size_t i = 0; i < m_active.size();)
+        {
+          const uint32_t v = m_active[i];
+          auto& voice = m_voices[v];
+          if (voice.start_group != 0 || voice.start_frame >= block_end)
+          {
+            ++i;
+            continue;
+          }
+          const int offset = voice.start_frame > block_start ? static_cast<int>(voice.start_frame - block_start) : 0;
+          int frames = frame_count - offset;
+          const bool stop_due = voice.stop_group == 0 && voice.stop_frame < block_end;
+          if (stop_due)
+            frames = std::max(static_cast<int>(static_cast<int64_t>(voice.stop_frame - block_start)) - offset, 0);
+          
+          auto start = m_profiler.now();
+          bool playing = frames == 0
+            || voice.mix(begin_bus(voice.bus, frame_count) + offset * channel_count, m_voice_dsp[v], m_mix_scratch,
+                         frames, channel_count, m_gain_params);
+          m_profiler.record_voice(v, start);
+          publish_position(v, voice, block_start + offset + frames);
+          if (stop_due && voice.is_playing)
+          {
+            voice.is_playing = false;
+            playing = false;
+          }
+          if (playing && voice.is_playing)
+          {
+            ++i;
+            continue;
+          }
+          if (!playing)
+          {
+            push_event({ SourceEventType::Finished, v, voice.play_serial });
+            // The source may drop the data as soon as it sees the event.
+            voice.buffer = nullptr;
+            voice.stream = nullptr;
+          }
+          deactivate(v);
+        }
+      }
+      
+    public:
+      Mixer(const InitParams& params)
+        : m_voices(params.max_voices)
+        , m_voice_dsp(params.max_voices)
+        , m_active_slot(params.max_voices, c_inactive)
+        , m_positions(params.max_voices)
+        , m_buses(std::max<size_t>(params.max_buses, 1))
+        , m_bus_num_inputs(m_buses.size())
+        , m_smoothing_ms(params.gain_smoothing_ms)
+        , m_block_frames(params.mix_block_frames)
+        , m_commands(params.command_queue_capacity)
+        , m_events(params.command_queue_capacity)
+      {
+        m_active.reserve(params.max_voices);
+        m_overflow.reserve(params.command_queue_capacity);
+        m_bus_order.reserve(m_buses.size());
+        m_buses[0].is_enabled = true;
+        update_bus_order();
+        m_gain_params.smoothing = params.gain_smoothing;
+        const int window_frames = ResamplerState::c_history * 2 + 2
+          + static_cast<int>(std::ceil(m_block_frames * Voice::c_max_step));
+        m_scratch.assign(static_cast<size_t>(m_block_frames) * c_max_buffer_channels, 0.f);
+        m_window.assign(static_cast<size_t>(window_frames) * c_max_buffer_channels, 0.f);
+        m_mix_scratch.window = m_window.data();
+        m_mix_scratch.window_stride = window_frames;
+        m_mix_scratch.planes = m_scratch.data();
+        m_mix_scratch.plane_stride = m_block_frames;
+      }
+      
+      // Adapts the mix to the rate and channel layout of a newly opened stream.
+      //   Voices keep their position; their resampling step follows the new rate.
+      void configure(int sample_rate, const SoundIoChannelLayout& layout)
+      {
+        m_sample_rate = sample_rate;
+        m_layout = layout;
+        m_channel_count = layout.channel_count;
+        m_bus_stride = static_cast<size_t>(m_block_frames) * m_channel_count;
+        m_bus_frames.assign(m_bus_stride * m_buses.size(), 0.f);
+        m_effect_planes.assign(m_bus_stride, 0.f);
+        
+        m_channel_sides.assign(layout.channel_count, 0);
+        for (int c = 0; c < layout.channel_count; ++c)
+          m_channel_sides[c] = static_cast<int8_t>(get_channel_side(layout.channels[c]));
+        m_gain_params.channel_sides = m_channel_sides.data();
+        m_gain_params.tau_frames = m_smoothing_ms * 1e-3f * m_sample_rate;
+        m_profiler.init(m_voices.size(), m_sample_rate);
+        
+        for (size_t v = 0; v < m_voices.size(); ++v)
+        {
+          m_voices[v].update_channel_map(m_voice_dsp[v], m_layout);
+          m_voices[v].update_step(m_voice_dsp[v], m_sample_rate);
+          m_voice_dsp[v].effects.configure(m_sample_rate);
+        }
+        for (auto& bus : m_buses)
+          bus.effects.configure(m_sample_rate);
+      }
+      
+      // Audio thread. Applies pending commands and returns the current period.
+      uint64_t begin_period()
+      {
+        const uint64_t period = m_period.load(std::memory_order_relaxed);
+        drain_commands(period);
+        return period;
+      }
+      
+      // Audio thread. Mixes at most get_block_frames() frames through the buses and returns
+      //   the interleaved block of the master bus.
+      const float* mix_block(int frame_count)
+      {
+        for (uint32_t b : m_bus_order)
+          m_buses[b].is_live = false;
+        mix_voices(frame_count, m_channel_count);
+        mix_buses(frame_count);
+        const float* master = begin_bus(0, frame_count);
+        m_frame += frame_count;
+        m_published_frame.store(m_frame, std::memory_order_release);
+        return master;
+      }
+      
+      // Audio thread.
+      void end_period(CallbackProfiler::Clock::time_point callback_start, int frames_written)
+      {
+        m_profiler.record_callback(callback_start, frames_written);
+        m_period.fetch_add(1, std::memory_order_release);
+      }
+      
+      CallbackProfiler::Clock::time_point now() const { return m_profiler.now(); }
+      
+      // Pushes as many overflowed commands as fit, oldest first, each stamped with the period
+      //   it got into the queue in. Returns true if none are left. Under m_overflow_mutex.
+      bool push_overflow()
+      {
+        const uint64_t period = m_period.load(std::memory_order_acquire);
+        size_t num_pushed = 0;
+        for (; num_pushed < m_overflow.size(); ++num_pushed)
+        {
+          SourceCommand cmd = m_overflow[num_pushed];
+          const uint64_t deferred = period - cmd.submit_period;
+          cmd.submit_period = period;
+          if (!m_commands.try_push(cmd))
+            break;
+          if (deferred > m_max_deferred_periods.load(std::memory_order_relaxed))
+            m_max_deferred_periods.store(deferred, std::memory_order_relaxed);
+        }
+        m_overflow.erase(m_overflow.begin(), m_overflow.begin() + num_pushed);
+        m_has_overflow.store(!m_overflow.empty(), std::memory_order_release);
+        return m_overflow.empty();
+      }
+      
+      // API thread. Never blocks: with the queue full, because the callback has fallen a whole
+      //   queue behind, the device is gone or nothing renders offline, the command waits in
+      //   the overflow until flush_posted(), the next callback or a later post() gets it into
+      //   the queue.
+      void post(SourceCommand cmd)
+      {
+        m_num_posted++;
+        cmd.submit_period = m_period.load(std::memory_order_acquire);
+        if (!m_has_overflow.load(std::memory_order_acquire) && m_commands.try_push(cmd))
+          return;
+        std::scoped_lock lock(m_overflow_mutex);
+        if (!push_overflow() || !m_commands.try_push(cmd))
+        {
+          m_overflow.push_back(cmd);
+          m_has_overflow.store(true, std::memory_order_release);
+          m_num_deferred.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      
+      // Any thread but the audio thread. Moves overflowed commands on to the queue and
+      //   returns true if some still did not fit.
+      bool flush_posted()
+      {
+        if (!m_has_overflow.load(std::memory_order_acquire))
+          return false;
+        std::scoped_lock lock(m_overflow_mutex);
+        return !push_overflow();
+      }
+      
+      // Any thread. True while posted commands wait for room in the queue.
+      bool has_overflow() const { return m_has_overflow.load(std::memory_order_acquire); }
+      
+      // API thread. Number of commands posted so far. Data detached from the voices by
+      //   those commands is unused once get_applied_epoch() reaches it.
+      uint64_t get_epoch() const { return m_num_posted; }
+      
+      // Any thread. Number of commands the audio thread has applied.
+      uint64_t get_applied_epoch() const { return m_num_applied.load(std::memory_order_acquire); }
+      
+      // API thread.
+      bool poll_event(SourceEvent& event)
+      {
+        return m_events.try_pop(event);
+      }
+      
+      size_t get_max_voices() const { return m_voices.size(); }
+      
+      size_t get_max_buses() const { return m_buses.size(); }
+      
+      int get_block_frames() const { return m_block_frames; }
+      
+      uint64_t get_period() const { return m_period.load(std::memory_order_acquire); }
+      
+      // As set by the last configure().
+      int get_sample_rate() const { return m_sample_rate; }
+      
+      const SoundIoChannelLayout& get_layout() const { return m_layout; }
+      
+      // Any thread. Frames mixed so far, i.e. the device frame the next block starts on.
+      uint64_t get_frame() const { return m_published_frame.load(std::memory_order_acquire); }
+      
+      // API thread. False unless the voice has been mixed since the play with play_serial.
+      bool get_voice_position(uint32_t voice, uint32_t play_serial, double& seconds, uint64_t& device_frame) const
+      {
+        if (voice >= m_positions.size())
+          return false;
+        const auto& published = m_positions[voice];
+        for (;;)
+        {
+          const uint32_t sequence = published.sequence.load(std::memory_order_acquire);
+          const uint32_t serial = published.play_serial.load(std::memory_order_relaxed);
+          seconds = published.seconds.load(std::memory_order_relaxed);
+          device_frame = published.device_frame.load(std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if ((sequence & 1) == 0 && published.sequence.load(std::memory_order_relaxed) == sequence)
+            return serial == play_serial;
+          std::this_thread::yield();
+        }
+      }
+      
+      void fill_profile(ProfileSnapshot& profile) const { m_profiler.fill(profile); }
+      
+      HistogramSnapshot get_voice_profile(uint32_t voice) const { return m_profiler.get_voice_snapshot(voice); }
+      
+      uint64_t get_num_dropped_events() const { return m_num_dropped_events.load(std::memory_order_relaxed); }
+      
+      CommandLatencyStats get_command_latency_stats() const
+      {
+        CommandLatencyStats stats;
+        stats.num_commands = m_num_commands.load(std::memory_order_relaxed);
+        stats.num_deferred_commands = m_num_deferred.load(std::memory_order_relaxed);
+        stats.max_deferred_periods = m_max_deferred_periods.load(std::memory_order_relaxed);
+        if (stats.num_commands > 0)
+          stats.mean_periods = static_cast<double>(m_sum_command_latency.load(std::memory_order_relaxed)) / stats.num_commands;
+        stats.max_periods = m_max_command_latency.load(std::memory_order_relaxed);
+        stats.num_late_schedules = m_num_late_schedules.load(std::memory_order_relaxed);
+        return stats;
+      }
+    };
+    
+    // One libsoundio output stream on one device. Its write callback runs the Mixer and
+    //   converts the float bus into the device's channel areas.
+    class OutputStream
+    {
+      Mixer* m_mixer = nullptr;
+      SoundIoDevice* m_device = nullptr;
+      SoundIoOutStream* m_outstream = nullptr;
+      bool m_started = false;
+      
+      SpscQueue<StreamError> m_errors { c_error_queue_capacity };
+      std::atomic<uint64_t> m_num_underflows { 0 };
+      std::atomic<uint64_t> m_num_dropped_errors { 0 };
+      std::atomic<int> m_stream_error { 0 };
+      std::atomic<bool> m_failed { false };
+      
+      double m_requested_latency = 0.0;
+      std::atomic<double> m_measured_latency { 0.0 };
+      std::atomic<double> m_smoothed_latency { 0.0 };
+      std::atomic<uint64_t> m_num_latency_measurements { 0 };
+      
+      static void write_func_proxy(struct SoundIoOutStream* outstream, int frame_count_min, int frame_count_max)
+      {
+        auto* stream = static_cast<OutputStream*>(outstream->userdata);
+        if (stream != nullptr)
+          stream->write_callback(outstream, frame_count_min, frame_count_max);
+      }
+      
+      static void underflow_callback(struct SoundIoOutStream* outstream)
+      {
+        if (auto* stream = static_cast<OutputStream*>(outstream->userdata))
+          stream->m_num_underflows.fetch_add(1, std::memory_order_relaxed);
+      }
+      
+      // Not necessarily called on the write callback thread, so the error is passed on
+      //   through an atomic rather than the error ring.
+      static void error_callback(struct SoundIoOutStream* outstream, int err)
+      {
+        if (auto* stream = static_cast<OutputStream*>(outstream->userdata))
+        {
+          stream->m_stream_error.store(err, std::memory_order_release);
+          stream->set_failed();
+        }
+      }
+      
+      // Wakes the event thread, which replaces the stream. soundio_wakeup() is called without
+      //   any of the adapter's locks: the backend stays connected while the stream exists,
+      //   and destroying the stream waits for its callbacks.
+      void set_failed()
+      {
+        m_failed.store(true, std::memory_order_release);
+        soundio_wakeup(m_device->soundio);
+      }
+      
+      void push_error(StreamErrorSite site, int code, uint64_t period)
+      {
+        if (!m_errors.try_push({ site, code, period }))
+          m_num_dropped_errors.fetch_add(1, std::memory_order_relaxed);
+      }
+      
+      // True if the channel areas form one plain interleaved frame array.
+      static bool is_interleaved(const SoundIoChannelArea* areas, int channel_count, int bytes_per_sample)
+      {
+        for (int channel = 0; channel < channel_count; ++channel)
+          if (areas[channel].ptr != areas[0].ptr + channel * bytes_per_sample
+              || areas[channel].step != channel_count * bytes_per_sample)
+            return false;
+        return true;
+      }
+      
+      // Converts the float bus into the device format. One instantiation per supported
+      //   format; the mixer picks one when the stream is opened.
+      template<SoundIoFormat F>
+      static void write_bus(SoundIoChannelArea* areas, const float* bus, int frame_count, int channel_count)
+      {
+        using Sample = typename SampleFormat<F>::type;
+        if (is_interleaved(areas, channel_count, sizeof(Sample)))
+          SampleFormat<F>::convert(bus, reinterpret_cast<Sample*>(areas[0].ptr), frame_count * channel_count);
+        else
+        {
+          for (int frame = 0; frame < frame_count; ++frame)
+            for (int channel = 0; channel < channel_count; ++channel)
+              SampleFormat<F>::convert(bus + frame * channel_count + channel,
+                                       reinterpret_cast<Sample*>(areas[channel].ptr + frame * areas[channel].step), 1);
+        }
+        for (int channel = 0; channel < channel_count; ++channel)
+          areas[channel].ptr += areas[channel].step * frame_count;
+      }
+      
+      using WriteBusFunc = void (*)(SoundIoChannelArea*, const float*, int, int);
+      WriteBusFunc m_write_bus = nullptr;
+      
+      void select_format(SoundIoDevice* device, SoundIoFormat requested)
+      {
+        auto is_supported = [device](SoundIoFormat format)
+        {
+          return format != SoundIoFormatInvalid && soundio_device_supports_format(device, format)
+            && (format == SoundIoFormatFloat32NE || format == SoundIoFormatS32NE
+                || format == SoundIoFormatS16NE || format == SoundIoFormatFloat64NE);
+        };
+        
+        // Prefer the explicitly requested format, then the device's native format,
+        //   then whatever we can write with the least conversion work in the server.
+        SoundIoFormat format = SoundIoFormatInvalid;
+        for (auto candidate : { requested, device->current_format,
+                                SoundIoFormatFloat32NE, SoundIoFormatS32NE, SoundIoFormatS16NE, SoundIoFormatFloat64NE })
+          if (is_supported(candidate))
+          {
+            format = candidate;
+            break;
+          }
+        
+        switch (format)
+        {
+          case SoundIoFormatS16NE: m_write_bus = &write_bus<SoundIoFormatS16NE>; break;
+          case SoundIoFormatS32NE: m_write_bus = &write_bus<SoundIoFormatS32NE>; break;
+          case SoundIoFormatFloat32NE: m_write_bus = &write_bus<SoundIoFormatFloat32NE>; break;
+          case SoundIoFormatFloat64NE: m_write_bus = &write_bus<SoundIoFormatFloat64NE>; break;
+          default: throw std::runtime_error("No suitable device format available.");
+        }
+        m_outstream->format = format;
+      }
+      
+      void write_callback(struct SoundIoOutStream* outstream, int /*frame_count_min*/, int frame_count_max)
+      {
+        const auto callback_start = m_mixer->now();
+        const uint64_t period = m_mixer->begin_period();
+        
+        // The queue has room again, so the event thread moves on what waits in the overflow.
+        if (m_mixer->has_overflow())
+          soundio_wakeup(m_device->soundio);
+        
+        // After an unrecoverable error the stream is left alone. The API thread learns about
+        //   it from check_error() and get_output_stats(). The event thread is woken again on
+        //   every callback until it replaces the stream, in case it missed the first wakeup.
+        if (m_failed.load(std::memory_order_relaxed))
+        {
+          soundio_wakeup(m_device->soundio);
+          m_mixer->end_period(callback_start, 0);
+          return;
+        }
+        
+        const int channel_count = outstream->layout.channel_count;
+        const int block_frames = m_mixer->get_block_frames();
+        struct SoundIoChannelArea* areas;
+        int err;
+        int frames_left = frame_count_max;
+        int frames_written = 0;
+        
+        while (frames_left > 0)
+        {
+          int frame_count = frames_left;
+          if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count)))
+          {
+            push_error(StreamErrorSite::BeginWrite, err, period);
+            set_failed();
+            break;
+          }
+          if (!frame_count)
+            break;
+          
+          for (int block_start = 0; block_start < frame_count; block_start += block_frames)
+          {
+            int frames = std::min(block_frames, frame_count - block_start);
+            m_write_bus(areas, m_mixer->mix_block(frames), frames, channel_count);
+          }
+          
+          if ((err = soundio_outstream_end_write(outstream)))
+          {
+            if (err == SoundIoErrorUnderflow)
+              break;
+            push_error(StreamErrorSite::EndWrite, err, period);
+            set_failed();
+            break;
+          }
+          
+          frames_left -= frame_count;
+          frames_written += frame_count;
+        }
+        
+        measure_latency(outstream);
+        m_mixer->end_period(callback_start, frames_written);
+      }
+      
+      void measure_latency(struct SoundIoOutStream* outstream)
+      {
+        double latency = 0.0;
+        if (soundio_outstream_get_latency(outstream, &latency) != 0)
+          return;
+        // Only the callback writes these, so plain loads and stores suffice.
+        auto n = m_num_latency_measurements.load(std::memory_order_relaxed);
+        double smoothed = n == 0 ? latency : m_smoothed_latency.load(std::memory_order_relaxed);
+        m_measured_latency.store(latency, std::memory_order_relaxed);
+        m_smoothed_latency.store(smoothed + (latency - smoothed) * c_latency_smoothing, std::memory_order_relaxed);
+        m_num_latency_measurements.store(n + 1, std::memory_order_relaxed);
+      }
+      
+      double resolve_latency(SoundIoDevice* device, const LatencyPolicy& policy) const
+      {
+        const double period = static_cast<double>(m_mixer->get_block_frames()) / m_outstream->sample_rate;
+        double latency = policy.target_seconds;
+        if (policy.min_periods > 0)
+          latency = std::max(latency, policy.min_periods * period);
+        if (policy.max_periods > 0 && latency > 0.0)
+          latency = std::min(latency, policy.max_periods * period);
+        if (latency > 0.0 && device->software_latency_max > 0.0)
+          latency = std::clamp(latency, device->software_latency_min, device->software_latency_max);
+        return latency;
+      }
+      
+    public:
+      // Weight of the newest measurement in LatencyInfo::smoothed_seconds.
+      static constexpr double c_latency_smoothing = 0.05;
+      static constexpr size_t c_error_queue_capacity = 64;
+      
+      // Takes a reference to the device.
+      OutputStream(Mixer* mixer, SoundIoDevice* device, const InitParams& params)
+        : m_mixer(mixer)
+        , m_device(device)
+      {
+        soundio_device_ref(m_device);
+        m_outstream = soundio_outstream_create(device);
+        if (m_outstream == nullptr)
+        {
+          soundio_device_unref(m_device);
+          throw std::runtime_error("Out of memory.");
+        }
+        
+        try
+        {
+          select_format(device, params.format);
+        }
+        catch (...)
+        {
+          soundio_outstream_destroy(m_outstream);
+          soundio_device_unref(m_device);
+          throw;
+        }
+        int sample_rate = params.sample_rate;
+        if (sample_rate <= 0)
+          sample_rate = device->sample_rate_current > 0 ? device->sample_rate_current : 48000;
+        m_outstream->sample_rate = soundio_device_nearest_sample_rate(device, sample_rate);
+        m_outstream->name = "AudioLibSwitcher_libsoundio";
+        m_outstream->userdata = this;
+        m_outstream->write_callback = write_func_proxy;
+        m_outstream->underflow_callback = underflow_callback;
+        m_outstream->error_callback = error_callback;
+        m_requested_latency = resolve_latency(device, params.latency);
+        m_outstream->software_latency = m_requested_latency;
+      }
+      
+      // Joins the callback thread, if it was started.
+      ~OutputStream()
+      {
+        soundio_outstream_destroy(m_outstream);
+        soundio_device_unref(m_device);
+      }
+      
+      OutputStream(const OutputStream&) = delete;
+      OutputStream& operator=(const OutputStream&) = delete;
+      
+      void open()
+      {
+        if (int err = soundio_outstream_open(m_outstream); err != 0)
+          throw std::runtime_error("unable to open device: " + std::string(soundio_strerror(err)));
+        if (m_outstream->layout_error)
+          throw std::runtime_error("unable to set channel layout: " + std::string(soundio_strerror(m_outstream->layout_error)));
+      }
+      
+      void start()
+      {
+        if (int err = soundio_outstream_start(m_outstream); err != 0)
+          throw std::runtime_error("unable to start device: " + std::string(soundio_strerror(err)));
+        m_started = true;
+      }
+      
+      // API thread. Formats and removes the errors posted by the audio thread so far.
+      std::vector<std::string> drain_errors()
+      {
+        std::vector<std::string> messages;
+        StreamError error;
+        while (m_errors.try_pop(error))
+        {
+          const char* site = error.site == StreamErrorSite::BeginWrite ? "begin_write" : "end_write";
+          messages.emplace_back("Stream error in " + std::string(site) + " (period " + std::to_string(error.period)
+                                + "): " + soundio_strerror(error.code));
+        }
+        if (int err = m_stream_error.exchange(0, std::memory_order_acq_rel); err != 0)
+          messages.emplace_back("Stream error: " + std::string(soundio_strerror(err)));
+        return messages;
+      }
+      
+      OutputStats get_output_stats() const
+      {
+        OutputStats stats;
+        stats.num_underflows = m_num_underflows.load(std::memory_order_relaxed);
+        stats.num_dropped_errors = m_num_dropped_errors.load(std::memory_order_relaxed);
+        stats.failed = m_failed.load(std::memory_order_acquire);
+        return stats;
+      }
+      
+      bool has_failed() const { return m_failed.load(std::memory_order_acquire); }
+      
+      LatencyInfo get_latency_info() const
+      {
+        LatencyInfo info;
+        info.requested_seconds = m_requested_latency;
+        info.negotiated_seconds = m_outstream->software_latency;
+        info.measured_seconds = m_measured_latency.load(std::memory_order_relaxed);
+        info.smoothed_seconds = m_smoothed_latency.load(std::memory_order_relaxed);
+        info.num_measurements = m_num_latency_measurements.load(std::memory_order_relaxed);
+        return info;
+      }
+      
+      SoundIoDevice* get_device() const { return m_device; }
+      
+      int get_sample_rate() const { return m_outstream->sample_rate; }
+      
+      SoundIoFormat get_format() const { return m_outstream->format; }
+      
+      const SoundIoChannelLayout& get_layout() const { return m_outstream->layout; }
+    };
+    
+    // Source class. API thread side mirror of the voice it is bound to, if any.
+    struct Source
+    {
+      static constexpr uint32_t c_no_voice = ~0u;
+      
+      // Shared with the buffer manager and other sources. The bound voice reads it through a
+      //   raw pointer, so the source hands its reference to the reclaimer when letting go.
+      std::shared_ptr<const Buffer> buffer;
+      // Set for sources created with create_streaming_source(). A stream source has no buffer.
+      std::shared_ptr<WavStream> stream;
+      uint32_t voice = c_no_voice;
+      uint32_t play_serial = 0;
+      int priority = 0;
+      bool is_playing = false;
+      bool is_paused = false;
+      bool looping = false;
+      float volume = 1.f;
+      float pan = 0.f;
+      float pitch = 1.f;
+      ResamplerQuality quality = ResamplerQuality::Cubic;
+      // Mixer bus slot, see BusManager.
+      uint32_t bus = 0;
+      EffectParams effects[c_max_effects];
+      // Behind effects[i].reverb. Handed to the reclaimer like the buffer.
+      std::shared_ptr<Convolver> reverbs[c_max_effects];
+    };
+    
+    using SourceId = SlotMap<Source>::Handle;
+    using BufferId = SlotMap<std::shared_ptr<const Buffer>>::Handle;
+    
+    // Sources are unlimited, but only sources that are playing or paused hold one of the
+    //   mixer's fixed number of voices. The voices exist from init() on, so triggering a
+    //   sound only costs one command and is audible from the next callback period.
+    // When all voices are taken, play() steals the voice of the lowest priority source,
+    //   oldest first, provided that priority does not exceed the new source's priority.
+    class SourceManager
+    {
+    private:
+      struct VoiceSlot
+      {
+        SourceId owner = SlotMap<Source>::c_invalid_handle;
+        uint64_t start_order = 0;
+      };
+      
+      SlotMap<Source> m_sources;
+      Mixer* m_mixer = nullptr;
+      WavStreamer* m_streamer = nullptr;
+      Reclaimer* m_reclaimer = nullptr;
+      ResamplerQuality m_default_quality = ResamplerQuality::Cubic;
+      std::vector<uint32_t> m_free_voices;
+      std::vector<VoiceSlot> m_voice_slots;
+      // Per voice, bit i set while effect slot i of the voice's chain is in use. Survives the
+      //   release of the voice, as the chain does.
+      std::vector<uint8_t> m_voice_effects;
+      std::vector<SourceId> m_finished_sources;
+      uint32_t m_play_serial = 0;
+      uint32_t m_group = 0;
+      uint64_t m_start_order = 0;
+      uint64_t m_num_steals = 0;
+      
+      void post(const Source& source, SourceCommandType type)
+      {
+        SourceCommand cmd;
+        cmd.type = type;
+        cmd.voice = source.voice;
+        cmd.play_serial = source.play_serial;
+        m_mixer->post(cmd);
+      }
+      
+      void release_voice(Source& source)
+      {
+        if (source.voice == Source::c_no_voice)
+          return;
+        m_voice_slots[source.voice] = VoiceSlot {};
+        m_free_voices.emplace_back(source.voice);
+        source.voice = Source::c_no_voice;
+      }
+      
+      // The voice may read the stream or buffer until the mixer has applied the Stop,
+      //   SetBuffer or Play posted for it, i.e. every command posted so far.
+      void retire_stream(Source& source)
+      {
+        if (source.stream == nullptr)
+          return;
+        m_streamer->remove(source.stream.get());
+        m_reclaimer->retire(std::move(source.stream), m_mixer->get_epoch());
+        source.stream = nullptr;
+      }
+      
+      void retire_buffer(Source& source)
+      {
+        m_reclaimer->retire(std::move(source.buffer), m_mixer->get_epoch());
+        source.buffer = nullptr;
+      }
+      
+      void post_effect(uint32_t voice, int slot, const EffectParams& params)
+      {
+        SourceCommand cmd { SourceCommandType::SetEffect, voice };
+        cmd.index = static_cast<uint8_t>(slot);
+        cmd.effect = params;
+        m_mixer->post(cmd);
+        if (params.type != EffectType::None)
+          m_voice_effects[voice] |= static_cast<uint8_t>(1u << slot);
+        else
+          m_voice_effects[voice] &= static_cast<uint8_t>(~(1u << slot));
+      }
+      
+      // A voice that changes hands still has the previous owner's effects.
+      void sync_effects(const Source& source)
+      {
+        for (int slot = 0; slot < c_max_effects; ++slot)
+          if (source.effects[slot].type != EffectType::None || (m_voice_effects[source.voice] & (1u << slot)) != 0)
+            post_effect(source.voice, slot, source.effects[slot]);
+      }
+      
+      // Returns Source::c_no_voice if every voice belongs to a higher priority source.
+      uint32_t acquire_voice(SourceId source_id, int priority)
+      {
+        uint32_t voice = Source::c_no_voice;
+        if (!m_free_voices.empty())
+        {
+          voice = m_free_voices.back();
+          m_free_voices.pop_back();
+        }
+        else
+        {
+          Source* victim = nullptr;
+          uint64_t victim_order = 0;
+          for (uint32_t v = 0; v < m_voice_slots.size(); ++v)
+          {
+            auto* owner = m_sources.get(m_voice_slots[v].owner);
+            if (owner == nullptr || owner->priority > priority)
+              continue;
+            if (victim == nullptr || owner->priority < victim->priority
+                || (owner->priority == victim->priority && m_voice_slots[v].start_order < victim_order))
+            {
+              victim = owner;
+              victim_order = m_voice_slots[v].start_order;
+              voice = v;
+            }
+          }
+          if (victim == nullptr)
+            return Source::c_no_voice;
+          
+          // The Play command that follows overwrites the voice, so no Stop is needed.
+          //   Report the stolen source like one that played to its end.
+          victim->voice = Source::c_no_voice;
+          victim->is_playing = false;
+          victim->is_paused = false;
+          m_finished_sources.emplace_back(m_voice_slots[voice].owner);
+          m_num_steals++;
+        }
+        m_voice_slots[voice].owner = source_id;
+        m_voice_slots[voice].start_order = m_start_order++;
+        return voice;
+      }
+      
+    public:
+      SourceManager(Mixer* mixer, WavStreamer* streamer, Reclaimer* reclaimer, ResamplerQuality default_quality)
+        : m_mixer(mixer)
+        , m_streamer(streamer)
+        , m_reclaimer(reclaimer)
+        , m_default_quality(default_quality)
+        , m_voice_slots(mixer->get_max_voices())
+        , m_voice_effects(mixer->get_max_voices(), 0)
+      {
+        auto num_voices = static_cast<uint32_t>(mixer->get_max_voices());
+        m_free_voices.reserve(num_voices);
+        for (uint32_t v = num_voices; v > 0; --v)
+          m_free_voices.emplace_back(v - 1);
+      }
+      
+      SourceId add_source()
+      {
+        Source source;
+        source.quality = m_default_quality;
+        return m_sources.insert(source);
+      }
+      
+      SourceId add_streaming_source(const std::string& wav_path, const StreamParams& params)
+      {
+        Source source;
+        source.quality = m_default_quality;
+        source.stream = std::make_shared<WavStream>(wav_path, params);
+        m_streamer->add(source.stream);
+        return m_sources.insert(std::move(source));
+      }
+      
+      bool remove_source(SourceId source_id)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          // Commands are applied in order, so the voice is clean before anyone reuses it.
+          if (source->voice != Source::c_no_voice)
+            post(*source, SourceCommandType::Stop);
+          release_voice(*source);
+          retire_stream(*source);
+          retire_buffer(*source);
+          for (auto& reverb : source->reverbs)
+            m_reclaimer->retire(std::move(reverb), m_mixer->get_epoch());
+          std::erase(m_finished_sources, source_id);
+        }
+        return m_sources.erase(source_id);
+      }
+      
+      // Applies pending events from the mixer callback to the source mirrors.
+      void process_events()
+      {
+        SourceEvent event;
+        while (m_mixer->poll_event(event))
+        {
+          if (event.type != SourceEventType::Finished || event.voice >= m_voice_slots.size())
+            continue;
+          auto src_id = m_voice_slots[event.voice].owner;
+          auto* source = m_sources.get(src_id);
+          // Ignore events from an earlier play() that has since been stopped, restarted or stolen.
+          if (source != nullptr && source->play_serial == event.play_serial && source->voice == event.voice)
+          {
+            source->is_playing = false;
+            source->is_paused = false;
+            release_voice(*source);
+            m_finished_sources.emplace_back(src_id);
+          }
+        }
+        
+        m_reclaimer->collect(m_mixer->get_applied_epoch());
+      }
+      
+      // Returns the ids of the sources that reached their end, or lost their voice to a
+      //   higher priority source, since the last call.
+      std::vector<SourceId> fetch_finished_sources()
+      {
+        process_events();
+        std::vector<SourceId> finished;
+        finished.swap(m_finished_sources);
+        return finished;
+      }
+      
+      bool is_playing(SourceId source_id)
+      {
+        process_events();
+        if (const auto* source = m_sources.get(source_id))
+          return source->is_playing;
+        else
+          return false;
+      }
+      
+      // fade_in > 0 ramps the source up from silence over that many seconds.
+      //   If crossfade_from is playing, it is faded out and stopped over the same time,
+      //   starting in the same mix block as this source.
+      //   frame is the device frame to start on, 0 for as soon as possible. A nonzero group
+      //   holds the start until release_group().
+      void play(SourceId source_id, float fade_in = 0.f, FadeCurve curve = FadeCurve::Linear,
+                SourceId crossfade_from = SlotMap<Source>::c_invalid_handle, uint64_t frame = 0, uint32_t group = 0)
+      {
+        process_events();
+        auto* source = m_sources.get(source_id);
+        if (source == nullptr)
+          return;
+        
+        if (source->is_paused && source->voice != Source::c_no_voice)
+        {
+          source->is_paused = false;
+          SourceCommand cmd { SourceCommandType::Resume, source->voice, source->play_serial };
+          cmd.frame = frame;
+          cmd.group = group;
+          m_mixer->post(cmd);
+          return;
+        }
+        
+        if (source->buffer == nullptr && source->stream == nullptr)
+          return;
+        if (source->voice == Source::c_no_voice)
+        {
+          source->voice = acquire_voice(source_id, source->priority);
+          if (source->voice == Source::c_no_voice)
+            return;
+          sync_effects(*source);
+        }
+        source->is_playing = true;
+        source->is_paused = false;
+        source->play_serial = ++m_play_serial;
+        
+        SourceCommand cmd { SourceCommandType::Play, source->voice, source->play_serial };
+        cmd.buffer = source->buffer.get();
+        if (source->buffer != nullptr)
+          source->buffer->touch();
+        if (source->stream != nullptr)
+        {
+          source->stream->set_looping(source->looping);
+          cmd.stream = source->stream.get();
+          cmd.stream_epoch = source->stream->restart();
+          m_streamer->wake();
+        }
+        cmd.value = source->volume;
+        cmd.pan = source->pan;
+        cmd.pitch = source->pitch;
+        cmd.flag = source->looping;
+        cmd.quality = source->quality;
+        cmd.duration = fade_in;
+        cmd.curve = curve;
+        cmd.frame = frame;
+        cmd.group = group;
+        cmd.bus = source->bus;
+        if (const auto* outgoing = m_sources.get(crossfade_from);
+            outgoing != nullptr && outgoing->voice != Source::c_no_voice && outgoing->is_playing)
+        {
+          cmd.crossfade_voice = outgoing->voice;
+          cmd.crossfade_serial = outgoing->play_serial;
+        }
+        m_mixer->post(cmd);
+      }
+      
+      // The source keeps playing up to the device frame and is then reported by
+      //   fetch_finished_sources(). A nonzero group holds the stop until release_group().
+      void stop_at(SourceId source_id, uint64_t frame, uint32_t group = 0)
+      {
+        auto* source = m_sources.get(source_id);
+        if (source != nullptr && source->voice != Source::c_no_voice)
+        {
+          SourceCommand cmd { SourceCommandType::StopAt, source->voice, source->play_serial };
+          cmd.frame = frame;
+          cmd.group = group;
+          m_mixer->post(cmd);
+        }
+      }
+      
+      // Returns a group id for play() and stop_at(), never 0.
+      uint32_t create_group()
+      {
+        if (++m_group == 0)
+          ++m_group;
+        return m_group;
+      }
+      
+      // Schedules everything held for group on the same device frame, 0 for as soon as possible.
+      //   Commands are applied in order, so the held starts and stops have all arrived by then.
+      void release_group(uint32_t group, uint64_t frame)
+      {
+        SourceCommand cmd { SourceCommandType::ReleaseGroup };
+        cmd.group = group;
+        cmd.frame = frame;
+        m_mixer->post(cmd);
+      }
+      
+      SourcePosition get_position(SourceId source_id)
+      {
+        process_events();
+        SourcePosition position;
+        const auto* source = m_sources.get(source_id);
+        if (source != nullptr && source->voice != Source::c_no_voice && source->is_playing)
+          position.is_valid = m_mixer->get_voice_position(source->voice, source->play_serial,
+                                                          position.seconds, position.device_frame);
+        if (!position.is_valid)
+          position = SourcePosition {};
+        return position;
+      }
+      
+      void pause(SourceId source_id)
+      {
+        auto* source = m_sources.get(source_id);
+        if (source != nullptr && source->voice != Source::c_no_voice)
+        {
+          source->is_paused = true;
+          post(*source, SourceCommandType::Pause);
+        }
+      }
+      
+      void stop(SourceId source_id)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->is_playing = false;
+          source->is_paused = false;
+          if (source->voice != Source::c_no_voice)
+            post(*source, SourceCommandType::Stop);
+          release_voice(*source);
+        }
+      }
+      
+      void set_volume(SourceId source_id, float volume)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->volume = volume;
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetVolume, source->voice };
+            cmd.value = volume;
+            m_mixer->post(cmd);
+          }
         }
       }
       
-      void set_volume(size_t source_id, float volume)
+      void set_pan(SourceId source_id, float pan)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->pan = std::clamp(pan, -1.f, 1.f);
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetPan, source->voice };
+            cmd.value = source->pan;
+            m_mixer->post(cmd);
+          }
+        }
+      }
+      
+      // Fades on top of the source volume. With stop_at_end the source finishes once the
+      //   fade is complete and is reported by fetch_finished_sources().
+      void fade(SourceId source_id, float gain, float seconds, FadeCurve curve, bool stop_at_end)
+      {
+        if (auto* source = m_sources.get(source_id); source != nullptr && source->voice != Source::c_no_voice)
+        {
+          SourceCommand cmd { SourceCommandType::Fade, source->voice };
+          cmd.value = gain;
+          cmd.duration = seconds;
+          cmd.curve = curve;
+          cmd.flag = stop_at_end;
+          m_mixer->post(cmd);
+        }
+      }
+      
+      void set_pitch(SourceId source_id, float pitch)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->pitch = pitch;
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetPitch, source->voice };
+            cmd.value = pitch;
+            m_mixer->post(cmd);
+          }
+        }
+      }
+      
+      void set_looping(SourceId source_id, bool looping)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->looping = looping;
+          if (source->stream != nullptr)
+            source->stream->set_looping(looping);
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetLooping, source->voice };
+            cmd.flag = looping;
+            m_mixer->post(cmd);
+          }
+        }
+      }
+      
+      void set_resampler_quality(SourceId source_id, ResamplerQuality quality)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->quality = quality;
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetResamplerQuality, source->voice };
+            cmd.quality = quality;
+            m_mixer->post(cmd);
+          }
+        }
+      }
+      
+      void set_bus(SourceId source_id, uint32_t bus)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          source->bus = bus;
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetBus, source->voice };
+            cmd.bus = bus;
+            m_mixer->post(cmd);
+          }
+        }
+      }
+      
+      // params.type EffectType::None clears the slot. A reverb needs ir; it gets its own
+      //   Convolver unless the slot already convolves with ir.
+      void set_effect(SourceId source_id, int slot, EffectParams params, std::shared_ptr<const ImpulseResponse> ir)
+      {
+        auto* source = m_sources.get(source_id);
+        if (source == nullptr)
+          return;
+        std::shared_ptr<Convolver> reverb;
+        if (params.type == EffectType::Reverb)
+          reverb = reuse_or_make_convolver(source->reverbs[slot], std::move(ir));
+        params.reverb = reverb.get();
+        source->effects[slot] = params;
+        if (source->voice != Source::c_no_voice)
+          post_effect(source->voice, slot, params);
+        if (source->reverbs[slot] != reverb)
+          m_reclaimer->retire(std::move(source->reverbs[slot]), m_mixer->get_epoch());
+        source->reverbs[slot] = std::move(reverb);
+      }
+      
+      // Follows a RemoveBus, which moves the voices on the bus by itself.
+      void move_bus_sources(uint32_t from_bus, uint32_t to_bus)
+      {
+        m_sources.for_each([=](SourceId, Source& source)
+        {
+          if (source.bus == from_bus)
+            source.bus = to_bus;
+        });
+      }
+      
+      void set_priority(SourceId source_id, int priority)
+      {
+        if (auto* source = m_sources.get(source_id))
+          source->priority = priority;
+      }
+      
+      void attach_buffer_to_source(SourceId source_id, std::shared_ptr<const Buffer> buffer)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          if (source->voice != Source::c_no_voice)
+          {
+            SourceCommand cmd { SourceCommandType::SetBuffer, source->voice };
+            cmd.buffer = buffer.get();
+            m_mixer->post(cmd);
+          }
+          retire_buffer(*source);
+          retire_stream(*source);
+          source->buffer = std::move(buffer);
+        }
+      }
+      
+      void clear_buffer(SourceId source_id)
+      {
+        if (auto* source = m_sources.get(source_id))
+        {
+          stop(source_id);
+          retire_buffer(*source);
+          retire_stream(*source);
+        }
+      }
+      
+      void set_standard_params(SourceId /*source_id*/)
+      {
+      
+      }
+      
+      size_t get_num_free_voices() const { return m_free_voices.size(); }
+      
+      // Calls func(voice, source_id) for every voice currently held by a source.
+      template<typename Func>
+      void for_each_bound_voice(Func func) const
+      {
+        for (uint32_t v = 0; v < m_voice_slots.size(); ++v)
+          if (m_sources.contains(m_voice_slots[v].owner))
+            func(v, m_voice_slots[v].owner);
+      }
+      
+      uint64_t get_num_voice_steals() const { return m_num_steals; }
+      
+      // Streams and buffers dropped by sources that the callback may still be reading.
+      size_t get_num_pending_reclaims() const { return m_reclaimer->get_num_pending(); }
+      
+      StreamStats get_stream_stats(SourceId source_id) const
+      {
+        const auto* source = m_sources.get(source_id);
+        if (source != nullptr && source->stream != nullptr)
+          return source->stream->get_stats();
+        return {};
+      }
+    };
+    
+    // API thread side mirror of a bus in the mixer's pool. Other buses are referred to by
+    //   their BusId.
+    struct Bus
+    {
+      // SlotMap<Bus>::c_invalid_handle, which cannot be named while Bus is incomplete.
+      static constexpr uint32_t c_no_bus = ~0u;
+      
+      struct Send
+      {
+        uint32_t target = c_no_bus;
+        float level = 0.f;
+      };
+      
+      uint32_t slot = 0;
+      uint32_t output = c_no_bus;
+      Send sends[MixBus::c_max_sends];
+      // Behind the reverbs in the mixer's effect chain for the bus.
+      std::shared_ptr<Convolver> reverbs[c_max_effects];
+    };
+    
+    using BusId = SlotMap<Bus>::Handle;
+    
+    // Sources feed buses, buses feed their output bus and their sends, and everything ends
+    //   up on the master bus, which always exists. The routing never forms a cycle: a change
+    //   that would is refused. The mixer has a fixed pool of buses, so changing the routing
+    //   is just a command like any other and never allocates on the audio thread.
+    class BusManager
+    {
+      SlotMap<Bus> m_buses;
+      Mixer* m_mixer = nullptr;
+      BusId m_master = Bus::c_no_bus;
+      std::vector<uint32_t> m_free_slots;
+      Reclaimer* m_reclaimer = nullptr;
+      
+      void post(SourceCommandType type, const Bus& bus, uint32_t target = 0)
+      {
+        SourceCommand cmd { type };
+        cmd.bus = bus.slot;
+        cmd.target = target;
+        m_mixer->post(cmd);
+      }
+      
+      // True if audio from bus from reaches bus to.
+      bool feeds(BusId from, BusId to) const
+      {
+        std::vector<BusId> pending { from };
+        std::vector<bool> visited(m_mixer->get_max_buses(), false);
+        while (!pending.empty())
+        {
+          const BusId bus_id = pending.back();
+          pending.pop_back();
+          if (bus_id == to)
+            return true;
+          const auto* bus = m_buses.get(bus_id);
+          if (bus == nullptr || visited[bus->slot])
+            continue;
+          visited[bus->slot] = true;
+          pending.emplace_back(bus->output);
+          for (const auto& send : bus->sends)
+            pending.emplace_back(send.target);
+        }
+        return false;
+      }
+      
+      Bus& get_routable(BusId bus_id, BusId target_id, const char* what)
+      {
+        auto* bus = m_buses.get(bus_id);
+        if (bus == nullptr || !m_buses.contains(target_id))
+          throw std::runtime_error(std::string("Unknown bus passed to ") + what + ".");
+        if (feeds(target_id, bus_id))
+          throw std::runtime_error(std::string(what) + " would route the bus into itself.");
+        return *bus;
+      }
+      
+    public:
+      // Shares the reclaimer with the SourceManager, whose process_events() collects it.
+      BusManager(Mixer* mixer, Reclaimer* reclaimer)
+        : m_mixer(mixer)
+        , m_reclaimer(reclaimer)
+      {
+        // Slot 0 is the master bus, which the mixer enables itself. Being the first handle,
+        //   its id is c_master_bus.
+        m_master = m_buses.insert(Bus {});
+        auto num_slots = static_cast<uint32_t>(mixer->get_max_buses());
+        for (uint32_t b = num_slots; b > 1; --b)
+          m_free_slots.emplace_back(b - 1);
+      }
+      
+      BusId get_master() const { return m_master; }
+      
+      BusId add_bus(BusId output_id)
+      {
+        const auto* output = m_buses.get(output_id);
+        if (output == nullptr)
+          throw std::runtime_error("Unknown output bus passed to create_bus().");
+        if (m_free_slots.empty())
+          throw std::runtime_error("No free bus. Raise InitParams::max_buses.");
+        Bus bus;
+        bus.slot = m_free_slots.back();
+        bus.output = output_id;
+        post(SourceCommandType::AddBus, bus, output->slot);
+        m_free_slots.pop_back();
+        return m_buses.insert(bus);
+      }
+      
+      // Buses feeding the removed bus are rerouted to its output and sends to it are
+      //   dropped. Returns the slots of the bus and its output for rerouting the sources.
+      bool remove_bus(BusId bus_id, uint32_t& slot, uint32_t& output_slot)
+      {
+        auto* bus = m_buses.get(bus_id);
+        if (bus == nullptr || bus_id == m_master)
+          return false;
+        slot = bus->slot;
+        output_slot = m_buses.get(bus->output)->slot;
+        post(SourceCommandType::RemoveBus, *bus, output_slot);
+        for (auto& reverb : bus->reverbs)
+          m_reclaimer->retire(std::move(reverb), m_mixer->get_epoch());
+        m_reclaimer->collect(m_mixer->get_applied_epoch());
+        const BusId output_id = bus->output;
+        m_buses.for_each([=](BusId, Bus& other)
+        {
+          if (other.output == bus_id)
+            other.output = output_id;
+          for (auto& send : other.sends)
+            if (send.target == bus_id)
+              send = Bus::Send {};
+        });
+        m_free_slots.emplace_back(slot);
+        return m_buses.erase(bus_id);
+      }
+      
+      void set_output(BusId bus_id, BusId output_id)
+      {
+        if (bus_id == m_master)
+          throw std::runtime_error("The master bus has no output.");
+        auto& bus = get_routable(bus_id, output_id, "set_bus_output()");
+        bus.output = output_id;
+        post(SourceCommandType::SetBusOutput, bus, m_buses.get(output_id)->slot);
+      }
+      
+      void set_gain(BusId bus_id, float gain)
+      {
+        if (const auto* bus = m_buses.get(bus_id))
+        {
+          SourceCommand cmd { SourceCommandType::SetBusGain };
+          cmd.bus = bus->slot;
+          cmd.value = gain;
+          m_mixer->post(cmd);
+        }
+      }
+      
+      void set_muted(BusId bus_id, bool muted)
+      {
+        if (const auto* bus = m_buses.get(bus_id))
+        {
+          SourceCommand cmd { SourceCommandType::SetBusMute };
+          cmd.bus = bus->slot;
+          cmd.flag = muted;
+          m_mixer->post(cmd);
+        }
+      }
+      
+      // Adds, changes or, with level <= 0, removes the send from a bus to target.
+      void set_send(BusId bus_id, BusId target_id, float level)
+      {
+        auto& bus = get_routable(bus_id, target_id, "set_bus_send()");
+        int index = -1;
+        for (int s = 0; s < MixBus::c_max_sends && index < 0; ++s)
+          if (bus.sends[s].target == target_id)
+            index = s;
+        if (level <= 0.f)
+        {
+          if (index < 0)
+            return;
+          bus.sends[index] = Bus::Send {};
+        }
+        else
+        {
+          for (int s = 0; s < MixBus::c_max_sends && index < 0; ++s)
+            if (bus.sends[s].target == Bus::c_no_bus)
+              index = s;
+          if (index < 0)
+            throw std::runtime_error("The bus has no free send.");
+          bus.sends[index] = { target_id, level };
+        }
+        SourceCommand cmd { SourceCommandType::SetBusSend };
+        cmd.bus = bus.slot;
+        cmd.target = level > 0.f ? m_buses.get(target_id)->slot : MixBus::c_no_bus;
+        cmd.value = std::max(level, 0.f);
+        cmd.index = static_cast<uint8_t>(index);
+        m_mixer->post(cmd);
+      }
+      
+      // As SourceManager::set_effect(). The bus's reverbs keep ringing after its inputs stop.
+      void set_effect(BusId bus_id, int slot, EffectParams params, std::shared_ptr<const ImpulseResponse> ir)
+      {
+        m_reclaimer->collect(m_mixer->get_applied_epoch());
+        auto* bus = m_buses.get(bus_id);
+        if (bus == nullptr)
+          return;
+        std::shared_ptr<Convolver> reverb;
+        if (params.type == EffectType::Reverb)
+          reverb = reuse_or_make_convolver(bus->reverbs[slot], std::move(ir));
+        params.reverb = reverb.get();
+        SourceCommand cmd { SourceCommandType::SetBusEffect };
+        cmd.bus = bus->slot;
+        cmd.index = static_cast<uint8_t>(slot);
+        cmd.effect = params;
+        m_mixer->post(cmd);
+        if (bus->reverbs[slot] != reverb)
+          m_reclaimer->retire(std::move(bus->reverbs[slot]), m_mixer->get_epoch());
+        bus->reverbs[slot] = std::move(reverb);
+      }
+      
+      // The mixer's slot for a bus, or MixBus::c_no_bus for an unknown bus.
+      uint32_t get_slot(BusId bus_id) const
+      {
+        const auto* bus = m_buses.get(bus_id);
+        return bus != nullptr ? bus->slot : MixBus::c_no_bus;
+      }
+      
+      size_t get_num_buses() const { return m_buses.size(); }
+    };
+    
+    // A Buffer never changes once published. Setting new data replaces the buffer behind
+    //   the id, and sources attached earlier keep playing the data they were attached with,
+    //   like OpenAL, which refuses new data for an attached buffer. Removing a buffer only
+    //   drops the manager's reference: the memory goes once no source holds it and the
+    //   callback has moved on, see Reclaimer.
+    // Copied data lives in the IPcmAllocator. All data counts against the memory budget
+    //   from upload until the last reference to it is gone.
+    class BufferManager
+    {
+      SlotMap<std::shared_ptr<const Buffer>> m_buffers;
+      std::shared_ptr<IPcmAllocator> m_allocator;
+      // Shared with the storage of every buffer, which may outlive the manager.
+      std::shared_ptr<std::atomic<size_t>> m_resident_bytes = std::make_shared<std::atomic<size_t>>(0);
+      size_t m_budget_bytes = 0;
+      std::function<void(unsigned int, size_t)> m_on_evict;
+      uint64_t m_num_evictions = 0;
+      uint64_t m_num_budget_overruns = 0;
+      
+      static void validate(size_t num_samples, const SoundIoChannelLayout& layout)
+      {
+        if (layout.channel_count < 1 || layout.channel_count > c_max_buffer_channels)
+          throw std::runtime_error("Buffers support 1 to " + std::to_string(c_max_buffer_channels) + " channels.");
+        if (num_samples % layout.channel_count != 0)
+          throw std::runtime_error("Buffer size is not a whole number of frames.");
+      }
+      
+      // Asks m_on_evict to drop the least recently used buffers that no source holds until
+      //   num_bytes more fit into the budget. Buffers held by sources are skipped, as
+      //   evicting them would not free anything yet. The data being replaced on buffer_id
+      //   counts as freed if nothing else holds it.
+      void make_room(BufferId buffer_id, size_t num_bytes)
+      {
+        if (m_budget_bytes == 0)
+          return;
+        size_t replaced_bytes = 0;
+        if (const auto* current = m_buffers.get(buffer_id); current != nullptr && current->use_count() == 1)
+          replaced_bytes = (*current)->num_bytes;
+        auto fits = [&]
+        {
+          return m_resident_bytes->load(std::memory_order_relaxed) + num_bytes <= m_budget_bytes + replaced_bytes;
+        };
+        if (fits())
+          return;
+        
+        if (m_on_evict)
+        {
+          std::vector<std::pair<int64_t, BufferId>> candidates;
+          m_buffers.for_each([&](BufferId id, const std::shared_ptr<const Buffer>& buffer)
+          {
+            if (id != buffer_id && buffer.use_count() == 1 && buffer->num_bytes > 0)
+              candidates.emplace_back(buffer->last_use, id);
+          });
+          std::sort(candidates.begin(), candidates.end());
+          // The hook may destroy or replace any buffer, so each candidate is looked up again.
+          for (const auto& [last_use, id] : candidates)
+          {
+            if (fits())
+              break;
+            const auto* candidate = m_buffers.get(id);
+            if (candidate == nullptr || candidate->use_count() != 1 || (*candidate)->num_bytes == 0)
+              continue;
+            m_num_evictions++;
+            m_on_evict(id, (*candidate)->num_bytes);
+          }
+        }
+        if (!fits())
+          m_num_budget_overruns++;
+      }
+      
+      void publish(BufferId buffer_id, std::shared_ptr<const void> storage, const void* samples,
+                   SampleType sample_type, size_t num_samples, const SoundIoChannelLayout& layout, int sample_rate)
+      {
+        auto* slot = m_buffers.get(buffer_id);
+        if (slot == nullptr)
+          return;
+        const size_t num_bytes = get_data_bytes(sample_type, num_samples / layout.channel_count, layout.channel_count);
+        m_resident_bytes->fetch_add(num_bytes, std::memory_order_relaxed);
+        std::shared_ptr<const void> tracked(samples,
+          [storage = std::move(storage), resident_bytes = m_resident_bytes, num_bytes](const void*)
+          {
+            resident_bytes->fetch_sub(num_bytes, std::memory_order_relaxed);
+          });
+        auto buffer = std::make_shared<Buffer>();
+        buffer->storage = std::move(tracked);
+        buffer->samples = samples;
+        buffer->num_frames = num_samples / layout.channel_count;
+        buffer->sample_type = sample_type;
+        buffer->layout = layout;
+        buffer->sample_rate = sample_rate;
+        buffer->num_bytes = num_bytes;
+        buffer->touch();
+        *slot = std::move(buffer);
+      }
+      
+      std::shared_ptr<void> allocate_storage(size_t num_bytes)
+      {
+        void* block = m_allocator->allocate(num_bytes);
+        return std::shared_ptr<void>(block, [allocator = m_allocator, num_bytes](void* ptr)
+        {
+          allocator->deallocate(ptr, num_bytes);
+        });
+      }
+      
+    public:
+      BufferManager(std::shared_ptr<IPcmAllocator> allocator, size_t budget_bytes,
+                    std::function<void(unsigned int, size_t)> on_evict)
+        : m_allocator(allocator != nullptr ? std::move(allocator) : std::make_shared<PoolPcmAllocator>())
+        , m_budget_bytes(budget_bytes)
+        , m_on_evict(std::move(on_evict))
+      {}
+      
+      BufferId add_buffer()
+      {
+        return m_buffers.insert(std::make_shared<const Buffer>());
+      }
+      
+      bool remove_buffer(BufferId buffer_id)
+      {
+        return m_buffers.erase(buffer_id);
+      }
+      
+      // Counts as a use for picking eviction candidates.
+      std::shared_ptr<const Buffer> get_buffer(BufferId buffer_id) const
+      {
+        if (const auto* buffer = m_buffers.get(buffer_id))
+        {
+          (*buffer)->touch();
+          return *buffer;
+        }
+        return nullptr;
+      }
+      
+      void set_buffer_data_mono_16(BufferId buffer_id, const std::vector<short>& short_buffer, int sample_rate)
+      {
+        copy_buffer_data(buffer_id, std::span<const short>(short_buffer), *soundio_channel_layout_get_default(1), sample_rate);
+      }
+      
+      void set_buffer_data_mono_16(BufferId buffer_id, std::vector<short>&& short_buffer, int sample_rate)
+      {
+        set_buffer_data_mono_16(buffer_id, std::make_shared<const std::vector<short>>(std::move(short_buffer)), sample_rate);
+      }
+      
+      void set_buffer_data_mono_16(BufferId buffer_id, std::shared_ptr<const std::vector<short>> block, int sample_rate)
+      {
+        set_buffer_data(buffer_id, std::move(block), *soundio_channel_layout_get_default(1), sample_rate);
+      }
+      
+      void set_buffer_data_mono_16(BufferId buffer_id, std::span<const short> samples, int sample_rate,
+                                   std::function<void()> release)
+      {
+        set_buffer_data(buffer_id, samples, *soundio_channel_layout_get_default(1), sample_rate, std::move(release));
+      }
+      
+      // Copies the samples into the allocator.
+      template<typename T>
+      void copy_buffer_data(BufferId buffer_id, std::span<const T> samples, const SoundIoChannelLayout& layout,
+                            int sample_rate)
+      {
+        if (!m_buffers.contains(buffer_id))
+          return;
+        validate(samples.size(), layout);
+        const size_t num_bytes = samples.size_bytes();
+        make_room(buffer_id, num_bytes);
+        auto storage = allocate_storage(num_bytes);
+        void* block = storage.get();
+        if (num_bytes > 0)
+          std::memcpy(block, samples.data(), num_bytes);
+        publish(buffer_id, std::move(storage), block, SampleTypeOf<T>::value, samples.size(), layout, sample_rate);
+      }
+      
+      // Encodes the samples as sample_type, SampleType::MuLaw or SampleType::ImaAdpcm, into
+      //   the allocator.
+      void encode_buffer_data(BufferId buffer_id, std::span<const short> samples, const SoundIoChannelLayout& layout,
+                              int sample_rate, SampleType sample_type)
+      {
+        if (sample_type != SampleType::MuLaw && sample_type != SampleType::ImaAdpcm)
+          throw std::runtime_error("Buffers can only be compressed to mu-law or IMA-ADPCM.");
+        if (!m_buffers.contains(buffer_id))
+          return;
+        validate(samples.size(), layout);
+        const size_t num_frames = samples.size() / layout.channel_count;
+        const size_t num_bytes = get_data_bytes(sample_type, num_frames, layout.channel_count);
+        make_room(buffer_id, num_bytes);
+        auto storage = allocate_storage(num_bytes);
+        auto* block = static_cast<uint8_t*>(storage.get());
+        if (sample_type == SampleType::MuLaw)
+          encode_mulaw(samples.data(), samples.size(), block);
+        else
+          encode_ima_adpcm(samples.data(), num_frames, layout.channel_count, block);
+        publish(buffer_id, std::move(storage), block, sample_type, samples.size(), layout, sample_rate);
+      }
+      
+      template<typename T>
+      void set_buffer_data(BufferId buffer_id, std::shared_ptr<const std::vector<T>> block,
+                           const SoundIoChannelLayout& layout, int sample_rate)
+      {
+        if (m_buffers.contains(buffer_id) && block != nullptr)
+        {
+          const T* samples = block->data();
+          size_t num_samples = block->size();
+          set_storage(buffer_id, std::move(block), samples, SampleTypeOf<T>::value, num_samples, layout, sample_rate);
+        }
+      }
+      
+      template<typename T>
+      void set_buffer_data(BufferId buffer_id, std::span<const T> samples, const SoundIoChannelLayout& layout,
+                           int sample_rate, std::function<void()> release)
+      {
+        if (m_buffers.contains(buffer_id))
+        {
+          std::shared_ptr<const void> storage(samples.data(), [release = std::move(release)](const void*)
+          {
+            if (release)
+              release();
+          });
+          set_storage(buffer_id, std::move(storage), samples.data(), SampleTypeOf<T>::value, samples.size(),
+                      layout, sample_rate);
+        }
+      }
+      
+      // num_samples counts samples of all channels, i.e. frames * layout.channel_count.
+      void set_storage(BufferId buffer_id, std::shared_ptr<const void> storage, const void* samples,
+                       SampleType sample_type, size_t num_samples, const SoundIoChannelLayout& layout, int sample_rate)
+      {
+        validate(num_samples, layout);
+        make_room(buffer_id, get_data_bytes(sample_type, num_samples / layout.channel_count, layout.channel_count));
+        publish(buffer_id, std::move(storage), samples, sample_type, num_samples, layout, sample_rate);
+      }
+      
+      // 0 for an unknown buffer.
+      size_t get_resident_bytes(BufferId buffer_id) const
+      {
+        if (const auto* buffer = m_buffers.get(buffer_id))
+          return (*buffer)->num_bytes;
+        return 0;
+      }
+      
+      std::vector<BufferMemoryInfo> get_buffer_memory() const
+      {
+        std::vector<BufferMemoryInfo> memory;
+        memory.reserve(m_buffers.size());
+        m_buffers.for_each([&memory](BufferId id, const std::shared_ptr<const Buffer>& buffer)
+        {
+          memory.push_back({ id, buffer->num_bytes, buffer.use_count() > 1 });
+        });
+        return memory;
+      }
+      
+      AudioMemoryStats get_memory_stats() const
+      {
+        AudioMemoryStats stats;
+        stats.resident_bytes = m_resident_bytes->load(std::memory_order_relaxed);
+        stats.budget_bytes = m_budget_bytes;
+        stats.num_buffers = m_buffers.size();
+        stats.num_evictions = m_num_evictions;
+        stats.num_budget_overruns = m_num_budget_overruns;
+        if (const auto* pool = dynamic_cast<const PoolPcmAllocator*>(m_allocator.get()))
+          stats.allocator = pool->get_stats();
+        return stats;
+      }
+    };
+    
+    // Streams, buffers and reverbs let go of by the sources and buses, until the mixer has
+    //   applied the commands that stopped it using them.
+    Reclaimer m_reclaimer;
+    std::unique_ptr<SourceManager> m_source_manager;
+    std::unique_ptr<BusManager> m_bus_manager;
+    std::unique_ptr<BufferManager> m_buffer_manager;
+    std::unique_ptr<Mixer> m_mixer;
+    std::unique_ptr<WavStreamer> m_streamer;
+    // Replaced on the event thread (or in init() and poll_device_events()) when the output
+    //   device changes. The API thread only reads it under m_output_mutex.
+    std::unique_ptr<OutputStream> m_output;
+    mutable std::mutex m_output_mutex;
+    
+    void connect_backend(SoundIoBackend backend)
+    {
+      int err = 0;
+      {
+        std::scoped_lock lock(m_backend_mutex);
+        err = backend == SoundIoBackendNone
+          ? soundio_connect(m_soundio)
+          : soundio_connect_backend(m_soundio, backend);
+      }
+      if (err)
+        throw std::runtime_error("Unable to connect to backend: " + std::string(soundio_strerror(err)));
+      m_backend_connected.store(true, std::memory_order_release);
+      
+      //fprintf(stderr, "Backend: %s\n", soundio_backend_name(soundio->current_backend));
+      soundio_flush_events(m_soundio);
+    }
+    
+    // The stream has to go first, libsoundio does not outlive its streams.
+    void disconnect_backend()
+    {
+      close_output();
+      {
+        std::scoped_lock lock(m_backend_mutex);
+        soundio_disconnect(m_soundio);
+      }
+      m_backend_connected.store(false, std::memory_order_release);
+    }
+    
+    // Returns a new reference to the matching output device, or nullptr.
+    //   Empty id and name select the default device. Raw devices are never selected.
+    SoundIoDevice* find_output_device(const std::string& device_id, const std::string& device_name) const
+    {
+      if (device_id.empty() && device_name.empty())
+      {
+        int index = soundio_default_output_device_index(m_soundio);
+        return index >= 0 ? soundio_get_output_device(m_soundio, index) : nullptr;
+      }
+      int device_count = soundio_output_device_count(m_soundio);
+      for (int i = 0; i < device_count; i += 1)
+      {
+        auto* device = soundio_get_output_device(m_soundio, i);
+        bool found = device->is_raw == false
+          && (device_id.empty() || strcmp(device->id, device_id.c_str()) == 0)
+          && (device_name.empty() || strcmp(device->name, device_name.c_str()) == 0);
+        if (found)
+          return device;
+        soundio_device_unref(device);
+      }
+      return nullptr;
+    }
+    
+    // Moves playback onto device. The new stream is opened while the old one keeps playing,
+    //   so the gap is the old stream's shutdown plus the new stream's first period. Voices
+    //   live in the mixer and keep their positions. Backends that refuse a second stream on
+    //   the same hardware get the old stream closed first.
+    void switch_output(SoundIoDevice* device)
+    {
+      if (device->probe_error)
+        throw std::runtime_error("Cannot probe device: " + std::string(soundio_strerror(device->probe_error)));
+      
+      auto output = std::make_unique<OutputStream>(m_mixer.get(), device, m_params);
+      try
       {
-        if (source_id < m_sources.size())
-        {
-          m_sources[source_id]->volume = volume;
-          // Code to set the volume of the source using libsoundio
-        }
+        output->open();
       }
-      
-      void set_pitch(size_t source_id, float pitch)
+      catch (const std::runtime_error&)
       {
-        if (source_id < m_sources.size())
-        {
-          m_sources[source_id]->pitch = pitch;
-          // Code to set the pitch of the source using libsoundio
-        }
+        if (m_output == nullptr)
+          throw;
+        close_output();
+        output = std::make_unique<OutputStream>(m_mixer.get(), device, m_params);
+        output->open();
       }
       
-      void set_looping(size_t source_id, bool looping)
       {
-        if (source_id < m_sources.size())
-        {
-          m_sources[source_id]->looping = looping;
-          // Code to set the looping behavior of the source using libsoundio
-        }
+        std::scoped_lock lock(m_output_mutex);
+        // Destroying the old stream joins its callback, after which the mixer may be reconfigured.
+        release_output();
+        m_mixer->configure(output->get_sample_rate(), output->get_layout());
+        m_output = std::move(output);
       }
-      
-      void set_buffer_data_mono_16(SoundIoDevice* device, size_t source_id)
+      try
       {
-        if (source_id < m_sources.size())
-          m_sources[source_id]->set_buffer_data_mono_16(device);
+        m_output->start();
       }
-      
-      void attach_buffer_to_source(size_t source_id, Buffer* buffer)
+      catch (const std::runtime_error&)
       {
-        if (source_id < m_sources.size())
-        {
-          auto& source = m_sources[source_id];
-          source->buffer = buffer;
-          source->outstream->sample_rate = buffer->sample_rate;
-        }
+        close_output();
+        throw;
       }
-      
-      void open_stream(size_t source_id)
+      m_num_device_switches.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void close_output()
+    {
+      std::scoped_lock lock(m_output_mutex);
+      release_output();
+    }
+    
+    // Requires m_output_mutex. Keeps the errors the stream reported until check_error().
+    void release_output()
+    {
+      if (m_output == nullptr)
+        return;
+      for (auto& message : m_output->drain_errors())
+        push_event_error(std::move(message));
+      m_output.reset();
+    }
+    
+    void select_output(const std::string& device_id, const std::string& device_name, SoundIoBackend backend)
+    {
+      if (backend != SoundIoBackendNone && backend != m_soundio->current_backend)
       {
-        if (source_id < m_sources.size())
-        {
-          auto* source = m_sources[source_id].get();
-          auto* outstream = source->outstream;
-          if (int err = soundio_outstream_open(outstream); err != 0)
-            throw std::runtime_error("unable to open device: " + std::string(soundio_strerror(err)));
-          //std::cout << "Software latency: " + std::to_string(outstream->software_latency) << std::endl;
-          if (outstream->layout_error)
-            throw std::runtime_error("unable to set channel layout: " + std::string(soundio_strerror(outstream->layout_error)));
-          source->init();
-        }
+        disconnect_backend();
+        connect_backend(backend);
+        m_params.backend = backend;
       }
       
-      void clear_buffer(size_t source_id)
+      auto* device = find_output_device(device_id, device_name);
+      if (device == nullptr)
+        throw std::runtime_error("Output device not found.");
+      try
       {
-        if (source_id < m_sources.size())
-          m_sources[source_id]->buffer = nullptr;
+        switch_output(device);
       }
-      
-      void set_standard_params(size_t source_id)
+      catch (...)
       {
-      
+        soundio_device_unref(device);
+        throw;
       }
-    };
+      soundio_device_unref(device);
+      m_params.device_id = device_id;
+      m_params.device_name = device_name;
+    }
     
-    class BufferManager
+    // Serves device requests, reconnects after a backend disconnect and moves playback when
+    //   the stream has failed or the selected device (or the default) has changed. A device
+    //   that disappears is replaced by the default one until it comes back.
+    void poll_events()
     {
-      std::vector<std::unique_ptr<Buffer>> m_buffers;
+      // Commands posted while the stream was gone or behind, in case no post() follows.
+      m_mixer->flush_posted();
+      if (m_soundio->current_backend != SoundIoBackendNone)
+        soundio_flush_events(m_soundio);
       
-    public:
-      size_t add_buffer()
+      std::vector<std::shared_ptr<DeviceRequest>> requests;
       {
-        auto buf_id = m_buffers.size();
-        m_buffers.emplace_back(std::make_unique<Buffer>());
-        return buf_id;
+        std::scoped_lock lock(m_request_mutex);
+        requests.swap(m_device_requests);
       }
-      
-      bool remove_buffer(size_t buffer_id)
+      for (auto& request : requests)
       {
-        return stlutils::erase_at(m_buffers, buffer_id);
+        try
+        {
+          select_output(request->device_id, request->device_name, request->backend);
+          request->done.set_value();
+        }
+        catch (...)
+        {
+          request->done.set_exception(std::current_exception());
+        }
       }
       
-      Buffer* get_buffer(size_t buffer_id)
+      // libsoundio has to be disconnected and connected again after losing the backend.
+      if (!m_backend_connected.load(std::memory_order_acquire) && m_soundio->current_backend != SoundIoBackendNone)
+        disconnect_backend();
+      bool devices_changed = m_devices_changed.exchange(false, std::memory_order_acq_rel);
+      if (m_soundio->current_backend == SoundIoBackendNone)
       {
-        if (buffer_id < m_buffers.size())
-          return m_buffers[buffer_id].get();
-        return nullptr;
+        try
+        {
+          connect_backend(m_params.backend);
+        }
+        catch (const std::runtime_error&)
+        {
+          return; // Retried on the next poll.
+        }
+        devices_changed = true;
       }
       
-      void set_buffer_data_mono_16(size_t buffer_id, const std::vector<short>& short_buffer, int sample_rate)
+      const bool lost = m_output == nullptr || m_output->has_failed();
+      if (!lost && !devices_changed)
+        return;
+      
+      auto* device = find_output_device(m_params.device_id, m_params.device_name);
+      if (device == nullptr)
+        device = find_output_device({}, {});
+      if (device == nullptr)
+      {
+        if (lost)
+          close_output();
+        return;
+      }
+      if (lost || strcmp(device->id, m_output->get_device()->id) != 0)
       {
-        if (buffer_id < m_buffers.size())
+        try
         {
-          auto* buffer = m_buffers[buffer_id].get();
-          buffer->data = short_buffer;
-          buffer->sample_rate = sample_rate;
+          switch_output(device);
+          m_restore_failed = false;
+        }
+        catch (const std::runtime_error& e)
+        {
+          if (!m_restore_failed)
+            push_event_error("Unable to switch output device: " + std::string(e.what()));
+          m_restore_failed = true;
         }
       }
-      
-      // Additional functions for buffer management can be added here
-    };
-    
-    std::unique_ptr<SourceManager> m_source_manager;
-    std::unique_ptr<BufferManager> m_buffer_manager;
+      soundio_device_unref(device);
+    }
     
   public:
     virtual void init() override
     {
-      m_source_manager = std::make_unique<SourceManager>(m_soundio);
-      m_buffer_manager = std::make_unique<BufferManager>();
+      init(InitParams {});
+    }
+    
+    void init(const InitParams& params)
+    {
+      m_params = params;
+      m_buffer_manager = std::make_unique<BufferManager>(params.pcm_allocator, params.audio_memory_budget,
+                                                         params.on_evict_buffer);
+      m_streamer = std::make_unique<WavStreamer>(!params.offline);
+      m_mixer = std::make_unique<Mixer>(params);
+      m_source_manager = std::make_unique<SourceManager>(m_mixer.get(), m_streamer.get(), &m_reclaimer,
+                                                         params.resampler_quality);
+      m_bus_manager = std::make_unique<BusManager>(m_mixer.get(), &m_reclaimer);
+      
+      if (params.offline)
+      {
+        const auto& layout = params.offline_layout;
+        if (layout.channel_count <= 0 || layout.channel_count > SOUNDIO_MAX_CHANNELS)
+          throw std::runtime_error("Invalid offline channel layout.");
+        m_mixer->configure(params.sample_rate > 0 ? params.sample_rate : c_offline_sample_rate, layout);
+        return;
+      }
     
       // Initialize libsoundio
       m_soundio = soundio_create();
       if (m_soundio == nullptr)
         throw std::runtime_error("Failed to initialize libsoundio: Out of memory.");
-      
-      int err = soundio_connect(m_soundio);
-      if (err)
-        throw std::runtime_error("Unable to connect to backend: " + std::string(soundio_strerror(err)));
-      
-      //fprintf(stderr, "Backend: %s\n", soundio_backend_name(soundio->current_backend));
-      soundio_flush_events(m_soundio);
+      m_on_devices_change = params.on_devices_change;
+      m_on_backend_disconnect = params.on_backend_disconnect;
+      m_soundio->userdata = this;
+      m_soundio->on_devices_change = on_devices_change;
+      m_soundio->on_backend_disconnect = on_backend_disconnect;
+      connect_backend(params.backend);
       
       // Find and init device
+      select_output(params.device_id, params.device_name, SoundIoBackendNone);
+      m_devices_changed.store(false, std::memory_order_relaxed);
+      m_num_device_switches.store(0, std::memory_order_relaxed);
       
-      char *device_id = NULL;
-      int selected_device_index = -1;
-      if (device_id)
+      if (params.event_thread)
       {
-        int device_count = soundio_output_device_count(m_soundio);
-        for (int i = 0; i < device_count; i += 1)
-        {
-          auto* device = soundio_get_output_device(m_soundio, i);
-          if (strcmp(device->id, device_id) == 0 && device->is_raw == false)
-          {
-            selected_device_index = i;
-            break;
-          }
-        }
+        m_quit_events.store(false, std::memory_order_relaxed);
+        m_events_stopped = false;
+        m_event_thread = std::thread([this] { run_events(); });
       }
-      else
-        selected_device_index = soundio_default_output_device_index(m_soundio);
-      if (selected_device_index < 0)
-        throw std::runtime_error("Output device not found.");
-      m_device = soundio_get_output_device(m_soundio, selected_device_index);
-      if (m_device == nullptr)
-        throw std::runtime_error("Out of memory.");
-      //fprintf(stderr, "Output device: %s\n", device->name);
-      if (m_device->probe_error)
-        throw std::runtime_error("Cannot probe device: " + std::string(soundio_strerror(m_device->probe_error)));
     }
     
     virtual void finish() override
     {
+      stop_event_thread();
+      
+      // Destroying the stream joins the callback thread, so it must go before the sources.
+      close_output();
+      m_mixer.reset();
+      if (m_streamer != nullptr)
+        m_streamer->stop();
+      m_source_manager.reset();
+      m_bus_manager.reset();
+      m_reclaimer = Reclaimer {};
+      m_streamer.reset();
+      
       // Clean up libsoundio resources
-      if (m_device != nullptr)
-        soundio_device_unref(m_device);
       if (m_soundio != nullptr)
         soundio_destroy(m_soundio);
+      m_soundio = nullptr;
+      m_backend_connected.store(false, std::memory_order_release);
     }
     
     unsigned int create_source() override
     {
       // Create a new source and return its ID
-      auto src_id = m_source_manager->add_source(m_device);
-      return static_cast<unsigned int>(src_id);
+      return m_source_manager->add_source();
     }
     
     void destroy_source(unsigned int src_id) override
     {
-      m_source_manager->remove_source(static_cast<size_t>(src_id));
+      m_source_manager->remove_source(src_id);
     }
     
     unsigned int create_buffer() override
     {
       // Create a new buffer and return its ID
-      auto buf_id = m_buffer_manager->add_buffer();
-      return static_cast<unsigned int>(buf_id);
+      return m_buffer_manager->add_buffer();
     }
     
+    // Safe while sources still play the buffer. They keep it until they are detached,
+    //   removed or attached to another buffer.
     void destroy_buffer(unsigned int buf_id) override
     {
-      m_buffer_manager->remove_buffer(static_cast<size_t>(buf_id));
+      m_buffer_manager->remove_buffer(buf_id);
     }
     
     virtual void play_source(unsigned int src_id) override
@@ -458,11 +3297,70 @@ namespace audio
       m_source_manager->play(src_id);
     }
     
+    // Starts the source on a frame of the device frame clock, see get_device_frame().
+    //   A frame that has already been mixed starts it at once. A paused source resumes on it.
+    void play_source_at(unsigned int src_id, uint64_t device_frame)
+    {
+      m_source_manager->play(src_id, 0.f, FadeCurve::Linear, SlotMap<Source>::c_invalid_handle, device_frame);
+    }
+    
+    // Starts the sources on the same device frame, or together as soon as possible for 0,
+    //   so that they play in sync.
+    void play_sources_at(const std::vector<unsigned int>& src_ids, uint64_t device_frame = 0)
+    {
+      auto group = m_source_manager->create_group();
+      for (auto src_id : src_ids)
+        m_source_manager->play(src_id, 0.f, FadeCurve::Linear, SlotMap<Source>::c_invalid_handle, 0, group);
+      m_source_manager->release_group(group, device_frame);
+    }
+    
+    // Stops the source on a device frame. It counts as playing until then, and is reported
+    //   by fetch_finished_sources() afterwards. The cut is hard; see fade_out_source().
+    void stop_source_at(unsigned int src_id, uint64_t device_frame)
+    {
+      m_source_manager->stop_at(src_id, device_frame);
+    }
+    
+    // Stops the sources on the same device frame, or together as soon as possible for 0.
+    void stop_sources_at(const std::vector<unsigned int>& src_ids, uint64_t device_frame = 0)
+    {
+      auto group = m_source_manager->create_group();
+      for (auto src_id : src_ids)
+        m_source_manager->stop_at(src_id, 0, group);
+      m_source_manager->release_group(group, device_frame);
+    }
+    
+    // Frames mixed since init(), counted at the mix sample rate and carrying on across device
+    //   changes. It only advances while a stream is running. The next block mixed starts on
+    //   this frame; what is audible right now lags behind by the output latency, about
+    //   get_latency_info().smoothed_seconds * get_mix_sample_rate() frames.
+    uint64_t get_device_frame() const
+    {
+      return m_mixer->get_frame();
+    }
+    
+    SourcePosition get_source_position(unsigned int src_id)
+    {
+      return m_source_manager->get_position(src_id);
+    }
+    
     virtual bool is_source_playing(unsigned int src_id) override
     {
       return m_source_manager->is_playing(src_id);
     }
     
+    // Plays a 16-bit PCM WAVE file from disk without loading it into memory.
+    //   Throws if the file cannot be opened or is in an unsupported format.
+    unsigned int create_streaming_source(const std::string& wav_path, const StreamParams& params = {})
+    {
+      return m_source_manager->add_streaming_source(wav_path, params);
+    }
+    
+    StreamStats get_stream_stats(unsigned int src_id) const
+    {
+      return m_source_manager->get_stream_stats(src_id);
+    }
+    
     virtual void pause_source(unsigned int src_id) override
     {
       m_source_manager->pause(src_id);
@@ -478,11 +3376,155 @@ namespace audio
       m_source_manager->set_volume(src_id, vol);
     }
     
+    // -1 is hard left, 1 hard right. Centered sources play at full gain on every channel.
+    void set_source_pan(unsigned int src_id, float pan)
+    {
+      m_source_manager->set_pan(src_id, pan);
+    }
+    
+    // Fades run on the audio thread and are applied on top of the source volume.
+    void fade_source(unsigned int src_id, float gain, float seconds, FadeCurve curve = FadeCurve::Linear)
+    {
+      m_source_manager->fade(src_id, gain, seconds, curve, false);
+    }
+    
+    // Fades to silence and then stops the source.
+    void fade_out_source(unsigned int src_id, float seconds, FadeCurve curve = FadeCurve::Linear)
+    {
+      m_source_manager->fade(src_id, 0.f, seconds, curve, true);
+    }
+    
+    void play_source_fade_in(unsigned int src_id, float seconds, FadeCurve curve = FadeCurve::Linear)
+    {
+      m_source_manager->play(src_id, seconds, curve);
+    }
+    
+    // Starts to_src with a fade-in while from_src fades out and stops, both beginning in the same mix block.
+    void crossfade_sources(unsigned int from_src, unsigned int to_src, float seconds,
+                           FadeCurve curve = FadeCurve::EqualPower)
+    {
+      m_source_manager->play(to_src, seconds, curve, from_src);
+    }
+    
     virtual void set_source_pitch(unsigned int src_id, float pitch) override
     {
       m_source_manager->set_pitch(src_id, pitch);
     }
     
+    // Higher priority sources may steal the voice of lower priority ones when the pool is exhausted.
+    //   Default is 0.
+    void set_source_priority(unsigned int src_id, int priority)
+    {
+      m_source_manager->set_priority(src_id, priority);
+    }
+    
+    void set_source_resampler_quality(unsigned int src_id, ResamplerQuality quality)
+    {
+      m_source_manager->set_resampler_quality(src_id, quality);
+    }
+    
+    // Routes the source into a bus. Sources start out on the master bus.
+    void set_source_bus(unsigned int src_id, unsigned int bus_id)
+    {
+      const uint32_t slot = m_bus_manager->get_slot(bus_id);
+      if (slot != MixBus::c_no_bus)
+        m_source_manager->set_bus(src_id, slot);
+    }
+    
+    // Creates a submix bus feeding output_bus. Gain and mute of a bus apply to everything
+    //   routed into it, once per mix block, so they are the cheap way to control a group of
+    //   sources such as music, effects or dialog. Throws std::runtime_error when all
+    //   InitParams::max_buses are taken.
+    unsigned int create_bus(unsigned int output_bus = c_master_bus)
+    {
+      return m_bus_manager->add_bus(output_bus);
+    }
+    
+    // Sources and buses feeding the bus move to its output. The master bus cannot be destroyed.
+    void destroy_bus(unsigned int bus_id)
+    {
+      uint32_t slot = 0;
+      uint32_t output_slot = 0;
+      if (m_bus_manager->remove_bus(bus_id, slot, output_slot))
+        m_source_manager->move_bus_sources(slot, output_slot);
+    }
+    
+    // Throws std::runtime_error if the bus would end up feeding itself.
+    void set_bus_output(unsigned int bus_id, unsigned int output_bus)
+    {
+      m_bus_manager->set_output(bus_id, output_bus);
+    }
+    
+    // Smoothed like source volumes. Applies to the bus's output and its sends alike.
+    void set_bus_gain(unsigned int bus_id, float gain)
+    {
+      m_bus_manager->set_gain(bus_id, gain);
+    }
+    
+    // Ramps the bus to silence without touching its gain. Its sources keep playing.
+    void set_bus_muted(unsigned int bus_id, bool muted)
+    {
+      m_bus_manager->set_muted(bus_id, muted);
+    }
+    
+    // Feeds a copy of the bus, after its gain, into target_bus at level, e.g. into a bus
+    //   for a shared effect. A level <= 0 removes the send. Each bus has up to
+    //   MixBus::c_max_sends sends. Throws std::runtime_error if the bus would end up
+    //   feeding itself or has no free send.
+    void set_bus_send(unsigned int bus_id, unsigned int target_bus, float level)
+    {
+      m_bus_manager->set_send(bus_id, target_bus, level);
+    }
+    
+    // Effects run in slot order, 0 to c_max_effects - 1, on the source's own channels before
+    //   its volume and pan. Changes are glitch-free commands to the callback like any other:
+    //   a filter keeps its state when only its parameters change. Slots out of range throw
+    //   std::runtime_error.
+    //   A low-pass filter with the frequency following the amount of obstruction is a cheap
+    //   occlusion effect.
+    void set_source_filter(unsigned int src_id, int slot, FilterType type, float frequency,
+                           float q = c_butterworth_q, float gain_db = 0.f)
+    {
+      m_source_manager->set_effect(src_id, check_effect_slot(slot), make_filter_effect(type, frequency, q, gain_db),
+                                   nullptr);
+    }
+    
+    // Convolves the source with ir, see make_impulse_response(), mixing wet * reverb with
+    //   dry * source. The wet signal lags by c_convolution_partition frames. The tail stops
+    //   with the source, so for long tails or many sources, send a bus into a bus with a
+    //   reverb instead: its cost does not grow with the number of sources.
+    void set_source_reverb(unsigned int src_id, int slot, std::shared_ptr<const ImpulseResponse> ir, float wet,
+                           float dry = 1.f)
+    {
+      m_source_manager->set_effect(src_id, check_effect_slot(slot), make_reverb_effect(ir, wet, dry), ir);
+    }
+    
+    void clear_source_effect(unsigned int src_id, int slot)
+    {
+      m_source_manager->set_effect(src_id, check_effect_slot(slot), EffectParams {}, nullptr);
+    }
+    
+    // As set_source_filter(), on everything mixed into the bus before its gain and sends.
+    void set_bus_filter(unsigned int bus_id, int slot, FilterType type, float frequency,
+                        float q = c_butterworth_q, float gain_db = 0.f)
+    {
+      m_bus_manager->set_effect(bus_id, check_effect_slot(slot), make_filter_effect(type, frequency, q, gain_db),
+                                nullptr);
+    }
+    
+    // As set_source_reverb(). The tail rings out after the bus's inputs stop, until the
+    //   effect is cleared or the bus destroyed.
+    void set_bus_reverb(unsigned int bus_id, int slot, std::shared_ptr<const ImpulseResponse> ir, float wet,
+                        float dry = 1.f)
+    {
+      m_bus_manager->set_effect(bus_id, check_effect_slot(slot), make_reverb_effect(ir, wet, dry), ir);
+    }
+    
+    void clear_bus_effect(unsigned int bus_id, int slot)
+    {
+      m_bus_manager->set_effect(bus_id, check_effect_slot(slot), EffectParams {}, nullptr);
+    }
+    
     virtual void set_source_looping(unsigned int src_id, bool loop) override
     {
       m_source_manager->set_looping(src_id, loop);
@@ -503,24 +3545,297 @@ namespace audio
       m_buffer_manager->set_buffer_data_mono_16(buf_id, buffer, sample_rate);
     }
     
+    // Takes ownership of the samples without copying them.
+    void set_buffer_data_mono_16(unsigned int buf_id, std::vector<short>&& buffer, int sample_rate)
+    {
+      m_buffer_manager->set_buffer_data_mono_16(buf_id, std::move(buffer), sample_rate);
+    }
+    
+    // Shares one immutable PCM block between any number of buffers.
+    void set_buffer_data_mono_16(unsigned int buf_id, std::shared_ptr<const std::vector<short>> block, int sample_rate)
+    {
+      m_buffer_manager->set_buffer_data_mono_16(buf_id, std::move(block), sample_rate);
+    }
+    
+    // Adopts caller-owned memory. release is invoked once no buffer refers to the samples anymore.
+    //   The memory must stay valid and unchanged until then.
+    void set_buffer_data_mono_16(unsigned int buf_id, std::span<const short> samples, int sample_rate,
+                                 std::function<void()> release)
+    {
+      m_buffer_manager->set_buffer_data_mono_16(buf_id, samples, sample_rate, std::move(release));
+    }
+    
+    // Interleaved left/right frames.
+    void set_buffer_data_stereo_16(unsigned int buf_id, const std::vector<short>& buffer, int sample_rate)
+    {
+      set_buffer_data_multichannel(buf_id, buffer, get_stereo_layout(), sample_rate);
+    }
+    
+    void set_buffer_data_stereo_16(unsigned int buf_id, std::vector<short>&& buffer, int sample_rate)
+    {
+      set_buffer_data_multichannel(buf_id, std::move(buffer), get_stereo_layout(), sample_rate);
+    }
+    
+    // Interleaved frames with the channels in layout order. T is int16_t, int32_t or float,
+    //   the latter nominally in [-1, 1]. Up to c_max_buffer_channels channels; the mixer maps
+    //   them onto the output layout by channel position, see make_channel_map().
+    //   Throws if the layout or the sample count does not fit.
+    template<typename T>
+    void set_buffer_data_multichannel(unsigned int buf_id, const std::vector<T>& buffer,
+                                      const SoundIoChannelLayout& layout, int sample_rate)
+    {
+      m_buffer_manager->copy_buffer_data(buf_id, std::span<const T>(buffer), layout, sample_rate);
+    }
+    
+    template<typename T>
+    void set_buffer_data_multichannel(unsigned int buf_id, std::vector<T>&& buffer,
+                                      const SoundIoChannelLayout& layout, int sample_rate)
+    {
+      m_buffer_manager->set_buffer_data(buf_id, std::make_shared<const std::vector<T>>(std::move(buffer)), layout, sample_rate);
+    }
+    
+    template<typename T>
+    void set_buffer_data_multichannel(unsigned int buf_id, std::shared_ptr<const std::vector<T>> block,
+                                      const SoundIoChannelLayout& layout, int sample_rate)
+    {
+      m_buffer_manager->set_buffer_data(buf_id, std::move(block), layout, sample_rate);
+    }
+    
+    // Adopts caller-owned memory, as the corresponding set_buffer_data_mono_16() overload.
+    template<typename T>
+    void set_buffer_data_multichannel(unsigned int buf_id, std::span<const T> samples, const SoundIoChannelLayout& layout,
+                                      int sample_rate, std::function<void()> release)
+    {
+      m_buffer_manager->set_buffer_data(buf_id, samples, layout, sample_rate, std::move(release));
+    }
+    
+    // Compresses 16-bit samples into a buffer the mixer decodes while playing it:
+    //   SampleType::MuLaw at half the size of the samples, or SampleType::ImaAdpcm at a
+    //   little over a quarter. Both are lossy, ADPCM more audibly so on bright material.
+    //   Seeking and looping work as on uncompressed buffers.
+    void set_buffer_data_compressed(unsigned int buf_id, std::span<const short> samples, const SoundIoChannelLayout& layout,
+                                    int sample_rate, SampleType sample_type)
+    {
+      m_buffer_manager->encode_buffer_data(buf_id, samples, layout, sample_rate, sample_type);
+    }
+    
     virtual void attach_buffer_to_source(unsigned int src_id, unsigned int buf_id) override
     {
-      m_source_manager->set_buffer_data_mono_16(m_device, src_id);
-      
-      auto* buffer = m_buffer_manager->get_buffer(buf_id);
-      m_source_manager->attach_buffer_to_source(src_id, buffer);
-      
-      m_source_manager->open_stream(src_id);
+      m_source_manager->attach_buffer_to_source(src_id, m_buffer_manager->get_buffer(buf_id));
+    }
+    
+    // PCM bytes of the buffer's current data, 0 for an unknown buffer.
+    size_t get_buffer_resident_bytes(unsigned int buf_id) const
+    {
+      return m_buffer_manager->get_resident_bytes(buf_id);
     }
     
+    std::vector<BufferMemoryInfo> get_buffer_memory() const
+    {
+      return m_buffer_manager->get_buffer_memory();
+    }
+    
+    AudioMemoryStats get_audio_memory_stats() const
+    {
+      return m_buffer_manager->get_memory_stats();
+    }
+    
+    // Returns the errors the audio thread reported since the last call, one per line,
+    //   or an empty string if there were none.
     virtual std::string check_error() override
     {
-      return "";
+      std::vector<std::string> messages;
+      {
+        std::scoped_lock lock(m_event_errors_mutex);
+        messages.swap(m_event_errors);
+      }
+      {
+        std::scoped_lock lock(m_output_mutex);
+        if (m_output != nullptr)
+          for (auto& message : m_output->drain_errors())
+            messages.emplace_back(std::move(message));
+      }
+      
+      std::string result;
+      for (const auto& message : messages)
+      {
+        if (!result.empty())
+          result += '\n';
+        result += message;
+      }
+      return result;
+    }
+    
+    // Statistics of the current output stream. They start over when the device changes.
+    OutputStats get_output_stats() const
+    {
+      std::scoped_lock lock(m_output_mutex);
+      return m_output != nullptr ? m_output->get_output_stats() : OutputStats {};
+    }
+    
+    // Ids of the sources that played to their end since the last call.
+    std::vector<unsigned int> fetch_finished_sources()
+    {
+      return m_source_manager->fetch_finished_sources();
+    }
+    
+    CommandLatencyStats get_command_latency_stats() const
+    {
+      return m_mixer->get_command_latency_stats();
+    }
+    
+    // Callback timing, load and per-source mix cost. Only recorded when built with
+    //   AUDIOLIBSWITCHER_LIBSOUNDIO_PROFILING, otherwise the snapshot has enabled == false.
+    ProfileSnapshot get_profile_snapshot() const
+    {
+      ProfileSnapshot profile;
+      std::scoped_lock lock(m_output_mutex);
+      if (m_output == nullptr)
+        return profile;
+      m_mixer->fill_profile(profile);
+      const auto* device = m_output->get_device();
+      if (device->id != nullptr)
+        profile.device_id = device->id;
+      if (device->name != nullptr)
+        profile.device_name = device->name;
+      if (profile.enabled)
+        m_source_manager->for_each_bound_voice([&](uint32_t voice, unsigned int src_id)
+        {
+          profile.sources.push_back({ src_id, m_mixer->get_voice_profile(voice) });
+        });
+      return profile;
+    }
+    
+    std::string get_profile_csv() const
+    {
+      return to_csv(get_profile_snapshot());
+    }
+    
+    LatencyInfo get_latency_info() const
+    {
+      std::scoped_lock lock(m_output_mutex);
+      return m_output != nullptr ? m_output->get_latency_info() : LatencyInfo {};
     }
     
+    // Moves all sources to another output device. Playing sources continue from where they
+    //   were after a gap of a few periods. Empty device_id and device_name select the default
+    //   device and follow it from then on. A backend other than the current one reconnects
+    //   libsoundio first; SoundIoBackendNone keeps the current backend.
+    //   Throws std::runtime_error if the device cannot be found or opened.
+    void select_output_device(const std::string& device_id, const std::string& device_name = {},
+                              SoundIoBackend backend = SoundIoBackendNone)
+    {
+      if (m_params.offline)
+        throw std::runtime_error("There are no output devices in offline mode.");
+      if (!m_event_thread.joinable())
+      {
+        select_output(device_id, device_name, backend);
+        return;
+      }
+      auto request = std::make_shared<DeviceRequest>();
+      request->device_id = device_id;
+      request->device_name = device_name;
+      request->backend = backend;
+      auto done = request->done.get_future();
+      {
+        std::scoped_lock lock(m_request_mutex);
+        m_device_requests.emplace_back(std::move(request));
+      }
+      do
+        wake_events();
+      while (done.wait_for(c_wake_retry_interval) != std::future_status::ready);
+      done.get();
+    }
+    
+    // Handles device changes, backend disconnects and failed streams. Only needed with
+    //   InitParams::event_thread disabled, and then to be called regularly, e.g. once per frame.
+    void poll_device_events()
+    {
+      if (!m_event_thread.joinable() && !m_params.offline)
+        poll_events();
+    }
+    
+    // Number of times playback moved to a new stream since init(), whether requested or
+    //   after a device change, a backend reconnect or a failed stream.
+    uint64_t get_num_device_switches() const { return m_num_device_switches.load(std::memory_order_relaxed); }
+    
+    // Number of device list changes reported by the backend since init().
+    uint64_t get_num_device_changes() const { return m_num_device_changes.load(std::memory_order_relaxed); }
+    
+    bool is_backend_connected() const { return m_backend_connected.load(std::memory_order_acquire); }
+    
     SoundIo* get_soundio() const { return m_soundio; }
     
-    SoundIoDevice* get_device() const { return m_device; }
+    // The device currently played to, or nullptr while there is none.
+    //   The pointer is only valid until playback moves to another device.
+    SoundIoDevice* get_device() const
+    {
+      std::scoped_lock lock(m_output_mutex);
+      return m_output != nullptr ? m_output->get_device() : nullptr;
+    }
+    
+    int get_mix_sample_rate() const
+    {
+      if (m_params.offline)
+        return m_mixer->get_sample_rate();
+      std::scoped_lock lock(m_output_mutex);
+      return m_output != nullptr ? m_output->get_sample_rate() : 0;
+    }
+    
+    SoundIoFormat get_mix_format() const
+    {
+      if (m_params.offline)
+        return SoundIoFormatFloat32NE;
+      std::scoped_lock lock(m_output_mutex);
+      return m_output != nullptr ? m_output->get_format() : SoundIoFormatInvalid;
+    }
+    
+    bool is_offline() const { return m_params.offline; }
+    
+    // Offline mode only. Mixes the next frame_count frames into dst, interleaved in the
+    //   order of InitParams::offline_layout and clipped to [-1, 1] like a float device.
+    //   Calls made since the previous render() take effect on the first frame. Each call is
+    //   one callback period, so the output depends on how the frames are split into calls.
+    void render(float* dst, int frame_count)
+    {
+      if (!m_params.offline)
+        throw std::runtime_error("render() needs InitParams::offline.");
+      const int channel_count = m_mixer->get_layout().channel_count;
+      const int block_frames = m_mixer->get_block_frames();
+      const auto start = m_mixer->now();
+      // No callback drains the queue between calls, so commands beyond its capacity are
+      //   still waiting in the overflow.
+      while (m_mixer->flush_posted())
+        m_mixer->begin_period();
+      m_mixer->begin_period();
+      for (int done = 0; done < frame_count; done += block_frames)
+      {
+        const int frames = std::min(block_frames, frame_count - done);
+        m_streamer->refill_now();
+        kernels::convert_f32_to_f32(m_mixer->mix_block(frames), dst + static_cast<size_t>(done) * channel_count,
+                                    frames * channel_count);
+      }
+      m_mixer->end_period(start, frame_count);
+    }
+    
+    // Offline mode only. Renders frame_count frames into a 16-bit or float WAVE file,
+    //   c_render_chunk_frames per render() call.
+    void render_to_wav(const std::string& path, uint64_t frame_count, SampleType sample_type = SampleType::S16)
+    {
+      if (!m_params.offline)
+        throw std::runtime_error("render_to_wav() needs InitParams::offline.");
+      const auto& layout = m_mixer->get_layout();
+      WavWriter writer(path, m_mixer->get_sample_rate(), layout.channel_count, sample_type,
+                       layout.channel_count > 2 ? get_channel_mask_from_layout(layout) : 0);
+      std::vector<float> frames(static_cast<size_t>(c_render_chunk_frames) * layout.channel_count);
+      for (uint64_t done = 0; done < frame_count; done += c_render_chunk_frames)
+      {
+        const int chunk = static_cast<int>(std::min<uint64_t>(c_render_chunk_frames, frame_count - done));
+        render(frames.data(), chunk);
+        writer.write(frames.data(), chunk);
+      }
+      writer.close();
+    }
   };
   
 }
@@ -0,0 +1,229 @@
+//
+//  Biquad.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "SampleKernels.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+namespace audio
+{
+
+  enum class FilterType : uint8_t
+  {
+    LowPass,    // E.g. occlusion: a wall takes out the highs first.
+    HighPass,
+    BandPass,   // Unity gain at the center frequency.
+    LowShelf,   // Boosts or cuts below the frequency by gain_db.
+    HighShelf,  // Boosts or cuts above the frequency by gain_db.
+  };
+
+  // Q of a Butterworth response, i.e. the flattest pass band without a resonance peak.
+  inline constexpr float c_butterworth_q = 0.70710678f;
+
+  struct FilterParams
+  {
+    FilterType type = FilterType::LowPass;
+    // Corner, center or shelf frequency in Hz. Clamped to below the Nyquist frequency.
+    float frequency = 1000.f;
+    float q = c_butterworth_q;
+    // Shelves only.
+    float gain_db = 0.f;
+  };
+
+  // Normalized transposed direct form II coefficients, a0 == 1.
+  //   The block terms let four outputs be computed from four inputs and the state at once:
+  //   y[k] = sum_j block_x[j][k] * x[j] + block_s1[k] * s1 + block_s2[k] * s2.
+  //   Only the state update stays serial, so the block costs about as much as one sample
+  //   of the plain recursion.
+  struct BiquadCoeffs
+  {
+    float b0 = 1.f;
+    float b1 = 0.f;
+    float b2 = 0.f;
+    float a1 = 0.f;
+    float a2 = 0.f;
+    float block_x[4][4] {};
+    float block_s1[4] {};
+    float block_s2[4] {};
+  };
+
+  struct BiquadState
+  {
+    float s1 = 0.f;
+    float s2 = 0.f;
+  };
+
+  namespace biquad
+  {
+
+    // Runs the recursion in double for four samples from the given input and state.
+    inline void simulate(const BiquadCoeffs& k, const double* x, double s1, double s2, float* y)
+    {
+      for (int n = 0; n < 4; ++n)
+      {
+        const double out = k.b0 * x[n] + s1;
+        s1 = k.b1 * x[n] - k.a1 * out + s2;
+        s2 = k.b2 * x[n] - k.a2 * out;
+        y[n] = static_cast<float>(out);
+      }
+    }
+
+  }
+
+  // Audio EQ Cookbook (R. Bristow-Johnson) designs.
+  inline BiquadCoeffs make_biquad(const FilterParams& params, int sample_rate)
+  {
+    const double rate = sample_rate > 0 ? sample_rate : 48000.0;
+    const double frequency = std::clamp<double>(params.frequency, 10.0, rate * 0.49);
+    const double w0 = 2.0 * M_PI * frequency / rate;
+    const double cos_w0 = std::cos(w0);
+    const double alpha = std::sin(w0) / (2.0 * std::max(params.q, 0.05f));
+    const double a = std::pow(10.0, params.gain_db / 40.0);
+    const double shelf = 2.0 * std::sqrt(a) * alpha;
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+    switch (params.type)
+    {
+      case FilterType::LowPass:
+        b0 = (1.0 - cos_w0) / 2.0;
+        b1 = 1.0 - cos_w0;
+        b2 = b0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cos_w0;
+        a2 = 1.0 - alpha;
+        break;
+      case FilterType::HighPass:
+        b0 = (1.0 + cos_w0) / 2.0;
+        b1 = -(1.0 + cos_w0);
+        b2 = b0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cos_w0;
+        a2 = 1.0 - alpha;
+        break;
+      case FilterType::BandPass:
+        b0 = alpha;
+        b1 = 0.0;
+        b2 = -alpha;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cos_w0;
+        a2 = 1.0 - alpha;
+        break;
+      case FilterType::LowShelf:
+        b0 = a * ((a + 1.0) - (a - 1.0) * cos_w0 + shelf);
+        b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cos_w0);
+        b2 = a * ((a + 1.0) - (a - 1.0) * cos_w0 - shelf);
+        a0 = (a + 1.0) + (a - 1.0) * cos_w0 + shelf;
+        a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cos_w0);
+        a2 = (a + 1.0) + (a - 1.0) * cos_w0 - shelf;
+        break;
+      case FilterType::HighShelf:
+        b0 = a * ((a + 1.0) + (a - 1.0) * cos_w0 + shelf);
+        b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cos_w0);
+        b2 = a * ((a + 1.0) + (a - 1.0) * cos_w0 - shelf);
+        a0 = (a + 1.0) - (a - 1.0) * cos_w0 + shelf;
+        a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cos_w0);
+        a2 = (a + 1.0) - (a - 1.0) * cos_w0 - shelf;
+        break;
+    }
+
+    BiquadCoeffs k;
+    k.b0 = static_cast<float>(b0 / a0);
+    k.b1 = static_cast<float>(b1 / a0);
+    k.b2 = static_cast<float>(b2 / a0);
+    k.a1 = static_cast<float>(a1 / a0);
+    k.a2 = static_cast<float>(a2 / a0);
+    for (int j = 0; j < 4; ++j)
+    {
+      double impulse[4] {};
+      impulse[j] = 1.0;
+      biquad::simulate(k, impulse, 0.0, 0.0, k.block_x[j]);
+    }
+    const double silence[4] {};
+    biquad::simulate(k, silence, 1.0, 0.0, k.block_s1);
+    biquad::simulate(k, silence, 0.0, 1.0, k.block_s2);
+    return k;
+  }
+
+  // Filters count samples of one channel in place.
+  inline void process_biquad_scalar(const BiquadCoeffs& k, BiquadState& state, float* data, int count)
+  {
+    float s1 = state.s1;
+    float s2 = state.s2;
+    for (int i = 0; i < count; ++i)
+    {
+      const float x = data[i];
+      const float y = k.b0 * x + s1;
+      s1 = k.b1 * x - k.a1 * y + s2;
+      s2 = k.b2 * x - k.a2 * y;
+      data[i] = y;
+    }
+    state.s1 = s1;
+    state.s2 = s2;
+  }
+
+  inline void process_biquad(const BiquadCoeffs& k, BiquadState& state, float* data, int count)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    float s1 = state.s1;
+    float s2 = state.s2;
+    const __m128 x0 = _mm_loadu_ps(k.block_x[0]);
+    const __m128 x1 = _mm_loadu_ps(k.block_x[1]);
+    const __m128 x2 = _mm_loadu_ps(k.block_x[2]);
+    const __m128 x3 = _mm_loadu_ps(k.block_x[3]);
+    const __m128 g1 = _mm_loadu_ps(k.block_s1);
+    const __m128 g2 = _mm_loadu_ps(k.block_s2);
+    for (; i + 4 <= count; i += 4)
+    {
+      const float* x = data + i;
+      // The input terms do not depend on the state, so they overlap with the previous block.
+      __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, _mm_set1_ps(x[0])), _mm_mul_ps(x1, _mm_set1_ps(x[1]))),
+                            _mm_add_ps(_mm_mul_ps(x2, _mm_set1_ps(x[2])), _mm_mul_ps(x3, _mm_set1_ps(x[3]))));
+      y = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(g1, _mm_set1_ps(s1)), _mm_mul_ps(g2, _mm_set1_ps(s2))));
+      const float in2 = x[2];
+      const float in3 = x[3];
+      const float y2 = _mm_cvtss_f32(_mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 2, 2)));
+      const float y3 = _mm_cvtss_f32(_mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 3, 3)));
+      _mm_storeu_ps(data + i, y);
+      s1 = k.b1 * in3 - k.a1 * y3 + k.b2 * in2 - k.a2 * y2;
+      s2 = k.b2 * in3 - k.a2 * y3;
+    }
+    state.s1 = s1;
+    state.s2 = s2;
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    float s1 = state.s1;
+    float s2 = state.s2;
+    const float32x4_t x0 = vld1q_f32(k.block_x[0]);
+    const float32x4_t x1 = vld1q_f32(k.block_x[1]);
+    const float32x4_t x2 = vld1q_f32(k.block_x[2]);
+    const float32x4_t x3 = vld1q_f32(k.block_x[3]);
+    const float32x4_t g1 = vld1q_f32(k.block_s1);
+    const float32x4_t g2 = vld1q_f32(k.block_s2);
+    for (; i + 4 <= count; i += 4)
+    {
+      const float* x = data + i;
+      float32x4_t y = vmlaq_n_f32(vmulq_n_f32(x0, x[0]), x1, x[1]);
+      y = vmlaq_n_f32(vmlaq_n_f32(y, x2, x[2]), x3, x[3]);
+      y = vmlaq_n_f32(vmlaq_n_f32(y, g1, s1), g2, s2);
+      const float in2 = x[2];
+      const float in3 = x[3];
+      const float y2 = vgetq_lane_f32(y, 2);
+      const float y3 = vgetq_lane_f32(y, 3);
+      vst1q_f32(data + i, y);
+      s1 = k.b1 * in3 - k.a1 * y3 + k.b2 * in2 - k.a2 * y2;
+      s2 = k.b2 * in3 - k.a2 * y3;
+    }
+    state.s1 = s1;
+    state.s2 = s2;
+#endif
+    process_biquad_scalar(k, state, data + i, count - i);
+    // A decaying state would otherwise end up in denormals, which are slow on x86.
+    if (std::abs(state.s1) < 1e-20f && std::abs(state.s2) < 1e-20f)
+      state = BiquadState {};
+  }
+
+}
@@ -0,0 +1,76 @@
+//
+//  BufferFormat.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+
+namespace audio
+{
+
+  // Sample formats buffers can hold. Samples are interleaved frame by frame, except for
+  //   ImaAdpcm, which is stored in blocks, see c_adpcm_block_frames.
+  enum class SampleType : uint8_t
+  {
+    S16,
+    S32,
+    F32,  // Nominally in [-1, 1].
+    MuLaw,    // 8-bit G.711 mu-law, decoded while mixing.
+    ImaAdpcm, // 4-bit IMA-ADPCM, decoded while mixing.
+  };
+
+  // Voices resample and mix every source channel separately, so the per-voice scratch
+  //   and resampler state are sized for this many channels (7.1).
+  constexpr int c_max_buffer_channels = 8;
+
+  // IMA-ADPCM data is a sequence of blocks of c_adpcm_block_frames frames. A block holds
+  //   one run per channel: the decoder state at the start of the block (the predictor as
+  //   little-endian int16, the step index and a zero byte), then one nibble per frame,
+  //   low nibble first. Frame f lies in block f / c_adpcm_block_frames, so any frame can
+  //   be reached by decoding at most one block. The last block is padded.
+  constexpr int c_adpcm_block_frames = 512;
+  constexpr int c_adpcm_header_bytes = 4;
+
+  inline size_t get_adpcm_block_bytes(int channel_count)
+  {
+    return static_cast<size_t>(channel_count) * (c_adpcm_header_bytes + c_adpcm_block_frames / 2);
+  }
+
+  // 0 for ImaAdpcm, which has no whole number of bytes per sample.
+  inline size_t get_bytes_per_sample(SampleType type)
+  {
+    switch (type)
+    {
+      case SampleType::S16: return 2;
+      case SampleType::S32: return 4;
+      case SampleType::F32: return 4;
+      case SampleType::MuLaw: return 1;
+      case SampleType::ImaAdpcm: return 0;
+    }
+    return 2;
+  }
+
+  // Size of num_frames frames of channel_count channels.
+  inline size_t get_data_bytes(SampleType type, size_t num_frames, int channel_count)
+  {
+    if (type == SampleType::ImaAdpcm)
+      return (num_frames + c_adpcm_block_frames - 1) / c_adpcm_block_frames * get_adpcm_block_bytes(channel_count);
+    return num_frames * channel_count * get_bytes_per_sample(type);
+  }
+
+  template<typename T>
+  struct SampleTypeOf;
+
+  template<>
+  struct SampleTypeOf<int16_t> { static constexpr SampleType value = SampleType::S16; };
+
+  template<>
+  struct SampleTypeOf<int32_t> { static constexpr SampleType value = SampleType::S32; };
+
+  template<>
+  struct SampleTypeOf<float> { static constexpr SampleType value = SampleType::F32; };
+
+}
@@ -0,0 +1,143 @@
+//
+//  ChannelMap.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "BufferFormat.h"
+#include <soundio/soundio.h>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace audio
+{
+
+  // Which side of the listener a channel is on: -1 left, 1 right, 0 neither.
+  inline int get_channel_side(SoundIoChannelId id)
+  {
+    switch (id)
+    {
+      case SoundIoChannelIdFrontLeft:
+      case SoundIoChannelIdFrontLeftCenter:
+      case SoundIoChannelIdBackLeft:
+      case SoundIoChannelIdSideLeft:
+      case SoundIoChannelIdTopFrontLeft:
+      case SoundIoChannelIdTopBackLeft:
+        return -1;
+      case SoundIoChannelIdFrontRight:
+      case SoundIoChannelIdFrontRightCenter:
+      case SoundIoChannelIdBackRight:
+      case SoundIoChannelIdSideRight:
+      case SoundIoChannelIdTopFrontRight:
+      case SoundIoChannelIdTopBackRight:
+        return 1;
+      default:
+        return 0;
+    }
+  }
+
+  // Layout described by a WAVE speaker mask, see WavInfo::channel_mask. Channels beyond
+  //   the bits set in the mask have no position.
+  inline SoundIoChannelLayout get_layout_from_channel_mask(uint32_t mask, int channel_count)
+  {
+    SoundIoChannelLayout layout {};
+    layout.channel_count = std::min(channel_count, SOUNDIO_MAX_CHANNELS);
+    int c = 0;
+    for (int bit = 0; bit < 18 && c < layout.channel_count; ++bit)
+      if (mask & (1u << bit))
+        layout.channels[c++] = static_cast<SoundIoChannelId>(SoundIoChannelIdFrontLeft + bit);
+    for (; c < layout.channel_count; ++c)
+      layout.channels[c] = SoundIoChannelIdInvalid;
+    return layout;
+  }
+
+  // WAVE speaker mask for a layout, the inverse of get_layout_from_channel_mask(). 0 if the
+  //   layout has channels without a mask bit or not in mask bit order.
+  inline uint32_t get_channel_mask_from_layout(const SoundIoChannelLayout& layout)
+  {
+    uint32_t mask = 0;
+    int last_bit = -1;
+    for (int c = 0; c < layout.channel_count; ++c)
+    {
+      const int bit = layout.channels[c] - SoundIoChannelIdFrontLeft;
+      if (bit <= last_bit || bit >= 18)
+        return 0;
+      mask |= 1u << bit;
+      last_bit = bit;
+    }
+    return mask;
+  }
+
+  // Gains from the channels of a source layout onto the channels of the output layout.
+  struct ChannelMap
+  {
+    int in_channels = 0;
+    int out_channels = 0;
+    // True for a stereo source on a stereo output with nothing to fold, which the mixer
+    //   sums with a dedicated kernel.
+    bool is_stereo_passthrough = false;
+    // [in][out].
+    float gains[c_max_buffer_channels][SOUNDIO_MAX_CHANNELS] {};
+  };
+
+  // Channels present in both layouts map one to one. The others are folded onto the
+  //   nearest output channels at -3 dB: side and back channels onto the front of the same
+  //   side, left and right onto center on a mono output, center onto left and right.
+  //   LFE is dropped unless the output has one. Channels without a position map by index.
+  inline ChannelMap make_channel_map(const SoundIoChannelLayout& in, const SoundIoChannelLayout& out)
+  {
+    constexpr float c_fold = 0.70710678f;
+    ChannelMap map;
+    map.in_channels = std::min(in.channel_count, c_max_buffer_channels);
+    map.out_channels = out.channel_count;
+    auto find = [&out](SoundIoChannelId id) { return soundio_channel_layout_find_channel(&out, id); };
+
+    for (int i = 0; i < map.in_channels; ++i)
+    {
+      const SoundIoChannelId id = in.channels[i];
+      float* gains = map.gains[i];
+      if (int o = find(id); o >= 0)
+      {
+        gains[o] = 1.f;
+        continue;
+      }
+      if (id == SoundIoChannelIdLfe || id == SoundIoChannelIdLeftLfe || id == SoundIoChannelIdRightLfe
+          || id == SoundIoChannelIdLfe2)
+        continue;
+      // Mid/side, ambisonic, auxiliary and unlabeled channels have no position to fold by.
+      if (id == SoundIoChannelIdInvalid || id >= SoundIoChannelIdMsMid)
+      {
+        if (i < out.channel_count)
+          gains[i] = 1.f;
+        continue;
+      }
+
+      const int side = get_channel_side(id);
+      const int left = find(SoundIoChannelIdFrontLeft);
+      const int right = find(SoundIoChannelIdFrontRight);
+      const int center = find(SoundIoChannelIdFrontCenter);
+      int target = -1;
+      if (side < 0)
+        for (auto candidate : { SoundIoChannelIdFrontLeft, SoundIoChannelIdSideLeft, SoundIoChannelIdBackLeft })
+          if ((target = find(candidate)) >= 0)
+            break;
+      if (side > 0)
+        for (auto candidate : { SoundIoChannelIdFrontRight, SoundIoChannelIdSideRight, SoundIoChannelIdBackRight })
+          if ((target = find(candidate)) >= 0)
+            break;
+
+      if (target >= 0)
+        gains[target] = c_fold;
+      else if (side == 0 && left >= 0 && right >= 0)
+        gains[left] = gains[right] = c_fold;
+      else if (center >= 0)
+        gains[center] = c_fold;
+    }
+
+    map.is_stereo_passthrough = map.in_channels == 2 && map.out_channels == 2
+      && map.gains[0][0] == 1.f && map.gains[0][1] == 0.f && map.gains[1][0] == 0.f && map.gains[1][1] == 1.f;
+    return map;
+  }
+
+}
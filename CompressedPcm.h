@@ -0,0 +1,168 @@
+//
+//  CompressedPcm.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "BufferFormat.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace audio
+{
+
+  namespace adpcm
+  {
+
+    inline constexpr int16_t c_step_table[89] =
+    {
+      7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+      50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+      337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+      2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+      15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+
+    inline constexpr int8_t c_index_table[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+    // Applies one nibble to the decoder state. Branch free, the encoder calls it too so
+    //   both sides stay in step.
+    inline void step(int nibble, int& predictor, int& index)
+    {
+      const int step = c_step_table[index];
+      int diff = step >> 3;
+      diff += step & -((nibble >> 2) & 1);
+      diff += (step >> 1) & -((nibble >> 1) & 1);
+      diff += (step >> 2) & -(nibble & 1);
+      predictor = std::clamp(predictor + ((nibble & 8) ? -diff : diff), -32768, 32767);
+      index = std::clamp(index + c_index_table[nibble], 0, 88);
+    }
+
+  }
+
+  // Where the last ADPCM read of a voice stopped, so that the next one continues from
+  //   there instead of decoding the block from its start again.
+  struct AdpcmCursor
+  {
+    const void* data = nullptr;
+    size_t frame = 0;
+    int16_t predictor[c_max_buffer_channels] {};
+    uint8_t index[c_max_buffer_channels] {};
+
+    void reset() { data = nullptr; }
+  };
+
+  // Encodes interleaved 16-bit samples into count bytes of mu-law codes.
+  inline void encode_mulaw(const int16_t* src, size_t count, uint8_t* dst)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      int pcm = src[i];
+      const int sign = pcm < 0 ? 0x80 : 0;
+      pcm = std::min(pcm < 0 ? -pcm : pcm, 32635) + 0x84;
+      int segment = 7;
+      for (int mask = 0x4000; (pcm & mask) == 0 && segment > 0; mask >>= 1)
+        --segment;
+      const int mantissa = (pcm >> (segment + 3)) & 0x0F;
+      dst[i] = static_cast<uint8_t>(~(sign | (segment << 4) | mantissa));
+    }
+  }
+
+  // Encodes num_frames interleaved frames into get_data_bytes(SampleType::ImaAdpcm, ...)
+  //   bytes with the standard IMA quantizer, see c_adpcm_block_frames for the layout.
+  inline void encode_ima_adpcm(const int16_t* src, size_t num_frames, int channel_count, uint8_t* dst)
+  {
+    const size_t block_bytes = get_adpcm_block_bytes(channel_count);
+    const size_t run_bytes = c_adpcm_header_bytes + c_adpcm_block_frames / 2;
+    const size_t num_blocks = (num_frames + c_adpcm_block_frames - 1) / c_adpcm_block_frames;
+    for (int c = 0; c < channel_count; ++c)
+    {
+      int predictor = 0;
+      int index = 0;
+      for (size_t b = 0; b < num_blocks; ++b)
+      {
+        uint8_t* run = dst + b * block_bytes + c * run_bytes;
+        run[0] = static_cast<uint8_t>(predictor & 0xFF);
+        run[1] = static_cast<uint8_t>((predictor >> 8) & 0xFF);
+        run[2] = static_cast<uint8_t>(index);
+        run[3] = 0;
+        uint8_t* nibbles = run + c_adpcm_header_bytes;
+        std::fill(nibbles, nibbles + c_adpcm_block_frames / 2, uint8_t(0));
+        for (int i = 0; i < c_adpcm_block_frames; ++i)
+        {
+          const size_t frame = b * c_adpcm_block_frames + i;
+          // The last block is padded with the last decoded value.
+          const int sample = frame < num_frames ? src[frame * channel_count + c] : predictor;
+          int diff = sample - predictor;
+          int nibble = diff < 0 ? 8 : 0;
+          diff = diff < 0 ? -diff : diff;
+          int step = adpcm::c_step_table[index];
+          for (int bit = 4; bit > 0; bit >>= 1, step >>= 1)
+            if (diff >= step)
+            {
+              nibble |= bit;
+              diff -= step;
+            }
+          adpcm::step(nibble, predictor, index);
+          nibbles[i >> 1] |= static_cast<uint8_t>(nibble << ((i & 1) * 4));
+        }
+      }
+    }
+  }
+
+  // Decodes frames [frame, frame + frame_count) of ADPCM data, channel c into
+  //   dst + c * stride, scaled by gain. The channels of a block are separate runs, so each
+  //   one is decoded straight into its plane without a deinterleave. The predictor chain
+  //   itself is serial; the cursor keeps sequential reads from decoding a block prefix twice.
+  inline void decode_ima_adpcm(const uint8_t* data, int channel_count, size_t frame, int frame_count,
+                               float* dst, int stride, float gain, AdpcmCursor* cursor)
+  {
+    const size_t block_bytes = get_adpcm_block_bytes(channel_count);
+    const size_t run_bytes = c_adpcm_header_bytes + c_adpcm_block_frames / 2;
+    int frames_done = 0;
+    while (frames_done < frame_count)
+    {
+      const size_t f = frame + frames_done;
+      const int offset = static_cast<int>(f % c_adpcm_block_frames);
+      const int count = std::min(frame_count - frames_done, c_adpcm_block_frames - offset);
+      const uint8_t* block = data + f / c_adpcm_block_frames * block_bytes;
+      const bool resume = cursor != nullptr && cursor->data == data && cursor->frame == f && offset > 0;
+      for (int c = 0; c < channel_count; ++c)
+      {
+        const uint8_t* run = block + c * run_bytes;
+        const uint8_t* nibbles = run + c_adpcm_header_bytes;
+        int predictor = static_cast<int16_t>(run[0] | (run[1] << 8));
+        int index = std::min<int>(run[2], 88);
+        int i = 0;
+        if (resume)
+        {
+          predictor = cursor->predictor[c];
+          index = cursor->index[c];
+          i = offset;
+        }
+        for (; i < offset; ++i)
+          adpcm::step((nibbles[i >> 1] >> ((i & 1) * 4)) & 0x0F, predictor, index);
+        float* out = dst + c * stride + frames_done;
+        for (; i < offset + count; ++i)
+        {
+          adpcm::step((nibbles[i >> 1] >> ((i & 1) * 4)) & 0x0F, predictor, index);
+          out[i - offset] = static_cast<float>(predictor) * gain;
+        }
+        if (cursor != nullptr)
+        {
+          cursor->predictor[c] = static_cast<int16_t>(predictor);
+          cursor->index[c] = static_cast<uint8_t>(index);
+        }
+      }
+      if (cursor != nullptr)
+      {
+        cursor->data = data;
+        cursor->frame = f + count;
+      }
+      frames_done += count;
+    }
+  }
+
+}
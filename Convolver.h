@@ -0,0 +1,193 @@
+//
+//  Convolver.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "Fft.h"
+#include "SampleKernels.h"
+#include <vector>
+#include <memory>
+#include <span>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+
+namespace audio
+{
+
+  // Frames per partition of the convolution reverb. The wet signal lags the dry one by
+  //   this much, 5.3 ms at 48 kHz, which blends into the reverb's pre-delay.
+  inline constexpr int c_convolution_partition = 256;
+
+  // An impulse response cut into c_convolution_partition frame partitions, each stored as
+  //   the spectrum of the partition zero padded to twice its length. Immutable, so one
+  //   response can be shared by any number of Convolvers.
+  struct ImpulseResponse
+  {
+    static constexpr int c_num_bins = c_convolution_partition + 1;
+
+    int channel_count = 0;
+    int num_partitions = 0;
+    size_t num_frames = 0;
+    // [channel][partition]: c_num_bins real parts, then c_num_bins imaginary parts.
+    std::vector<float> spectra;
+
+    const float* get_partition(int channel, int partition) const
+    {
+      return spectra.data() + (static_cast<size_t>(channel) * num_partitions + partition) * 2 * c_num_bins;
+    }
+  };
+
+  // samples holds channel_count (1 or 2) interleaved channels. The response is used at the
+  //   mix rate as is, so record or resample it at get_mix_sample_rate().
+  inline std::shared_ptr<const ImpulseResponse> make_impulse_response(std::span<const float> samples, int channel_count)
+  {
+    if (channel_count < 1 || channel_count > 2)
+      throw std::runtime_error("Impulse responses must have one or two channels.");
+    if (samples.empty() || samples.size() % channel_count != 0)
+      throw std::runtime_error("Impulse response size is not a whole number of frames.");
+    auto ir = std::make_shared<ImpulseResponse>();
+    ir->channel_count = channel_count;
+    ir->num_frames = samples.size() / channel_count;
+    ir->num_partitions = static_cast<int>((ir->num_frames + c_convolution_partition - 1) / c_convolution_partition);
+    ir->spectra.resize(static_cast<size_t>(channel_count) * ir->num_partitions * 2 * ImpulseResponse::c_num_bins);
+    RealFft fft(2 * c_convolution_partition);
+    std::vector<float> block(2 * c_convolution_partition);
+    for (int c = 0; c < channel_count; ++c)
+      for (int p = 0; p < ir->num_partitions; ++p)
+      {
+        std::fill(block.begin(), block.end(), 0.f);
+        const size_t first = static_cast<size_t>(p) * c_convolution_partition;
+        const size_t count = std::min<size_t>(c_convolution_partition, ir->num_frames - first);
+        for (size_t i = 0; i < count; ++i)
+          block[i] = samples[(first + i) * channel_count + c];
+        auto* re = const_cast<float*>(ir->get_partition(c, p));
+        fft.forward(block.data(), re, re + ImpulseResponse::c_num_bins);
+      }
+    return ir;
+  }
+
+  // Uniformly partitioned overlap-save convolution with a frequency domain delay line: every
+  //   c_convolution_partition input frames, the last two partitions of input are transformed
+  //   once and the spectra of the last num_partitions input partitions are multiplied with
+  //   those of the impulse response. The cost per frame is one FFT pair per partition length
+  //   plus num_partitions complex multiply-adds per bin, independent of the block size.
+  // Channels 0 and 1 are convolved, with the response's channel c % channel_count, and any
+  //   further channels pass dry. Everything is allocated in the constructor, on the API
+  //   thread; reset() and process() run on the audio thread.
+  class Convolver
+  {
+    static constexpr int c_size = 2 * c_convolution_partition;
+    static constexpr int c_num_bins = ImpulseResponse::c_num_bins;
+
+  public:
+    static constexpr int c_max_channels = 2;
+
+  private:
+    struct Channel
+    {
+      // The previous and the current input partition.
+      std::vector<float> input = std::vector<float>(c_size, 0.f);
+      // Wet output for the current partition, computed from the previous ones.
+      std::vector<float> output = std::vector<float>(c_convolution_partition, 0.f);
+      // Ring of input spectra, newest at head.
+      std::vector<float> spectra;
+      int head = 0;
+      // Spectra written since reset(). Older slots are stale and skipped, so a reset
+      //   does not have to clear the whole delay line.
+      int num_valid = 0;
+      int fill = 0;
+    };
+
+    std::shared_ptr<const ImpulseResponse> m_ir;
+    RealFft m_fft { c_size };
+    Channel m_channels[c_max_channels];
+    std::vector<float> m_acc = std::vector<float>(2 * c_num_bins, 0.f);
+    std::vector<float> m_time = std::vector<float>(c_size, 0.f);
+
+    void run_partition(Channel& ch, int ir_channel)
+    {
+      const int num_partitions = m_ir->num_partitions;
+      float* spectrum = ch.spectra.data() + static_cast<size_t>(ch.head) * 2 * c_num_bins;
+      m_fft.forward(ch.input.data(), spectrum, spectrum + c_num_bins);
+      ch.num_valid = std::min(ch.num_valid + 1, num_partitions);
+
+      float* acc_re = m_acc.data();
+      float* acc_im = acc_re + c_num_bins;
+      std::fill(m_acc.begin(), m_acc.end(), 0.f);
+      for (int p = 0; p < ch.num_valid; ++p)
+      {
+        int slot = ch.head - p;
+        if (slot < 0)
+          slot += num_partitions;
+        const float* in = ch.spectra.data() + static_cast<size_t>(slot) * 2 * c_num_bins;
+        const float* ir = m_ir->get_partition(ir_channel, p);
+        kernels::complex_multiply_add(in, in + c_num_bins, ir, ir + c_num_bins, acc_re, acc_im, c_num_bins);
+      }
+      m_fft.inverse(acc_re, acc_im, m_time.data());
+      // The first half wraps around circularly; the second half is the linear convolution.
+      std::copy(m_time.begin() + c_convolution_partition, m_time.end(), ch.output.begin());
+
+      std::copy(ch.input.begin() + c_convolution_partition, ch.input.end(), ch.input.begin());
+      ch.head = ch.head + 1 < num_partitions ? ch.head + 1 : 0;
+      ch.fill = 0;
+    }
+
+  public:
+    explicit Convolver(std::shared_ptr<const ImpulseResponse> ir)
+      : m_ir(std::move(ir))
+    {
+      if (m_ir == nullptr)
+        throw std::runtime_error("Convolver needs an impulse response.");
+      for (auto& ch : m_channels)
+        ch.spectra.assign(static_cast<size_t>(m_ir->num_partitions) * 2 * c_num_bins, 0.f);
+    }
+
+    const ImpulseResponse* get_impulse_response() const { return m_ir.get(); }
+
+    // Drops the tail, e.g. when a voice starts over.
+    void reset()
+    {
+      for (auto& ch : m_channels)
+      {
+        std::fill(ch.input.begin(), ch.input.end(), 0.f);
+        std::fill(ch.output.begin(), ch.output.end(), 0.f);
+        ch.num_valid = 0;
+        ch.fill = 0;
+      }
+    }
+
+    // In place on planar data, channel c at planes + c * stride: dry * x + wet * (x * ir).
+    void process(float* planes, int stride, int channel_count, int frame_count, float wet, float dry)
+    {
+      for (int c = 0; c < std::min(channel_count, c_max_channels); ++c)
+      {
+        auto& ch = m_channels[c];
+        float* data = planes + c * stride;
+        for (int done = 0; done < frame_count;)
+        {
+          const int n = std::min(frame_count - done, c_convolution_partition - ch.fill);
+          float* x = data + done;
+          float* in = ch.input.data() + c_convolution_partition + ch.fill;
+          const float* y = ch.output.data() + ch.fill;
+          for (int i = 0; i < n; ++i)
+          {
+            in[i] = x[i];
+            x[i] = dry * x[i] + wet * y[i];
+          }
+          ch.fill += n;
+          done += n;
+          if (ch.fill == c_convolution_partition)
+            run_partition(ch, c % m_ir->channel_count);
+        }
+      }
+      if (dry != 1.f)
+        for (int c = c_max_channels; c < channel_count; ++c)
+          kernels::apply_gain(planes + c * stride, frame_count, dry);
+    }
+  };
+
+}
@@ -0,0 +1,142 @@
+//
+//  EffectChain.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "Biquad.h"
+#include "Convolver.h"
+#include <memory>
+#include <cstdint>
+
+
+namespace audio
+{
+
+  // Effect slots per source and per bus, processed in slot order.
+  inline constexpr int c_max_effects = 4;
+
+  enum class EffectType : uint8_t
+  {
+    None,
+    Filter,
+    Reverb,
+  };
+
+  // What the audio thread is told about one slot. reverb is owned by the API side, which keeps
+  //   it alive until the slot has been changed. An idle chain, of a released voice or a
+  //   removed bus, may hold a dangling reverb until then, so it is only set() or configure()d.
+  struct EffectParams
+  {
+    EffectType type = EffectType::None;
+    FilterParams filter;
+    Convolver* reverb = nullptr;
+    float wet = 1.f;
+    float dry = 1.f;
+  };
+
+  // API thread. Keeps current if it already convolves with ir, so changing the wet or dry
+  //   level of a reverb does not cut its tail.
+  inline std::shared_ptr<Convolver> reuse_or_make_convolver(const std::shared_ptr<Convolver>& current,
+                                                            std::shared_ptr<const ImpulseResponse> ir)
+  {
+    if (current != nullptr && current->get_impulse_response() == ir.get())
+      return current;
+    return std::make_shared<Convolver>(std::move(ir));
+  }
+
+  // Runs on the audio thread on planar data, MaxChannels planes at most.
+  template<int MaxChannels>
+  class EffectChain
+  {
+    struct Slot
+    {
+      EffectParams params;
+      BiquadCoeffs coeffs;
+      BiquadState states[MaxChannels] {};
+    };
+
+    Slot m_slots[c_max_effects] {};
+    int m_num_active = 0;
+
+  public:
+    // A filter keeps its state when only its parameters change, so sweeping the frequency
+    //   does not click.
+    void set(int slot, const EffectParams& params, int sample_rate)
+    {
+      if (slot < 0 || slot >= c_max_effects)
+        return;
+      auto& s = m_slots[slot];
+      const bool same_effect = s.params.type == params.type && s.params.reverb == params.reverb;
+      if (s.params.type != EffectType::None)
+        --m_num_active;
+      if (params.type != EffectType::None)
+        ++m_num_active;
+      s.params = params;
+      if (!same_effect)
+      {
+        for (auto& state : s.states)
+          state = BiquadState {};
+        if (params.type == EffectType::Reverb && params.reverb != nullptr)
+          params.reverb->reset();
+      }
+      if (params.type == EffectType::Filter)
+        s.coeffs = make_biquad(params.filter, sample_rate);
+    }
+
+    // Only redesigns the filters: the reverbs of an idle chain may already be gone, see
+    //   EffectParams, and are only touched again once the slot has been set anew.
+    void configure(int sample_rate)
+    {
+      for (auto& s : m_slots)
+        if (s.params.type == EffectType::Filter)
+          s.coeffs = make_biquad(s.params.filter, sample_rate);
+    }
+
+    // Clears filter states and reverb tails, keeping the parameters.
+    void reset()
+    {
+      for (auto& s : m_slots)
+      {
+        for (auto& state : s.states)
+          state = BiquadState {};
+        if (s.params.type == EffectType::Reverb && s.params.reverb != nullptr)
+          s.params.reverb->reset();
+      }
+    }
+
+    bool is_empty() const { return m_num_active == 0; }
+
+    // True while a reverb may still be ringing after the input stops.
+    bool has_tail() const
+    {
+      for (const auto& s : m_slots)
+        if (s.params.type == EffectType::Reverb && s.params.reverb != nullptr)
+          return true;
+      return false;
+    }
+
+    // Channel c at planes + c * stride.
+    void process(float* planes, int stride, int channel_count, int frame_count)
+    {
+      if (m_num_active == 0)
+        return;
+      const int num_channels = std::min(channel_count, MaxChannels);
+      for (auto& s : m_slots)
+        switch (s.params.type)
+        {
+          case EffectType::Filter:
+            for (int c = 0; c < num_channels; ++c)
+              process_biquad(s.coeffs, s.states[c], planes + c * stride, frame_count);
+            break;
+          case EffectType::Reverb:
+            if (s.params.reverb != nullptr)
+              s.params.reverb->process(planes, stride, num_channels, frame_count, s.params.wet, s.params.dry);
+            break;
+          case EffectType::None:
+            break;
+        }
+    }
+  };
+
+}
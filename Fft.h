@@ -0,0 +1,226 @@
+//
+//  Fft.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "SampleKernels.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+
+
+namespace audio
+{
+
+  // FFT of a real block of a power of two size N, computed as a complex FFT of N/2 points
+  //   on the even and odd samples plus one pass that splits the two spectra apart.
+  //   Spectra are split complex arrays of N/2 + 1 bins: real parts in re, imaginary parts
+  //   in im. All tables are built in the constructor, so forward() and inverse() do not
+  //   allocate and may run on the audio thread.
+  class RealFft
+  {
+    int m_size = 0;
+    int m_half = 0;
+    std::vector<uint32_t> m_bit_reverse;
+    // e^(-2 pi i k / len) for the complex pass of length len at offset len / 2 - 1, k < len / 2,
+    //   so each pass reads its twiddles contiguously and its butterflies vectorize.
+    std::vector<float> m_twiddle_re;
+    std::vector<float> m_twiddle_im;
+    // Conjugated, for the inverse.
+    std::vector<float> m_twiddle_im_inverse;
+    // e^(-2 pi i k / N) for the split pass, k <= N/4.
+    std::vector<float> m_split_re;
+    std::vector<float> m_split_im;
+
+    // Radix-2 decimation in time on bit reversed input. inverse conjugates the twiddles.
+    void transform(float* re, float* im, bool inverse) const
+    {
+      // The first pass only needs W^0 = 1.
+      for (int a = 0; a < m_half; a += 2)
+      {
+        const float v_re = re[a + 1];
+        const float v_im = im[a + 1];
+        re[a + 1] = re[a] - v_re;
+        im[a + 1] = im[a] - v_im;
+        re[a] += v_re;
+        im[a] += v_im;
+      }
+      const auto& twiddle_im = inverse ? m_twiddle_im_inverse : m_twiddle_im;
+      for (int len = 4; len <= m_half; len <<= 1)
+      {
+        const int half_len = len / 2;
+        const float* w_re = m_twiddle_re.data() + half_len - 1;
+        const float* w_im = twiddle_im.data() + half_len - 1;
+        for (int i = 0; i < m_half; i += len)
+        {
+          float* a_re = re + i;
+          float* a_im = im + i;
+          float* b_re = a_re + half_len;
+          float* b_im = a_im + half_len;
+          int j = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+          for (; j + 4 <= half_len; j += 4)
+          {
+            const __m128 wr = _mm_loadu_ps(w_re + j);
+            const __m128 wi = _mm_loadu_ps(w_im + j);
+            const __m128 br = _mm_loadu_ps(b_re + j);
+            const __m128 bi = _mm_loadu_ps(b_im + j);
+            const __m128 ar = _mm_loadu_ps(a_re + j);
+            const __m128 ai = _mm_loadu_ps(a_im + j);
+            const __m128 vr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+            const __m128 vi = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+            _mm_storeu_ps(b_re + j, _mm_sub_ps(ar, vr));
+            _mm_storeu_ps(b_im + j, _mm_sub_ps(ai, vi));
+            _mm_storeu_ps(a_re + j, _mm_add_ps(ar, vr));
+            _mm_storeu_ps(a_im + j, _mm_add_ps(ai, vi));
+          }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+          for (; j + 4 <= half_len; j += 4)
+          {
+            const float32x4_t wr = vld1q_f32(w_re + j);
+            const float32x4_t wi = vld1q_f32(w_im + j);
+            const float32x4_t br = vld1q_f32(b_re + j);
+            const float32x4_t bi = vld1q_f32(b_im + j);
+            const float32x4_t ar = vld1q_f32(a_re + j);
+            const float32x4_t ai = vld1q_f32(a_im + j);
+            const float32x4_t vr = vmlsq_f32(vmulq_f32(br, wr), bi, wi);
+            const float32x4_t vi = vmlaq_f32(vmulq_f32(br, wi), bi, wr);
+            vst1q_f32(b_re + j, vsubq_f32(ar, vr));
+            vst1q_f32(b_im + j, vsubq_f32(ai, vi));
+            vst1q_f32(a_re + j, vaddq_f32(ar, vr));
+            vst1q_f32(a_im + j, vaddq_f32(ai, vi));
+          }
+#endif
+          for (; j < half_len; ++j)
+          {
+            const float v_re = b_re[j] * w_re[j] - b_im[j] * w_im[j];
+            const float v_im = b_re[j] * w_im[j] + b_im[j] * w_re[j];
+            b_re[j] = a_re[j] - v_re;
+            b_im[j] = a_im[j] - v_im;
+            a_re[j] += v_re;
+            a_im[j] += v_im;
+          }
+        }
+      }
+    }
+
+  public:
+    explicit RealFft(int size)
+      : m_size(size)
+      , m_half(size / 2)
+    {
+      if (size < 4 || (size & (size - 1)) != 0)
+        throw std::runtime_error("FFT size must be a power of two >= 4.");
+      int bits = 0;
+      while ((1 << bits) < m_half)
+        ++bits;
+      m_bit_reverse.resize(m_half);
+      for (int i = 0; i < m_half; ++i)
+      {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b)
+          r |= ((i >> b) & 1u) << (bits - 1 - b);
+        m_bit_reverse[i] = r;
+      }
+      for (int len = 2; len <= m_half; len <<= 1)
+        for (int k = 0; k < len / 2; ++k)
+        {
+          m_twiddle_re.emplace_back(static_cast<float>(std::cos(2.0 * M_PI * k / len)));
+          m_twiddle_im.emplace_back(static_cast<float>(-std::sin(2.0 * M_PI * k / len)));
+          m_twiddle_im_inverse.emplace_back(-m_twiddle_im.back());
+        }
+      for (int k = 0; k <= m_half / 2; ++k)
+      {
+        m_split_re.emplace_back(static_cast<float>(std::cos(2.0 * M_PI * k / m_size)));
+        m_split_im.emplace_back(static_cast<float>(-std::sin(2.0 * M_PI * k / m_size)));
+      }
+    }
+
+    int get_size() const { return m_size; }
+
+    int get_num_bins() const { return m_half + 1; }
+
+    // Spectrum of m_size samples.
+    void forward(const float* src, float* re, float* im) const
+    {
+      for (int n = 0; n < m_half; ++n)
+      {
+        re[m_bit_reverse[n]] = src[2 * n];
+        im[m_bit_reverse[n]] = src[2 * n + 1];
+      }
+      transform(re, im, false);
+
+      // With Z the spectrum of even + i * odd samples, E = (Z[k] + conj(Z[h - k])) / 2 and
+      //   O = (Z[k] - conj(Z[h - k])) / 2i are the spectra of the even and the odd samples.
+      //   X[k] = E + W^k O and X[h - k] = conj(E - W^k O), so bins pair up in place.
+      const float z0_re = re[0];
+      const float z0_im = im[0];
+      re[0] = z0_re + z0_im;
+      im[0] = 0.f;
+      re[m_half] = z0_re - z0_im;
+      im[m_half] = 0.f;
+      for (int k = 1; k <= m_half / 2; ++k)
+      {
+        const int m = m_half - k;
+        const float e_re = 0.5f * (re[k] + re[m]);
+        const float e_im = 0.5f * (im[k] - im[m]);
+        const float o_re = 0.5f * (im[k] + im[m]);
+        const float o_im = -0.5f * (re[k] - re[m]);
+        const float t_re = m_split_re[k] * o_re - m_split_im[k] * o_im;
+        const float t_im = m_split_re[k] * o_im + m_split_im[k] * o_re;
+        re[k] = e_re + t_re;
+        im[k] = e_im + t_im;
+        re[m] = e_re - t_re;
+        im[m] = t_im - e_im;
+      }
+    }
+
+    // m_size samples from a spectrum, scaled so that inverse(forward(x)) == x.
+    //   Overwrites re and im.
+    void inverse(float* re, float* im, float* dst) const
+    {
+      // The reverse of the split in forward(): Z[k] = E + i O with
+      //   E = (X[k] + conj(X[h - k])) / 2 and O = conj(W^k) (X[k] - conj(X[h - k])) / 2.
+      const float x0 = re[0];
+      const float xh = re[m_half];
+      re[0] = 0.5f * (x0 + xh);
+      im[0] = 0.5f * (x0 - xh);
+      for (int k = 1; k <= m_half / 2; ++k)
+      {
+        const int m = m_half - k;
+        const float e_re = 0.5f * (re[k] + re[m]);
+        const float e_im = 0.5f * (im[k] - im[m]);
+        const float d_re = 0.5f * (re[k] - re[m]);
+        const float d_im = 0.5f * (im[k] + im[m]);
+        const float o_re = m_split_re[k] * d_re + m_split_im[k] * d_im;
+        const float o_im = m_split_re[k] * d_im - m_split_im[k] * d_re;
+        // Z[k] = E + i O, Z[h - k] = conj(E) + i conj(O).
+        re[k] = e_re - o_im;
+        im[k] = e_im + o_re;
+        re[m] = e_re + o_im;
+        im[m] = o_re - e_im;
+      }
+
+      for (int n = 0; n < m_half; ++n)
+      {
+        const uint32_t r = m_bit_reverse[n];
+        if (r > static_cast<uint32_t>(n))
+        {
+          std::swap(re[n], re[r]);
+          std::swap(im[n], im[r]);
+        }
+      }
+      transform(re, im, true);
+      const float scale = 1.f / m_half;
+      for (int n = 0; n < m_half; ++n)
+      {
+        dst[2 * n] = re[n] * scale;
+        dst[2 * n + 1] = im[n] * scale;
+      }
+    }
+  };
+
+}
@@ -0,0 +1,120 @@
+//
+//  GainRamp.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+namespace audio
+{
+
+  // How volume and pan changes are smoothed. Either way the gain is ramped linearly
+  //   sample by sample within a mix block, so a change never shows up as a step.
+  enum class GainSmoothing : uint8_t
+  {
+    Linear,       // Reaches the new value at the end of the next mix block.
+    Exponential,  // One-pole approach with the mixer's smoothing time constant.
+  };
+
+  enum class FadeCurve : uint8_t
+  {
+    Linear,
+    Exponential,  // Linear in dB down to -60 dB. Sounds even for long fades.
+    EqualPower,   // Quarter sine/cosine. Keeps the summed power constant in a crossfade.
+  };
+
+  // A parameter as applied by the mixer, chasing the value most recently set by the API.
+  struct SmoothedValue
+  {
+    static constexpr float c_snap = 1e-4f;
+
+    float current = 0.f;
+
+    // Returns the value at the end of a block of frame_count frames.
+    //   tau_frames is the time constant for GainSmoothing::Exponential.
+    float next(float target, GainSmoothing smoothing, float tau_frames, int frame_count)
+    {
+      if (smoothing == GainSmoothing::Exponential && tau_frames > 0.f)
+        current += (target - current) * (1.f - std::exp(-frame_count / tau_frames));
+      else
+        current = target;
+      if (std::abs(target - current) < c_snap)
+        current = target;
+      return current;
+    }
+  };
+
+  // A fade of a given length in frames. The mixer evaluates it once per block and ramps
+  //   linearly in between, i.e. curves are piecewise linear at mix block resolution.
+  struct Fade
+  {
+    static constexpr float c_exp_floor = 1e-3f;
+
+    float from = 1.f;
+    float to = 1.f;
+    int total_frames = 0;
+    int done_frames = 0;
+    FadeCurve curve = FadeCurve::Linear;
+    // Finishes the voice once the fade is complete, e.g. for a fade-out or the outgoing
+    //   side of a crossfade.
+    bool stop_at_end = false;
+
+    void start(float from_gain, float to_gain, int frames, FadeCurve fade_curve, bool stop)
+    {
+      from = from_gain;
+      to = to_gain;
+      total_frames = std::max(frames, 0);
+      done_frames = 0;
+      curve = fade_curve;
+      stop_at_end = stop;
+    }
+
+    bool is_done() const { return done_frames >= total_frames; }
+
+    float get_value() const
+    {
+      if (is_done())
+        return to;
+      float t = static_cast<float>(done_frames) / total_frames;
+      switch (curve)
+      {
+        case FadeCurve::Linear:
+          return from + (to - from) * t;
+        case FadeCurve::Exponential:
+        {
+          float a = std::log(std::max(from, c_exp_floor));
+          float b = std::log(std::max(to, c_exp_floor));
+          return std::exp(a + (b - a) * t);
+        }
+        case FadeCurve::EqualPower:
+        {
+          float w = to >= from ? std::sin(t * 1.5707963f) : 1.f - std::cos(t * 1.5707963f);
+          return from + (to - from) * w;
+        }
+      }
+      return to;
+    }
+
+    // Returns the value after frame_count more frames.
+    float advance(int frame_count)
+    {
+      done_frames = std::min(done_frames + frame_count, total_frames);
+      return get_value();
+    }
+  };
+
+  // Which side of the listener an output channel is on: -1 left, 1 right, 0 neither.
+  // Balance law: a centered source leaves every channel at unity gain, and panning
+  //   attenuates the opposite side along a quarter cosine, down to silence at +-1.
+  inline float get_pan_gain(float pan, int side)
+  {
+    if (side == 0 || pan * side >= 0.f)
+      return 1.f;
+    return std::cos(std::min(std::abs(pan), 1.f) * 1.5707963f);
+  }
+
+}
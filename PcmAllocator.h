@@ -0,0 +1,184 @@
+//
+//  PcmAllocator.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace audio
+{
+
+  // Storage for PCM data the adapter copies, see InitParams::pcm_allocator. Called from
+  //   API threads only, never from the audio callback. Blocks must be aligned to at least
+  //   c_alignment bytes.
+  class IPcmAllocator
+  {
+  public:
+    static constexpr size_t c_alignment = 64;
+
+    virtual ~IPcmAllocator() = default;
+
+    virtual void* allocate(size_t num_bytes) = 0;
+    // num_bytes is the value passed to allocate().
+    virtual void deallocate(void* ptr, size_t num_bytes) = 0;
+  };
+
+  struct PcmAllocatorStats
+  {
+    // Held from the system, including free slab blocks.
+    size_t reserved_bytes = 0;
+    // Handed out, rounded up to the block size.
+    size_t allocated_bytes = 0;
+    size_t num_slabs = 0;
+    size_t num_large_blocks = 0;
+  };
+
+  // Small blocks, typically short sound effects, come from slabs carved into eight or more
+  //   blocks of one size class each. Size classes step by quarter powers of two from 1 KiB
+  //   to 256 KiB, so at most a fifth of a block is wasted. Freed blocks go back to their
+  //   class's free list and slabs are kept until the allocator is destroyed, so loading
+  //   and unloading sounds all session long does not fragment the heap.
+  // Larger blocks, typically music, are allocated on their own, rounded up to 64 KiB.
+  //   The system allocator serves such sizes from separate mappings.
+  class PoolPcmAllocator final : public IPcmAllocator
+  {
+    static constexpr size_t c_min_slab_bytes = size_t(64) << 10;
+    static constexpr size_t c_min_blocks_per_slab = 8;
+    static constexpr int c_min_class_shift = 10;
+    static constexpr int c_num_classes = 33;
+    static constexpr size_t c_large_granularity = size_t(64) << 10;
+
+    struct SizeClass
+    {
+      std::vector<void*> free_blocks;
+    };
+
+    std::array<SizeClass, c_num_classes> m_classes;
+    std::vector<void*> m_slabs;
+    size_t m_slab_bytes = 0;
+    size_t m_allocated_bytes = 0;
+    size_t m_large_bytes = 0;
+    size_t m_num_large_blocks = 0;
+    mutable std::mutex m_mutex;
+
+    // 1, 1.25, 1.5, 1.75 times 2^n KiB.
+    static size_t get_class_size(int size_class)
+    {
+      const int shift = c_min_class_shift + size_class / 4;
+      return ((4 + size_class % 4) * (size_t(1) << shift)) / 4;
+    }
+
+    static int find_class(size_t num_bytes)
+    {
+      for (int c = 0; c < c_num_classes; ++c)
+        if (num_bytes <= get_class_size(c))
+          return c;
+      return -1;
+    }
+
+    static size_t get_slab_bytes(int size_class)
+    {
+      return std::max(c_min_slab_bytes, get_class_size(size_class) * c_min_blocks_per_slab);
+    }
+
+    static size_t round_up_large(size_t num_bytes)
+    {
+      return (num_bytes + c_large_granularity - 1) / c_large_granularity * c_large_granularity;
+    }
+
+    void add_slab(int size_class)
+    {
+      const size_t slab_bytes = get_slab_bytes(size_class);
+      auto* slab = static_cast<unsigned char*>(::operator new(slab_bytes, std::align_val_t(c_alignment)));
+      m_slabs.emplace_back(slab);
+      m_slab_bytes += slab_bytes;
+      const size_t block_bytes = get_class_size(size_class);
+      auto& free_blocks = m_classes[size_class].free_blocks;
+      // Reversed, so blocks are handed out in address order.
+      for (size_t offset = slab_bytes / block_bytes * block_bytes; offset > 0; offset -= block_bytes)
+        free_blocks.emplace_back(slab + offset - block_bytes);
+    }
+
+  public:
+    // Blocks up to this size come from slabs.
+    static size_t get_max_small_bytes() { return get_class_size(c_num_classes - 1); }
+
+    PoolPcmAllocator() = default;
+    PoolPcmAllocator(const PoolPcmAllocator&) = delete;
+    PoolPcmAllocator& operator=(const PoolPcmAllocator&) = delete;
+
+    ~PoolPcmAllocator() override
+    {
+      for (auto* slab : m_slabs)
+        ::operator delete(slab, std::align_val_t(c_alignment));
+    }
+
+    void* allocate(size_t num_bytes) override
+    {
+      num_bytes = std::max<size_t>(num_bytes, 1);
+      const int size_class = find_class(num_bytes);
+      if (size_class < 0)
+      {
+        const size_t block_bytes = round_up_large(num_bytes);
+        void* block = ::operator new(block_bytes, std::align_val_t(c_alignment));
+        std::scoped_lock lock(m_mutex);
+        m_large_bytes += block_bytes;
+        m_num_large_blocks++;
+        m_allocated_bytes += block_bytes;
+        return block;
+      }
+
+      std::scoped_lock lock(m_mutex);
+      auto& free_blocks = m_classes[size_class].free_blocks;
+      if (free_blocks.empty())
+        add_slab(size_class);
+      void* block = free_blocks.back();
+      free_blocks.pop_back();
+      m_allocated_bytes += get_class_size(size_class);
+      return block;
+    }
+
+    void deallocate(void* ptr, size_t num_bytes) override
+    {
+      if (ptr == nullptr)
+        return;
+      num_bytes = std::max<size_t>(num_bytes, 1);
+      const int size_class = find_class(num_bytes);
+      if (size_class < 0)
+      {
+        const size_t block_bytes = round_up_large(num_bytes);
+        ::operator delete(ptr, std::align_val_t(c_alignment));
+        std::scoped_lock lock(m_mutex);
+        m_large_bytes -= block_bytes;
+        m_num_large_blocks--;
+        m_allocated_bytes -= block_bytes;
+        return;
+      }
+
+      std::scoped_lock lock(m_mutex);
+      m_classes[size_class].free_blocks.emplace_back(ptr);
+      m_allocated_bytes -= get_class_size(size_class);
+    }
+
+    PcmAllocatorStats get_stats() const
+    {
+      std::scoped_lock lock(m_mutex);
+      PcmAllocatorStats stats;
+      stats.reserved_bytes = m_slab_bytes + m_large_bytes;
+      stats.allocated_bytes = m_allocated_bytes;
+      stats.num_slabs = m_slabs.size();
+      stats.num_large_blocks = m_num_large_blocks;
+      return stats;
+    }
+  };
+
+}
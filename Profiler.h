@@ -0,0 +1,252 @@
+//
+//  Profiler.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <bit>
+
+
+// Define AUDIOLIBSWITCHER_LIBSOUNDIO_PROFILING to record callback timing.
+//   Without it CallbackProfiler is an empty class and every call compiles away.
+namespace audio
+{
+
+  struct HistogramSnapshot
+  {
+    // Bucket i counts values in (upper_bounds[i - 1], upper_bounds[i]].
+    std::vector<uint64_t> upper_bounds;
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+
+    // Upper bound of the bucket containing the p-th quantile, p in [0, 1], capped at max.
+    uint64_t percentile(double p) const
+    {
+      if (count == 0)
+        return 0;
+      uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * count)));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < counts.size(); ++i)
+      {
+        seen += counts[i];
+        if (seen >= rank)
+          return std::min(upper_bounds[i], max);
+      }
+      return max;
+    }
+  };
+
+  // Fixed-bucket histogram written by one thread and read by any other without locks.
+  //   Log2 buckets cover [0, 2^63] with one bucket per power of two; linear buckets
+  //   have a fixed width and clamp overflow into the last bucket.
+  class AtomicHistogram
+  {
+  public:
+    enum class Scale : uint8_t { Log2, Linear };
+
+  private:
+    Scale m_scale = Scale::Log2;
+    uint64_t m_bucket_width = 1;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+    size_t m_num_buckets = 0;
+    std::atomic<uint64_t> m_count { 0 };
+    std::atomic<uint64_t> m_sum { 0 };
+    std::atomic<uint64_t> m_max { 0 };
+
+    size_t get_bucket(uint64_t value) const
+    {
+      if (m_scale == Scale::Log2)
+        return std::bit_width(value);
+      return std::min<size_t>(value / m_bucket_width, m_num_buckets - 1);
+    }
+
+    uint64_t get_upper_bound(size_t bucket) const
+    {
+      if (m_scale == Scale::Log2)
+        return bucket == 0 ? 0 : (bucket >= 64 ? ~uint64_t(0) : (uint64_t(1) << bucket) - 1);
+      return bucket + 1 == m_num_buckets ? ~uint64_t(0) : (bucket + 1) * m_bucket_width - 1;
+    }
+
+  public:
+    explicit AtomicHistogram(Scale scale = Scale::Log2, uint64_t bucket_width = 1, size_t num_buckets = 65)
+      : m_scale(scale)
+      , m_bucket_width(std::max<uint64_t>(bucket_width, 1))
+      , m_num_buckets(scale == Scale::Log2 ? 65 : std::max<size_t>(num_buckets, 1))
+    {
+      m_counts = std::make_unique<std::atomic<uint64_t>[]>(m_num_buckets);
+    }
+
+    // Writer thread only.
+    void record(uint64_t value)
+    {
+      m_counts[get_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_sum.fetch_add(value, std::memory_order_relaxed);
+      if (value > m_max.load(std::memory_order_relaxed))
+        m_max.store(value, std::memory_order_relaxed);
+    }
+
+    // Writer thread only.
+    void reset()
+    {
+      for (size_t i = 0; i < m_num_buckets; ++i)
+        m_counts[i].store(0, std::memory_order_relaxed);
+      m_count.store(0, std::memory_order_relaxed);
+      m_sum.store(0, std::memory_order_relaxed);
+      m_max.store(0, std::memory_order_relaxed);
+    }
+
+    // Any thread. The fields are read one at a time, so a snapshot taken while the writer
+    //   is active may be off by the values recorded meanwhile.
+    HistogramSnapshot snapshot() const
+    {
+      HistogramSnapshot snap;
+      size_t last = 0;
+      std::vector<uint64_t> counts(m_num_buckets);
+      for (size_t i = 0; i < m_num_buckets; ++i)
+      {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        if (counts[i] > 0)
+          last = i + 1;
+      }
+      // Trailing empty buckets are left out to keep snapshots and CSV rows short.
+      for (size_t i = 0; i < last; ++i)
+      {
+        snap.upper_bounds.emplace_back(get_upper_bound(i));
+        snap.counts.emplace_back(counts[i]);
+      }
+      snap.count = m_count.load(std::memory_order_relaxed);
+      snap.sum = m_sum.load(std::memory_order_relaxed);
+      snap.max = m_max.load(std::memory_order_relaxed);
+      return snap;
+    }
+  };
+
+  struct ProfileSnapshot
+  {
+    struct VoiceProfile
+    {
+      unsigned int source_id = 0;
+      // Time spent pulling, resampling and mixing this source per mix block.
+      HistogramSnapshot mix_ns;
+    };
+
+    // False if the library was built without AUDIOLIBSWITCHER_LIBSOUNDIO_PROFILING.
+    bool enabled = false;
+    std::string device_id;
+    std::string device_name;
+    int sample_rate = 0;
+    // Wall time of each write callback.
+    HistogramSnapshot callback_ns;
+    HistogramSnapshot frames_per_callback;
+    // Callback wall time divided by the duration of the frames written, in per mille.
+    //   1000 means the callback took as long as the audio it produced.
+    HistogramSnapshot load_permille;
+    // Sources currently holding a voice.
+    std::vector<VoiceProfile> sources;
+  };
+
+  // One row per histogram: device,scope,metric,count,mean,p50,p90,p99,max.
+  inline std::string to_csv(const ProfileSnapshot& profile)
+  {
+    std::string csv = "device,scope,metric,count,mean,p50,p90,p99,max\n";
+    auto add_row = [&](const std::string& scope, const char* metric, const HistogramSnapshot& h)
+    {
+      csv += profile.device_id + ',' + scope + ',' + metric + ',' + std::to_string(h.count) + ','
+        + std::to_string(h.mean()) + ',' + std::to_string(h.percentile(0.5)) + ','
+        + std::to_string(h.percentile(0.9)) + ',' + std::to_string(h.percentile(0.99)) + ','
+        + std::to_string(h.max) + '\n';
+    };
+    add_row("device", "callback_ns", profile.callback_ns);
+    add_row("device", "frames_per_callback", profile.frames_per_callback);
+    add_row("device", "load_permille", profile.load_permille);
+    for (const auto& source : profile.sources)
+      add_row("source:" + std::to_string(source.source_id), "mix_ns", source.mix_ns);
+    return csv;
+  }
+
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_PROFILING)
+  // Records into histograms from the write callback. Snapshots may be taken from any thread.
+  class CallbackProfiler
+  {
+    AtomicHistogram m_callback_ns;
+    AtomicHistogram m_frames { AtomicHistogram::Scale::Linear, 64, 129 };
+    AtomicHistogram m_load_permille { AtomicHistogram::Scale::Linear, 25, 81 };
+    std::vector<AtomicHistogram> m_voice_ns;
+    int m_sample_rate = 0;
+
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    void init(size_t num_voices, int sample_rate)
+    {
+      m_voice_ns = std::vector<AtomicHistogram>(num_voices);
+      m_sample_rate = sample_rate;
+    }
+
+    Clock::time_point now() const { return Clock::now(); }
+
+    void record_callback(Clock::time_point start, int frame_count)
+    {
+      auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+      m_callback_ns.record(ns);
+      m_frames.record(static_cast<uint64_t>(frame_count));
+      if (frame_count > 0 && m_sample_rate > 0)
+        m_load_permille.record(ns * m_sample_rate / (static_cast<uint64_t>(frame_count) * 1000000));
+    }
+
+    void record_voice(size_t voice, Clock::time_point start)
+    {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+      m_voice_ns[voice].record(static_cast<uint64_t>(ns));
+    }
+
+    // A voice was (re)started for another play, so its history no longer applies.
+    void reset_voice(size_t voice)
+    {
+      m_voice_ns[voice].reset();
+    }
+
+    void fill(ProfileSnapshot& profile) const
+    {
+      profile.enabled = true;
+      profile.sample_rate = m_sample_rate;
+      profile.callback_ns = m_callback_ns.snapshot();
+      profile.frames_per_callback = m_frames.snapshot();
+      profile.load_permille = m_load_permille.snapshot();
+    }
+
+    HistogramSnapshot get_voice_snapshot(size_t voice) const
+    {
+      return voice < m_voice_ns.size() ? m_voice_ns[voice].snapshot() : HistogramSnapshot {};
+    }
+  };
+#else
+  class CallbackProfiler
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    void init(size_t, int) {}
+    Clock::time_point now() const { return {}; }
+    void record_callback(Clock::time_point, int) {}
+    void record_voice(size_t, Clock::time_point) {}
+    void reset_voice(size_t) {}
+    void fill(ProfileSnapshot&) const {}
+    HistogramSnapshot get_voice_snapshot(size_t) const { return {}; }
+  };
+#endif
+
+}
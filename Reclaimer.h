@@ -0,0 +1,60 @@
+//
+//  Reclaimer.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace audio
+{
+
+  // Keeps objects alive that the audio callback may still be reading through a raw pointer
+  //   and drops them in batches once it no longer can. The callback never touches a
+  //   reference count or frees anything.
+  // Epochs count the commands posted to the mixer. An object retired in epoch e is unused
+  //   once the mixer has applied e commands, because the commands that detached it from
+  //   its voices were posted before it was retired. Only used from the API thread.
+  class Reclaimer
+  {
+    struct Retired
+    {
+      std::shared_ptr<const void> object;
+      uint64_t epoch = 0;
+    };
+
+    // In epoch order, as epochs never decrease.
+    std::vector<Retired> m_retired;
+    uint64_t m_num_reclaimed = 0;
+
+  public:
+    void retire(std::shared_ptr<const void> object, uint64_t epoch)
+    {
+      if (object != nullptr)
+        m_retired.push_back({ std::move(object), epoch });
+    }
+
+    // Releases every object retired in an epoch <= applied_epoch. Returns how many.
+    size_t collect(uint64_t applied_epoch)
+    {
+      if (m_retired.empty() || m_retired.front().epoch > applied_epoch)
+        return 0;
+      auto end = m_retired.begin();
+      while (end != m_retired.end() && end->epoch <= applied_epoch)
+        ++end;
+      const auto count = static_cast<size_t>(end - m_retired.begin());
+      m_retired.erase(m_retired.begin(), end);
+      m_num_reclaimed += count;
+      return count;
+    }
+
+    size_t get_num_pending() const { return m_retired.size(); }
+
+    uint64_t get_num_reclaimed() const { return m_num_reclaimed; }
+  };
+
+}
@@ -0,0 +1,203 @@
+//
+//  Resampler.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "SampleKernels.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+namespace audio
+{
+
+  enum class ResamplerQuality : uint8_t
+  {
+    Linear,  // 2 taps.
+    Cubic,   // 4 taps, Catmull-Rom.
+    Sinc,    // 16 taps, Kaiser windowed sinc, polyphase with interpolated phases.
+  };
+
+  // Polyphase Kaiser windowed sinc coefficients.
+  // One table per cutoff bucket, so that downsampling (step > 1) lowers the cutoff
+  //   instead of aliasing. Built once on first use.
+  class SincTable
+  {
+  public:
+    static constexpr int c_taps = 16;
+    static constexpr int c_phases = 256;
+
+  private:
+    static constexpr int c_num_buckets = 5;
+    static constexpr double c_bucket_steps[c_num_buckets] { 1.0, 1.5, 2.0, 3.0, 4.0 };
+
+    // [bucket][phase 0..c_phases][tap]. The extra phase lets the last one interpolate towards the next tap.
+    std::vector<float> m_coeffs;
+
+    static double bessel_i0(double x)
+    {
+      double sum = 1.0;
+      double term = 1.0;
+      for (int k = 1; k < 32; ++k)
+      {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+      }
+      return sum;
+    }
+
+    SincTable()
+      : m_coeffs(static_cast<size_t>(c_num_buckets) * (c_phases + 1) * c_taps)
+    {
+      const double beta = 8.0;
+      const double half = c_taps / 2.0;
+      for (int bucket = 0; bucket < c_num_buckets; ++bucket)
+      {
+        const double cutoff = 0.92 / c_bucket_steps[bucket];
+        for (int phase = 0; phase <= c_phases; ++phase)
+        {
+          float* coeffs = &m_coeffs[(static_cast<size_t>(bucket) * (c_phases + 1) + phase) * c_taps];
+          double frac = static_cast<double>(phase) / c_phases;
+          double sum = 0.0;
+          for (int tap = 0; tap < c_taps; ++tap)
+          {
+            // Tap 'half - 1' sits on the interpolation point when frac == 0.
+            double x = tap - (half - 1) - frac;
+            double arg = cutoff * x * M_PI;
+            double sinc = std::abs(arg) < 1e-9 ? 1.0 : std::sin(arg) / arg;
+            double r = x / half;
+            double window = std::abs(r) >= 1.0 ? 0.0 : bessel_i0(beta * std::sqrt(1.0 - r * r)) / bessel_i0(beta);
+            coeffs[tap] = static_cast<float>(sinc * window);
+            sum += coeffs[tap];
+          }
+          // Unity gain at DC for every phase.
+          for (int tap = 0; tap < c_taps; ++tap)
+            coeffs[tap] = static_cast<float>(coeffs[tap] / sum);
+        }
+      }
+    }
+
+  public:
+    static const SincTable& get()
+    {
+      static const SincTable table;
+      return table;
+    }
+
+    static int bucket_for_step(double step)
+    {
+      for (int bucket = 0; bucket < c_num_buckets; ++bucket)
+        if (step <= c_bucket_steps[bucket])
+          return bucket;
+      return c_num_buckets - 1;
+    }
+
+    const float* phase(int bucket, int phase) const
+    {
+      return &m_coeffs[(static_cast<size_t>(bucket) * (c_phases + 1) + phase) * c_taps];
+    }
+  };
+
+  inline int get_num_taps(ResamplerQuality quality)
+  {
+    switch (quality)
+    {
+      case ResamplerQuality::Linear: return 2;
+      case ResamplerQuality::Cubic: return 4;
+      case ResamplerQuality::Sinc: return SincTable::c_taps;
+    }
+    return 2;
+  }
+
+  // Streaming resampler state for one channel.
+  // Each block works on a window of c_history past input frames followed by the new input
+  //   frames of the block. 'position' is where the next output frame is read in that window.
+  //   It starts at c_history, i.e. on the first input frame, so the resampler adds no delay.
+  //   Instead it reads up to c_taps / 2 frames ahead of the playback position.
+  // The window layout does not depend on the quality, so the quality may change mid-stream.
+  struct ResamplerState
+  {
+    static constexpr int c_history = SincTable::c_taps;
+
+    float history[c_history] {};
+    double position = c_history;
+
+    void reset()
+    {
+      std::fill(std::begin(history), std::end(history), 0.f);
+      position = c_history;
+    }
+  };
+
+  // Number of new input frames the next call to resample() consumes.
+  inline int get_resampler_input_frames(const ResamplerState& state, ResamplerQuality quality,
+                                        double step, int frame_count)
+  {
+    const int taps = get_num_taps(quality);
+    double last = state.position + (frame_count - 1) * step;
+    return std::max(0, static_cast<int>(std::floor(last)) + taps / 2 - ResamplerState::c_history + 1);
+  }
+
+  // window: c_history floats of scratch followed by the input_frames new input frames,
+  //   where input_frames == get_resampler_input_frames(...).
+  //   The history part is filled in here and the state is advanced.
+  inline void resample(ResamplerState& state, ResamplerQuality quality, double step,
+                       float* window, int input_frames, float* out, int frame_count)
+  {
+    constexpr int H = ResamplerState::c_history;
+    std::copy(std::begin(state.history), std::end(state.history), window);
+
+    const double start = state.position;
+    switch (quality)
+    {
+      case ResamplerQuality::Linear:
+        for (int k = 0; k < frame_count; ++k)
+        {
+          double pos = start + k * step;
+          int i = static_cast<int>(pos);
+          float f = static_cast<float>(pos - i);
+          out[k] = window[i] + f * (window[i + 1] - window[i]);
+        }
+        break;
+      case ResamplerQuality::Cubic:
+        for (int k = 0; k < frame_count; ++k)
+        {
+          double pos = start + k * step;
+          int i = static_cast<int>(pos);
+          float f = static_cast<float>(pos - i);
+          float p0 = window[i - 1];
+          float p1 = window[i];
+          float p2 = window[i + 1];
+          float p3 = window[i + 2];
+          float a = -0.5f * p0 + 1.5f * p1 - 1.5f * p2 + 0.5f * p3;
+          float b = p0 - 2.5f * p1 + 2.f * p2 - 0.5f * p3;
+          float c = -0.5f * p0 + 0.5f * p2;
+          out[k] = ((a * f + b) * f + c) * f + p1;
+        }
+        break;
+      case ResamplerQuality::Sinc:
+      {
+        const auto& table = SincTable::get();
+        const int bucket = SincTable::bucket_for_step(step);
+        constexpr int half = SincTable::c_taps / 2;
+        for (int k = 0; k < frame_count; ++k)
+        {
+          double pos = start + k * step;
+          int i = static_cast<int>(pos);
+          float phase_pos = static_cast<float>(pos - i) * SincTable::c_phases;
+          int phase = std::min(static_cast<int>(phase_pos), SincTable::c_phases - 1);
+          out[k] = kernels::dot_lerp(window + i - (half - 1), table.phase(bucket, phase), table.phase(bucket, phase + 1),
+                                     phase_pos - phase, SincTable::c_taps);
+        }
+        break;
+      }
+    }
+
+    std::copy(window + input_frames, window + input_frames + H, state.history);
+    state.position = start + frame_count * step - input_frames;
+  }
+
+}
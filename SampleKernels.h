@@ -0,0 +1,905 @@
+//
+//  SampleKernels.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AUDIOLIBSWITCHER_LIBSOUNDIO_NEON
+#endif
+
+
+// Block kernels used by the mixer callback.
+// Each kernel has a scalar fallback. The SIMD paths are picked at compile time
+//   from the target flags (SSE2 is implied on x86-64, -mavx2 enables AVX2, NEON is used on arm64).
+namespace audio::kernels
+{
+
+  // dst[i] = src[i] * gain. Use gain = 1/32768 for normalized output.
+  inline void convert_s16_to_f32(const int16_t* src, float* dst, int count, float gain)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 g8 = _mm256_set1_ps(gain);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s));
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, g8));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      // Sign-extend by unpacking into the high halves and shifting back down.
+      __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+      __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), g4));
+      _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), g4));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    const float32x4_t g4 = vdupq_n_f32(gain);
+    for (; i + 8 <= count; i += 8)
+    {
+      int16x8_t s = vld1q_s16(src + i);
+      vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), g4));
+      vst1q_f32(dst + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), g4));
+    }
+#endif
+    for (; i < count; ++i)
+      dst[i] = src[i] * gain;
+  }
+
+  // dst[i] = src[i] * gain. Use gain = 1/2^31 for normalized output.
+  inline void convert_s32_to_f32(const int32_t* src, float* dst, int count, float gain)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 g8 = _mm256_set1_ps(gain);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256 f = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, g8));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 f = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+      _mm_storeu_ps(dst + i, _mm_mul_ps(f, g4));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    const float32x4_t g4 = vdupq_n_f32(gain);
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(src + i)), g4));
+#endif
+    for (; i < count; ++i)
+      dst[i] = static_cast<float>(src[i]) * gain;
+  }
+
+  // Splits interleaved frames into planar channels and scales them:
+  //   dst[c * stride + f] = src[f * C + c] * gain.
+  template<typename T>
+  inline void deinterleave_to_f32_scalar(const T* src, int channel_count, float* dst, int stride, int frames, float gain)
+  {
+    for (int f = 0; f < frames; ++f)
+      for (int c = 0; c < channel_count; ++c)
+        dst[c * stride + f] = static_cast<float>(src[f * channel_count + c]) * gain;
+  }
+
+  inline void deinterleave_s16_to_f32(const int16_t* src, int channel_count, float* dst, int stride, int frames, float gain)
+  {
+    if (channel_count == 1)
+    {
+      convert_s16_to_f32(src, dst, frames, gain);
+      return;
+    }
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    if (channel_count == 2)
+    {
+      const __m128 g4 = _mm_set1_ps(gain);
+      for (; f + 4 <= frames; f += 4)
+      {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * f));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)); // L0 R0 L1 R1
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)); // L2 R2 L3 R3
+        _mm_storeu_ps(dst + f, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), g4));
+        _mm_storeu_ps(dst + stride + f, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)), g4));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    if (channel_count == 2)
+    {
+      const float32x4_t g4 = vdupq_n_f32(gain);
+      for (; f + 4 <= frames; f += 4)
+      {
+        int16x4x2_t s = vld2_s16(src + 2 * f);
+        vst1q_f32(dst + f, vmulq_f32(vcvtq_f32_s32(vmovl_s16(s.val[0])), g4));
+        vst1q_f32(dst + stride + f, vmulq_f32(vcvtq_f32_s32(vmovl_s16(s.val[1])), g4));
+      }
+    }
+#endif
+    deinterleave_to_f32_scalar(src + f * channel_count, channel_count, dst + f, stride, frames - f, gain);
+  }
+
+  inline void deinterleave_s32_to_f32(const int32_t* src, int channel_count, float* dst, int stride, int frames, float gain)
+  {
+    if (channel_count == 1)
+    {
+      convert_s32_to_f32(src, dst, frames, gain);
+      return;
+    }
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    if (channel_count == 2)
+    {
+      const __m128 g4 = _mm_set1_ps(gain);
+      for (; f + 4 <= frames; f += 4)
+      {
+        __m128 lo = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * f)));
+        __m128 hi = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * f + 4)));
+        _mm_storeu_ps(dst + f, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), g4));
+        _mm_storeu_ps(dst + stride + f, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)), g4));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    if (channel_count == 2)
+    {
+      const float32x4_t g4 = vdupq_n_f32(gain);
+      for (; f + 4 <= frames; f += 4)
+      {
+        int32x4x2_t s = vld2q_s32(src + 2 * f);
+        vst1q_f32(dst + f, vmulq_f32(vcvtq_f32_s32(s.val[0]), g4));
+        vst1q_f32(dst + stride + f, vmulq_f32(vcvtq_f32_s32(s.val[1]), g4));
+      }
+    }
+#endif
+    deinterleave_to_f32_scalar(src + f * channel_count, channel_count, dst + f, stride, frames - f, gain);
+  }
+
+  inline void deinterleave_f32(const float* src, int channel_count, float* dst, int stride, int frames, float gain)
+  {
+    if (channel_count == 1)
+    {
+      std::transform(src, src + frames, dst, [gain](float v) { return v * gain; });
+      return;
+    }
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    if (channel_count == 2)
+    {
+      const __m128 g4 = _mm_set1_ps(gain);
+      for (; f + 4 <= frames; f += 4)
+      {
+        __m128 lo = _mm_loadu_ps(src + 2 * f);
+        __m128 hi = _mm_loadu_ps(src + 2 * f + 4);
+        _mm_storeu_ps(dst + f, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), g4));
+        _mm_storeu_ps(dst + stride + f, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)), g4));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    if (channel_count == 2)
+    {
+      const float32x4_t g4 = vdupq_n_f32(gain);
+      for (; f + 4 <= frames; f += 4)
+      {
+        float32x4x2_t s = vld2q_f32(src + 2 * f);
+        vst1q_f32(dst + f, vmulq_f32(s.val[0], g4));
+        vst1q_f32(dst + stride + f, vmulq_f32(s.val[1], g4));
+      }
+    }
+#endif
+    deinterleave_to_f32_scalar(src + f * channel_count, channel_count, dst + f, stride, frames - f, gain);
+  }
+
+  // G.711 mu-law to the int16 range, times gain. Computed rather than looked up so that the
+  //   SIMD paths below can do the same: the segment shift becomes a multiplication by a
+  //   float whose exponent is the segment.
+  inline float decode_mulaw(uint8_t code, float gain)
+  {
+    const int u = ~code & 0xFF;
+    const int magnitude = ((((u & 0x0F) << 3) + 0x84) << ((u >> 4) & 7)) - 0x84;
+    return static_cast<float>((u & 0x80) ? -magnitude : magnitude) * gain;
+  }
+
+  inline void convert_mulaw_to_f32_scalar(const uint8_t* src, float* dst, int count, float gain)
+  {
+    for (int i = 0; i < count; ++i)
+      dst[i] = decode_mulaw(src[i], gain);
+  }
+
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+  // Four inverted mu-law codes, zero-extended to 32 bits.
+  inline __m128 decode_mulaw_sse2(__m128i u, __m128 gain4)
+  {
+    const __m128i mantissa = _mm_and_si128(u, _mm_set1_epi32(0x0F));
+    const __m128i segment = _mm_and_si128(_mm_srli_epi32(u, 4), _mm_set1_epi32(7));
+    const __m128i sign = _mm_slli_epi32(_mm_and_si128(u, _mm_set1_epi32(0x80)), 24);
+    const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(segment, _mm_set1_epi32(127)), 23));
+    const __m128 base = _mm_cvtepi32_ps(_mm_add_epi32(_mm_slli_epi32(mantissa, 3), _mm_set1_epi32(0x84)));
+    const __m128 magnitude = _mm_sub_ps(_mm_mul_ps(base, scale), _mm_set1_ps(0x84));
+    return _mm_mul_ps(_mm_xor_ps(magnitude, _mm_castsi128_ps(sign)), gain4);
+  }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+  inline float32x4_t decode_mulaw_neon(uint32x4_t u, float32x4_t gain4)
+  {
+    const uint32x4_t mantissa = vandq_u32(u, vdupq_n_u32(0x0F));
+    const uint32x4_t segment = vandq_u32(vshrq_n_u32(u, 4), vdupq_n_u32(7));
+    const uint32x4_t sign = vshlq_n_u32(vandq_u32(u, vdupq_n_u32(0x80)), 24);
+    const float32x4_t scale = vreinterpretq_f32_u32(vshlq_n_u32(vaddq_u32(segment, vdupq_n_u32(127)), 23));
+    const float32x4_t base = vcvtq_f32_u32(vaddq_u32(vshlq_n_u32(mantissa, 3), vdupq_n_u32(0x84)));
+    const float32x4_t magnitude = vsubq_f32(vmulq_f32(base, scale), vdupq_n_f32(0x84));
+    return vmulq_f32(vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(magnitude), sign)), gain4);
+  }
+#endif
+
+  // dst[i] = decode_mulaw(src[i], gain). Use gain = 1/32768 for normalized output.
+  inline void convert_mulaw_to_f32(const uint8_t* src, float* dst, int count, float gain)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+      __m128i u = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), _mm_set1_epi8(-1));
+      __m128i lo = _mm_unpacklo_epi8(u, zero);
+      __m128i hi = _mm_unpackhi_epi8(u, zero);
+      _mm_storeu_ps(dst + i, decode_mulaw_sse2(_mm_unpacklo_epi16(lo, zero), g4));
+      _mm_storeu_ps(dst + i + 4, decode_mulaw_sse2(_mm_unpackhi_epi16(lo, zero), g4));
+      _mm_storeu_ps(dst + i + 8, decode_mulaw_sse2(_mm_unpacklo_epi16(hi, zero), g4));
+      _mm_storeu_ps(dst + i + 12, decode_mulaw_sse2(_mm_unpackhi_epi16(hi, zero), g4));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    const float32x4_t g4 = vdupq_n_f32(gain);
+    for (; i + 16 <= count; i += 16)
+    {
+      uint8x16_t u = vmvnq_u8(vld1q_u8(src + i));
+      uint16x8_t lo = vmovl_u8(vget_low_u8(u));
+      uint16x8_t hi = vmovl_u8(vget_high_u8(u));
+      vst1q_f32(dst + i, decode_mulaw_neon(vmovl_u16(vget_low_u16(lo)), g4));
+      vst1q_f32(dst + i + 4, decode_mulaw_neon(vmovl_u16(vget_high_u16(lo)), g4));
+      vst1q_f32(dst + i + 8, decode_mulaw_neon(vmovl_u16(vget_low_u16(hi)), g4));
+      vst1q_f32(dst + i + 12, decode_mulaw_neon(vmovl_u16(vget_high_u16(hi)), g4));
+    }
+#endif
+    convert_mulaw_to_f32_scalar(src + i, dst + i, count - i, gain);
+  }
+
+  // Interleaved mu-law codes to planar floats. Decodes a chunk at a time and splits the
+  //   channels with deinterleave_f32().
+  inline void deinterleave_mulaw_to_f32(const uint8_t* src, int channel_count, float* dst, int stride, int frames,
+                                        float gain)
+  {
+    if (channel_count == 1)
+    {
+      convert_mulaw_to_f32(src, dst, frames, gain);
+      return;
+    }
+    constexpr int c_chunk_samples = 256;
+    float chunk[c_chunk_samples];
+    const int chunk_frames = c_chunk_samples / channel_count;
+    for (int f = 0; f < frames; f += chunk_frames)
+    {
+      const int n = std::min(chunk_frames, frames - f);
+      convert_mulaw_to_f32(src + f * channel_count, chunk, n * channel_count, gain);
+      deinterleave_f32(chunk, channel_count, dst + f, stride, n, 1.f);
+    }
+  }
+
+  // Duplicates a mono block onto every channel of an interleaved bus and accumulates:
+  //   bus[f * C + c] += src[f] * gain.
+  inline void mix_mono_to_interleaved_scalar(const float* src, float* bus, int frames, int channel_count, float gain)
+  {
+    for (int f = 0; f < frames; ++f)
+    {
+      float s = src[f] * gain;
+      float* out = bus + f * channel_count;
+      for (int c = 0; c < channel_count; ++c)
+        out[c] += s;
+    }
+  }
+
+  inline void mix_mono_to_stereo(const float* src, float* bus, int frames, float gain)
+  {
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; f + 4 <= frames; f += 4)
+    {
+      __m128 s = _mm_mul_ps(_mm_loadu_ps(src + f), g4);
+      __m128 lo = _mm_unpacklo_ps(s, s); // s0 s0 s1 s1
+      __m128 hi = _mm_unpackhi_ps(s, s); // s2 s2 s3 s3
+      float* out = bus + 2 * f;
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), lo));
+      _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), hi));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; f + 4 <= frames; f += 4)
+    {
+      float32x4_t s = vmulq_n_f32(vld1q_f32(src + f), gain);
+      float32x4x2_t out = vld2q_f32(bus + 2 * f);
+      out.val[0] = vaddq_f32(out.val[0], s);
+      out.val[1] = vaddq_f32(out.val[1], s);
+      vst2q_f32(bus + 2 * f, out);
+    }
+#endif
+    mix_mono_to_interleaved_scalar(src + f, bus + 2 * f, frames - f, 2, gain);
+  }
+
+  // 5.1 and 7.1: one broadcast per frame, stored as 4 + 2 or 4 + 4 lanes.
+  template<int C>
+  inline void mix_mono_to_surround(const float* src, float* bus, int frames, float gain)
+  {
+    static_assert(C == 6 || C == 8);
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    for (; f < frames; ++f)
+    {
+      __m128 s = _mm_set1_ps(src[f] * gain);
+      float* out = bus + f * C;
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), s));
+      if constexpr (C == 8)
+        _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), s));
+      else
+      {
+        out[4] += src[f] * gain;
+        out[5] += src[f] * gain;
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; f < frames; ++f)
+    {
+      float32x4_t s = vdupq_n_f32(src[f] * gain);
+      float* out = bus + f * C;
+      vst1q_f32(out, vaddq_f32(vld1q_f32(out), s));
+      if constexpr (C == 8)
+        vst1q_f32(out + 4, vaddq_f32(vld1q_f32(out + 4), s));
+      else
+      {
+        out[4] += src[f] * gain;
+        out[5] += src[f] * gain;
+      }
+    }
+#endif
+    mix_mono_to_interleaved_scalar(src + f, bus + f * C, frames - f, C, gain);
+  }
+
+  inline void mix_mono_to_interleaved(const float* src, float* bus, int frames, int channel_count, float gain)
+  {
+    switch (channel_count)
+    {
+      case 2: mix_mono_to_stereo(src, bus, frames, gain); break;
+      case 6: mix_mono_to_surround<6>(src, bus, frames, gain); break;
+      case 8: mix_mono_to_surround<8>(src, bus, frames, gain); break;
+      default: mix_mono_to_interleaved_scalar(src, bus, frames, channel_count, gain); break;
+    }
+  }
+
+  // dst[i] *= gain.
+  inline void apply_gain(float* dst, int count, float gain)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 g8 = _mm256_set1_ps(gain);
+    for (; i + 8 <= count; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), g8));
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i), g4));
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32(dst + i, vmulq_n_f32(vld1q_f32(dst + i), gain));
+#endif
+    for (; i < count; ++i)
+      dst[i] *= gain;
+  }
+
+  // dst[f * C + c] *= g0 + (g1 - g0) * f / frames for C = channel_count interleaved channels,
+  //   i.e. a linear ramp that reaches g1 one frame after the end, where the next block
+  //   continues from. Every channel of a frame gets the same gain. Mono and stereo are
+  //   vectorised, where sample i belongs to frame i >> (channel_count - 1).
+  inline void apply_gain_ramp(float* dst, int frames, int channel_count, float g0, float g1)
+  {
+    if (frames <= 0)
+      return;
+    const float step = (g1 - g0) / frames;
+    const int count = frames * channel_count;
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    if (channel_count == 1 || channel_count == 2)
+    {
+      const int shift = channel_count - 1;
+      const __m256 lanes8 = shift == 0 ? _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f)
+                                       : _mm256_setr_ps(0.f, 0.f, 1.f, 1.f, 2.f, 2.f, 3.f, 3.f);
+      const __m256 g08 = _mm256_set1_ps(g0);
+      const __m256 step8 = _mm256_set1_ps(step);
+      for (; i + 8 <= count; i += 8)
+      {
+        // Gains are computed from the index rather than accumulated, so they do not drift.
+        __m256 g = _mm256_add_ps(g08, _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i >> shift)), lanes8), step8));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(dst + i), g));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    if (channel_count == 1 || channel_count == 2)
+    {
+      const int shift = channel_count - 1;
+      const __m128 lanes4 = shift == 0 ? _mm_setr_ps(0.f, 1.f, 2.f, 3.f) : _mm_setr_ps(0.f, 0.f, 1.f, 1.f);
+      const __m128 g04 = _mm_set1_ps(g0);
+      const __m128 step4 = _mm_set1_ps(step);
+      for (; i + 4 <= count; i += 4)
+      {
+        __m128 g = _mm_add_ps(g04, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i >> shift)), lanes4), step4));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i), g));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    if (channel_count == 1 || channel_count == 2)
+    {
+      const int shift = channel_count - 1;
+      const float lanes[2][4] { { 0.f, 1.f, 2.f, 3.f }, { 0.f, 0.f, 1.f, 1.f } };
+      const float32x4_t lanes4 = vld1q_f32(lanes[shift]);
+      for (; i + 4 <= count; i += 4)
+      {
+        float32x4_t g = vmlaq_n_f32(vdupq_n_f32(g0), vaddq_f32(vdupq_n_f32(static_cast<float>(i >> shift)), lanes4), step);
+        vst1q_f32(dst + i, vmulq_f32(vld1q_f32(dst + i), g));
+      }
+    }
+#endif
+    // The vector loops stop on a frame boundary. A pointer rather than dst[f * C + c], which
+    //   GCC flags under -Waggressive-loop-optimizations.
+    float* out = dst + i;
+    for (int f = i / channel_count; f < frames; ++f)
+    {
+      const float g = g0 + step * f;
+      for (int c = 0; c < channel_count; ++c)
+        *out++ *= g;
+    }
+  }
+
+  // dst[i] += src[i] * gain.
+  inline void mix_gain(const float* src, float* dst, int count, float gain)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 g8 = _mm256_set1_ps(gain);
+    for (; i + 8 <= count; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), g8)));
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+      _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g4)));
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+#endif
+    for (; i < count; ++i)
+      dst[i] += src[i] * gain;
+  }
+
+  // dst[f * C + c] += src[f * C + c] * (g0 + (g1 - g0) * f / frames), the ramp of
+  //   apply_gain_ramp().
+  inline void mix_gain_ramp(const float* src, float* dst, int frames, int channel_count, float g0, float g1)
+  {
+    if (frames <= 0)
+      return;
+    const float step = (g1 - g0) / frames;
+    const int count = frames * channel_count;
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    if (channel_count == 1 || channel_count == 2)
+    {
+      const int shift = channel_count - 1;
+      const __m256 lanes8 = shift == 0 ? _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f)
+                                       : _mm256_setr_ps(0.f, 0.f, 1.f, 1.f, 2.f, 2.f, 3.f, 3.f);
+      const __m256 g08 = _mm256_set1_ps(g0);
+      const __m256 step8 = _mm256_set1_ps(step);
+      for (; i + 8 <= count; i += 8)
+      {
+        __m256 g = _mm256_add_ps(g08, _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i >> shift)), lanes8), step8));
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), g)));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    if (channel_count == 1 || channel_count == 2)
+    {
+      const int shift = channel_count - 1;
+      const __m128 lanes4 = shift == 0 ? _mm_setr_ps(0.f, 1.f, 2.f, 3.f) : _mm_setr_ps(0.f, 0.f, 1.f, 1.f);
+      const __m128 g04 = _mm_set1_ps(g0);
+      const __m128 step4 = _mm_set1_ps(step);
+      for (; i + 4 <= count; i += 4)
+      {
+        __m128 g = _mm_add_ps(g04, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(i >> shift)), lanes4), step4));
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+      }
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    if (channel_count == 1 || channel_count == 2)
+    {
+      const int shift = channel_count - 1;
+      const float lanes[2][4] { { 0.f, 1.f, 2.f, 3.f }, { 0.f, 0.f, 1.f, 1.f } };
+      const float32x4_t lanes4 = vld1q_f32(lanes[shift]);
+      for (; i + 4 <= count; i += 4)
+      {
+        float32x4_t g = vmlaq_n_f32(vdupq_n_f32(g0), vaddq_f32(vdupq_n_f32(static_cast<float>(i >> shift)), lanes4), step);
+        vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), g));
+      }
+    }
+#endif
+    const float* in = src + i;
+    float* out = dst + i;
+    for (int f = i / channel_count; f < frames; ++f)
+    {
+      const float g = g0 + step * f;
+      for (int c = 0; c < channel_count; ++c)
+        *out++ += *in++ * g;
+    }
+  }
+
+  // Accumulates a mono block onto an interleaved bus with a separate linear gain ramp per channel:
+  //   bus[f * C + c] += src[f] * (gain0[c] + (gain1[c] - gain0[c]) * f / frames).
+  inline void mix_mono_to_interleaved_ramp_scalar(const float* src, float* bus, int frames, int channel_count,
+                                                  const float* gain0, const float* gain1, int frame_offset = 0, int total_frames = 0)
+  {
+    const float inv_total = 1.f / (total_frames > 0 ? total_frames : frames);
+    for (int f = 0; f < frames; ++f)
+    {
+      float t = (frame_offset + f) * inv_total;
+      float* out = bus + f * channel_count;
+      for (int c = 0; c < channel_count; ++c)
+        out[c] += src[f] * (gain0[c] + (gain1[c] - gain0[c]) * t);
+    }
+  }
+
+  inline void mix_mono_to_stereo_ramp(const float* src, float* bus, int frames, const float* gain0, const float* gain1)
+  {
+    if (frames <= 0)
+      return;
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const float step_l = (gain1[0] - gain0[0]) / frames;
+    const float step_r = (gain1[1] - gain0[1]) / frames;
+    // Lanes hold L R L R of two consecutive frames.
+    const __m128 base4 = _mm_setr_ps(gain0[0], gain0[1], gain0[0] + step_l, gain0[1] + step_r);
+    const __m128 step4 = _mm_setr_ps(step_l, step_r, step_l, step_r);
+    for (; f + 4 <= frames; f += 4)
+    {
+      __m128 s = _mm_loadu_ps(src + f);
+      __m128 lo = _mm_unpacklo_ps(s, s); // s0 s0 s1 s1
+      __m128 hi = _mm_unpackhi_ps(s, s); // s2 s2 s3 s3
+      __m128 g_lo = _mm_add_ps(base4, _mm_mul_ps(_mm_set1_ps(static_cast<float>(f)), step4));
+      __m128 g_hi = _mm_add_ps(base4, _mm_mul_ps(_mm_set1_ps(static_cast<float>(f + 2)), step4));
+      float* out = bus + 2 * f;
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(lo, g_lo)));
+      _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(hi, g_hi)));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    const float step_l = (gain1[0] - gain0[0]) / frames;
+    const float step_r = (gain1[1] - gain0[1]) / frames;
+    const float lanes[4] { 0.f, 1.f, 2.f, 3.f };
+    const float32x4_t lanes4 = vld1q_f32(lanes);
+    for (; f + 4 <= frames; f += 4)
+    {
+      float32x4_t idx = vaddq_f32(vdupq_n_f32(static_cast<float>(f)), lanes4);
+      float32x4_t s = vld1q_f32(src + f);
+      float32x4x2_t out = vld2q_f32(bus + 2 * f);
+      out.val[0] = vmlaq_f32(out.val[0], s, vmlaq_n_f32(vdupq_n_f32(gain0[0]), idx, step_l));
+      out.val[1] = vmlaq_f32(out.val[1], s, vmlaq_n_f32(vdupq_n_f32(gain0[1]), idx, step_r));
+      vst2q_f32(bus + 2 * f, out);
+    }
+#endif
+    mix_mono_to_interleaved_ramp_scalar(src + f, bus + 2 * f, frames - f, 2, gain0, gain1, f, frames);
+  }
+
+  inline void mix_mono_to_interleaved_ramp(const float* src, float* bus, int frames, int channel_count,
+                                           const float* gain0, const float* gain1)
+  {
+    if (channel_count == 2)
+      mix_mono_to_stereo_ramp(src, bus, frames, gain0, gain1);
+    else
+      mix_mono_to_interleaved_ramp_scalar(src, bus, frames, channel_count, gain0, gain1);
+  }
+
+  // Accumulates planar left and right blocks onto an interleaved stereo bus with a linear
+  //   gain ramp per side: bus[2f + c] += src_c[f] * (gain0[c] + (gain1[c] - gain0[c]) * f / frames).
+  inline void mix_stereo_to_stereo_ramp(const float* left, const float* right, float* bus, int frames,
+                                        const float* gain0, const float* gain1)
+  {
+    if (frames <= 0)
+      return;
+    const float step_l = (gain1[0] - gain0[0]) / frames;
+    const float step_r = (gain1[1] - gain0[1]) / frames;
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 lanes4 = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    for (; f + 4 <= frames; f += 4)
+    {
+      __m128 idx = _mm_add_ps(_mm_set1_ps(static_cast<float>(f)), lanes4);
+      __m128 l = _mm_mul_ps(_mm_loadu_ps(left + f), _mm_add_ps(_mm_set1_ps(gain0[0]), _mm_mul_ps(idx, _mm_set1_ps(step_l))));
+      __m128 r = _mm_mul_ps(_mm_loadu_ps(right + f), _mm_add_ps(_mm_set1_ps(gain0[1]), _mm_mul_ps(idx, _mm_set1_ps(step_r))));
+      float* out = bus + 2 * f;
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_unpacklo_ps(l, r)));
+      _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_unpackhi_ps(l, r)));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    const float lanes[4] { 0.f, 1.f, 2.f, 3.f };
+    const float32x4_t lanes4 = vld1q_f32(lanes);
+    for (; f + 4 <= frames; f += 4)
+    {
+      float32x4_t idx = vaddq_f32(vdupq_n_f32(static_cast<float>(f)), lanes4);
+      float32x4x2_t out = vld2q_f32(bus + 2 * f);
+      out.val[0] = vmlaq_f32(out.val[0], vld1q_f32(left + f), vmlaq_n_f32(vdupq_n_f32(gain0[0]), idx, step_l));
+      out.val[1] = vmlaq_f32(out.val[1], vld1q_f32(right + f), vmlaq_n_f32(vdupq_n_f32(gain0[1]), idx, step_r));
+      vst2q_f32(bus + 2 * f, out);
+    }
+#endif
+    // A pointer rather than bus[2 * f], which GCC flags under -Waggressive-loop-optimizations.
+    for (float* out = bus + 2 * f; f < frames; ++f, out += 2)
+    {
+      out[0] += left[f] * (gain0[0] + step_l * f);
+      out[1] += right[f] * (gain0[1] + step_r * f);
+    }
+  }
+
+  // The reverse of deinterleave_f32() without a gain: channel c at src + c * stride.
+  inline void interleave_f32(const float* src, int stride, int channel_count, float* dst, int frames)
+  {
+    int f = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    if (channel_count == 2)
+      for (; f + 4 <= frames; f += 4)
+      {
+        __m128 l = _mm_loadu_ps(src + f);
+        __m128 r = _mm_loadu_ps(src + stride + f);
+        _mm_storeu_ps(dst + 2 * f, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dst + 2 * f + 4, _mm_unpackhi_ps(l, r));
+      }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    if (channel_count == 2)
+      for (; f + 4 <= frames; f += 4)
+        vst2q_f32(dst + 2 * f, float32x4x2_t { vld1q_f32(src + f), vld1q_f32(src + stride + f) });
+#endif
+    for (; f < frames; ++f)
+      for (int c = 0; c < channel_count; ++c)
+        dst[f * channel_count + c] = src[c * stride + f];
+  }
+
+  // acc += a * b on split complex arrays: real parts in *_re, imaginary parts in *_im.
+  //   The inner loop of partitioned convolution.
+  inline void complex_multiply_add(const float* a_re, const float* a_im, const float* b_re, const float* b_im,
+                                   float* acc_re, float* acc_im, int count)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256 ar = _mm256_loadu_ps(a_re + i);
+      __m256 ai = _mm256_loadu_ps(a_im + i);
+      __m256 br = _mm256_loadu_ps(b_re + i);
+      __m256 bi = _mm256_loadu_ps(b_im + i);
+      __m256 re = _mm256_add_ps(_mm256_loadu_ps(acc_re + i), _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi)));
+      __m256 im = _mm256_add_ps(_mm256_loadu_ps(acc_im + i), _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br)));
+      _mm256_storeu_ps(acc_re + i, re);
+      _mm256_storeu_ps(acc_im + i, im);
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 ar = _mm_loadu_ps(a_re + i);
+      __m128 ai = _mm_loadu_ps(a_im + i);
+      __m128 br = _mm_loadu_ps(b_re + i);
+      __m128 bi = _mm_loadu_ps(b_im + i);
+      __m128 re = _mm_add_ps(_mm_loadu_ps(acc_re + i), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi)));
+      __m128 im = _mm_add_ps(_mm_loadu_ps(acc_im + i), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br)));
+      _mm_storeu_ps(acc_re + i, re);
+      _mm_storeu_ps(acc_im + i, im);
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+      float32x4_t ar = vld1q_f32(a_re + i);
+      float32x4_t ai = vld1q_f32(a_im + i);
+      float32x4_t br = vld1q_f32(b_re + i);
+      float32x4_t bi = vld1q_f32(b_im + i);
+      float32x4_t re = vmlsq_f32(vmlaq_f32(vld1q_f32(acc_re + i), ar, br), ai, bi);
+      float32x4_t im = vmlaq_f32(vmlaq_f32(vld1q_f32(acc_im + i), ar, bi), ai, br);
+      vst1q_f32(acc_re + i, re);
+      vst1q_f32(acc_im + i, im);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+      acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i];
+      acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i];
+    }
+  }
+
+  // Clamps to [-1, 1] and scales to the int16 range.
+  inline void convert_f32_to_s16(const float* src, int16_t* dst, int count)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 scale8 = _mm256_set1_ps(32767.f);
+    const __m256 lo8 = _mm256_set1_ps(-1.f);
+    const __m256 hi8 = _mm256_set1_ps(1.f);
+    for (; i + 16 <= count; i += 16)
+    {
+      __m256 fa = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo8), hi8);
+      __m256 fb = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), lo8), hi8);
+      __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(fa, scale8));
+      __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(fb, scale8));
+      __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), p);
+    }
+#endif
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 scale4 = _mm_set1_ps(32767.f);
+    const __m128 lo4 = _mm_set1_ps(-1.f);
+    const __m128 hi4 = _mm_set1_ps(1.f);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128 fa = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo4), hi4);
+      __m128 fb = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo4), hi4);
+      __m128i a = _mm_cvtps_epi32(_mm_mul_ps(fa, scale4));
+      __m128i b = _mm_cvtps_epi32(_mm_mul_ps(fb, scale4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+      float32x4_t fa = vminq_f32(vmaxq_f32(vld1q_f32(src + i), vdupq_n_f32(-1.f)), vdupq_n_f32(1.f));
+      float32x4_t fb = vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), vdupq_n_f32(-1.f)), vdupq_n_f32(1.f));
+      int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(fa, 32767.f));
+      int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(fb, 32767.f));
+      vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for (; i < count; ++i)
+      dst[i] = static_cast<int16_t>(std::lrint(std::clamp(src[i], -1.f, 1.f) * 32767.f));
+  }
+
+  // Clamps to [-1, 1] and scales to the int32 range.
+  //   2147483520 is the largest float below 2^31, so +1 does not wrap.
+  inline void convert_f32_to_s32(const float* src, int32_t* dst, int count)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 scale8 = _mm256_set1_ps(2147483520.f);
+    const __m256 lo8 = _mm256_set1_ps(-1.f);
+    const __m256 hi8 = _mm256_set1_ps(1.f);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256 f = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo8), hi8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtps_epi32(_mm256_mul_ps(f, scale8)));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 scale4 = _mm_set1_ps(2147483520.f);
+    const __m128 lo4 = _mm_set1_ps(-1.f);
+    const __m128 hi4 = _mm_set1_ps(1.f);
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo4), hi4);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_cvtps_epi32(_mm_mul_ps(f, scale4)));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+      float32x4_t f = vminq_f32(vmaxq_f32(vld1q_f32(src + i), vdupq_n_f32(-1.f)), vdupq_n_f32(1.f));
+      vst1q_s32(dst + i, vcvtnq_s32_f32(vmulq_n_f32(f, 2147483520.f)));
+    }
+#endif
+    for (; i < count; ++i)
+      dst[i] = static_cast<int32_t>(std::lrint(std::clamp(src[i], -1.f, 1.f) * 2147483520.f));
+  }
+
+  // Clamps to [-1, 1].
+  inline void convert_f32_to_f32(const float* src, float* dst, int count)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    const __m256 lo8 = _mm256_set1_ps(-1.f);
+    const __m256 hi8 = _mm256_set1_ps(1.f);
+    for (; i + 8 <= count; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo8), hi8));
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 lo4 = _mm_set1_ps(-1.f);
+    const __m128 hi4 = _mm_set1_ps(1.f);
+    for (; i + 4 <= count; i += 4)
+      _mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo4), hi4));
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32(dst + i, vminq_f32(vmaxq_f32(vld1q_f32(src + i), vdupq_n_f32(-1.f)), vdupq_n_f32(1.f)));
+#endif
+    for (; i < count; ++i)
+      dst[i] = std::clamp(src[i], -1.f, 1.f);
+  }
+
+  // Clamps to [-1, 1] and widens to double.
+  inline void convert_f32_to_f64(const float* src, double* dst, int count)
+  {
+    int i = 0;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    const __m128 lo4 = _mm_set1_ps(-1.f);
+    const __m128 hi4 = _mm_set1_ps(1.f);
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo4), hi4);
+      _mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+      _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+    }
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+      float32x4_t f = vminq_f32(vmaxq_f32(vld1q_f32(src + i), vdupq_n_f32(-1.f)), vdupq_n_f32(1.f));
+      vst1q_f64(dst + i, vcvt_f64_f32(vget_low_f32(f)));
+      vst1q_f64(dst + i + 2, vcvt_high_f64_f32(f));
+    }
+#endif
+    for (; i < count; ++i)
+      dst[i] = std::clamp(src[i], -1.f, 1.f);
+  }
+
+  // sum_j a[j] * (b0[j] + t * (b1[j] - b0[j])), i.e. a dot product against coefficients
+  //   linearly interpolated between two adjacent filter phases. count must be a multiple of 4.
+  inline float dot_lerp(const float* a, const float* b0, const float* b1, float t, int count)
+  {
+    int i = 0;
+    float sum = 0.f;
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    __m256 acc8 = _mm256_setzero_ps();
+    const __m256 t8 = _mm256_set1_ps(t);
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256 c0 = _mm256_loadu_ps(b0 + i);
+      __m256 c = _mm256_add_ps(c0, _mm256_mul_ps(t8, _mm256_sub_ps(_mm256_loadu_ps(b1 + i), c0)));
+      acc8 = _mm256_add_ps(acc8, _mm256_mul_ps(_mm256_loadu_ps(a + i), c));
+    }
+    __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc8), _mm256_extractf128_ps(acc8, 1));
+    const __m128 t4 = _mm_set1_ps(t);
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    __m128 acc4 = _mm_setzero_ps();
+    const __m128 t4 = _mm_set1_ps(t);
+#endif
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 c0 = _mm_loadu_ps(b0 + i);
+      __m128 c = _mm_add_ps(c0, _mm_mul_ps(t4, _mm_sub_ps(_mm_loadu_ps(b1 + i), c0)));
+      acc4 = _mm_add_ps(acc4, _mm_mul_ps(_mm_loadu_ps(a + i), c));
+    }
+    acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+    acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 1));
+    sum = _mm_cvtss_f32(acc4);
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    float32x4_t acc4 = vdupq_n_f32(0.f);
+    for (; i + 4 <= count; i += 4)
+    {
+      float32x4_t c0 = vld1q_f32(b0 + i);
+      float32x4_t c = vmlaq_n_f32(c0, vsubq_f32(vld1q_f32(b1 + i), c0), t);
+      acc4 = vmlaq_f32(acc4, vld1q_f32(a + i), c);
+    }
+    sum = vaddvq_f32(acc4);
+#endif
+    for (; i < count; ++i)
+      sum += a[i] * (b0[i] + t * (b1[i] - b0[i]));
+    return sum;
+  }
+
+}
@@ -0,0 +1,132 @@
+//
+//  SlotMap.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <optional>
+#include <cstdint>
+#include <stdexcept>
+
+
+namespace audio
+{
+
+  // Generational slot map with O(1) insert, erase and lookup.
+  // A handle packs a slot index (low c_index_bits) and the slot's generation (high bits).
+  //   Erasing bumps the generation, so handles to erased elements are detected as stale
+  //   instead of silently referring to whatever reuses the slot.
+  // Freed slots are reused in FIFO order to spread generation wrap-around over all slots.
+  // Handles stay valid until their element is erased. Pointers from get() do not: the slot
+  //   storage reallocates as it grows, so any insert may invalidate them. Hold on to handles,
+  //   or store pointers (e.g. std::unique_ptr<T>) as T when an address must stay stable.
+  template<typename T>
+  class SlotMap
+  {
+  public:
+    using Handle = uint32_t;
+    static constexpr int c_index_bits = 20;
+    static constexpr uint32_t c_index_mask = (1u << c_index_bits) - 1;
+    static constexpr uint32_t c_generation_mask = (1u << (32 - c_index_bits)) - 1;
+    static constexpr Handle c_invalid_handle = ~Handle(0);
+
+  private:
+    struct Slot
+    {
+      std::optional<T> value;
+      uint32_t generation = 0;
+    };
+
+    std::vector<Slot> m_slots;
+    std::deque<uint32_t> m_free;
+    size_t m_size = 0;
+
+    static Handle make_handle(uint32_t index, uint32_t generation)
+    {
+      return (generation << c_index_bits) | index;
+    }
+
+    const Slot* find(Handle handle) const
+    {
+      uint32_t index = handle & c_index_mask;
+      if (index >= m_slots.size())
+        return nullptr;
+      const auto& slot = m_slots[index];
+      if (!slot.value.has_value() || slot.generation != (handle >> c_index_bits))
+        return nullptr;
+      return &slot;
+    }
+
+  public:
+    Handle insert(T value)
+    {
+      uint32_t index = 0;
+      if (!m_free.empty())
+      {
+        index = m_free.front();
+        m_free.pop_front();
+      }
+      else
+      {
+        // The last index is never used, which keeps c_invalid_handle out of range.
+        if (m_slots.size() >= c_index_mask)
+          throw std::runtime_error("SlotMap is full.");
+        index = static_cast<uint32_t>(m_slots.size());
+        m_slots.emplace_back();
+      }
+      auto& slot = m_slots[index];
+      slot.value.emplace(std::move(value));
+      ++m_size;
+      return make_handle(index, slot.generation);
+    }
+
+    bool erase(Handle handle)
+    {
+      if (find(handle) == nullptr)
+        return false;
+      uint32_t index = handle & c_index_mask;
+      auto& slot = m_slots[index];
+      slot.value.reset();
+      slot.generation = (slot.generation + 1) & c_generation_mask;
+      m_free.emplace_back(index);
+      --m_size;
+      return true;
+    }
+
+    T* get(Handle handle)
+    {
+      auto* slot = find(handle);
+      return slot != nullptr ? const_cast<T*>(&*slot->value) : nullptr;
+    }
+
+    const T* get(Handle handle) const
+    {
+      auto* slot = find(handle);
+      return slot != nullptr ? &*slot->value : nullptr;
+    }
+
+    bool contains(Handle handle) const { return find(handle) != nullptr; }
+
+    size_t size() const { return m_size; }
+
+    // Calls func(handle, value) for every live element.
+    template<typename Func>
+    void for_each(Func func)
+    {
+      for (uint32_t index = 0; index < m_slots.size(); ++index)
+        if (auto& slot = m_slots[index]; slot.value.has_value())
+          func(make_handle(index, slot.generation), *slot.value);
+    }
+
+    template<typename Func>
+    void for_each(Func func) const
+    {
+      for (uint32_t index = 0; index < m_slots.size(); ++index)
+        if (const auto& slot = m_slots[index]; slot.value.has_value())
+          func(make_handle(index, slot.generation), *slot.value);
+    }
+  };
+
+}
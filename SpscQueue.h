@@ -0,0 +1,72 @@
+//
+//  SpscQueue.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+
+namespace audio
+{
+
+  // Wait-free bounded single-producer/single-consumer ring buffer.
+  // Storage is allocated once in the constructor so that try_push() and try_pop()
+  //   never allocate and can be used from the realtime audio thread.
+  template<typename T>
+  class SpscQueue
+  {
+    std::vector<T> m_items;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<size_t> m_head { 0 }; // Next slot to pop. Written by the consumer.
+    alignas(64) std::atomic<size_t> m_tail { 0 }; // Next slot to push. Written by the producer.
+
+  public:
+    // capacity must be a power of two.
+    explicit SpscQueue(size_t capacity)
+      : m_items(capacity)
+      , m_mask(capacity - 1)
+    {
+      if (capacity == 0 || (capacity & m_mask) != 0)
+        throw std::invalid_argument("SpscQueue capacity must be a power of two.");
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. Returns false if the queue is full.
+    bool try_push(const T& item)
+    {
+      const size_t tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+        return false;
+      m_items[tail & m_mask] = item;
+      m_tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool try_pop(T& item)
+    {
+      const size_t head = m_head.load(std::memory_order_relaxed);
+      if (head == m_tail.load(std::memory_order_acquire))
+        return false;
+      item = m_items[head & m_mask];
+      m_head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Only exact when called from either the producer or the consumer thread
+    //   while the other side is idle.
+    size_t size_approx() const
+    {
+      return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return m_items.size(); }
+  };
+
+}
@@ -0,0 +1,479 @@
+//
+//  WavStream.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "SpscQueue.h"
+#include "SampleKernels.h"
+#include "BufferFormat.h"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace audio
+{
+
+  struct WavInfo
+  {
+    int channels = 0;
+    int sample_rate = 0;
+    int bits_per_sample = 0;
+    // WAVE_FORMAT_EXTENSIBLE speaker mask, bit 0 front left in the order of SoundIoChannelId
+    //   starting at SoundIoChannelIdFrontLeft. 0 if the file does not specify one.
+    uint32_t channel_mask = 0;
+    uint64_t data_offset = 0;
+    uint64_t data_bytes = 0;
+  };
+
+  // Parses the RIFF header up to the start of the "data" chunk. Only 16-bit PCM is supported.
+  //   data_bytes never reaches past the end of the file, whatever the chunk size says.
+  inline WavInfo read_wav_header(std::FILE* file)
+  {
+    auto read_u32 = [](const unsigned char* p) { return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24; };
+    auto read_u16 = [](const unsigned char* p) { return uint16_t(p[0] | p[1] << 8); };
+
+    unsigned char riff[12];
+    if (std::fread(riff, 1, sizeof(riff), file) != sizeof(riff)
+        || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0)
+      throw std::runtime_error("Not a RIFF/WAVE file.");
+
+    WavInfo info;
+    bool has_fmt = false;
+    unsigned char header[8];
+    while (std::fread(header, 1, sizeof(header), file) == sizeof(header))
+    {
+      uint32_t size = read_u32(header + 4);
+      if (std::memcmp(header, "fmt ", 4) == 0)
+      {
+        unsigned char fmt[24];
+        const uint32_t fmt_size = std::min<uint32_t>(size, sizeof(fmt));
+        if (size < 16 || std::fread(fmt, 1, fmt_size, file) != fmt_size)
+          throw std::runtime_error("Truncated WAVE fmt chunk.");
+        uint16_t audio_format = read_u16(fmt);
+        info.channels = read_u16(fmt + 2);
+        info.sample_rate = static_cast<int>(read_u32(fmt + 4));
+        info.bits_per_sample = read_u16(fmt + 14);
+        // WAVE_FORMAT_EXTENSIBLE (0xFFFE) carries plain PCM in our supported case too.
+        if ((audio_format != 1 && audio_format != 0xFFFE) || info.bits_per_sample != 16 || info.channels <= 0)
+          throw std::runtime_error("Only 16-bit PCM WAVE files can be streamed.");
+        if (audio_format == 0xFFFE && fmt_size >= 24)
+          info.channel_mask = read_u32(fmt + 20);
+        has_fmt = true;
+        std::fseek(file, static_cast<long>(size - fmt_size + (size & 1)), SEEK_CUR);
+      }
+      else if (std::memcmp(header, "data", 4) == 0)
+      {
+        if (!has_fmt)
+          throw std::runtime_error("WAVE data chunk before fmt chunk.");
+        info.data_offset = static_cast<uint64_t>(std::ftell(file));
+        info.data_bytes = size;
+        // Truncated files and unfinished recordings, whose size is often left at 0xFFFFFFFF,
+        //   end where the file does.
+        if (std::fseek(file, 0, SEEK_END) == 0)
+        {
+          const long end = std::ftell(file);
+          const uint64_t available = end > 0 && static_cast<uint64_t>(end) > info.data_offset ? end - info.data_offset : 0;
+          info.data_bytes = std::min<uint64_t>(size, available);
+          std::fseek(file, static_cast<long>(info.data_offset), SEEK_SET);
+        }
+        return info;
+      }
+      else
+        std::fseek(file, static_cast<long>(size + (size & 1)), SEEK_CUR);
+    }
+    throw std::runtime_error("WAVE file has no data chunk.");
+  }
+
+  // The file's speaker mask, or the customary one for its channel count if it has none.
+  inline uint32_t get_channel_mask(const WavInfo& info)
+  {
+    if (info.channel_mask != 0)
+      return info.channel_mask;
+    switch (info.channels)
+    {
+      case 1: return 0x4;    // C
+      case 2: return 0x3;    // L R
+      case 3: return 0x7;    // L R C
+      case 4: return 0x33;   // L R BL BR
+      case 5: return 0x37;   // L R C BL BR
+      case 6: return 0x3F;   // L R C LFE BL BR
+      case 7: return 0x13F;  // L R C LFE BL BR BC
+      case 8: return 0x63F;  // L R C LFE BL BR SL SR
+      default: return 0;
+    }
+  }
+
+  struct StreamParams
+  {
+    // Frames decoded ahead of playback. Resident memory per stream is bounded by this,
+    //   independent of the track length.
+    size_t prefetch_frames = 32768;
+    // Granularity of the refill thread. prefetch_frames is rounded up to a power-of-two
+    //   number of chunks.
+    int chunk_frames = 4096;
+  };
+
+  struct StreamStats
+  {
+    // Number of callback blocks that found the ring empty, and the frames replaced by silence.
+    uint64_t num_underruns = 0;
+    uint64_t underrun_frames = 0;
+    size_t resident_bytes = 0;
+  };
+
+  // PCM from a 16-bit WAVE file, delivered through a ring of fixed-size chunks.
+  // The refill thread (producer) reads the file into free chunks and queues them as
+  //   filled. The mixer callback (consumer) reads filled chunks and hands them back.
+  // Chunks hold interleaved frames. read() splits them into one plane per channel.
+  // Restarting playback bumps the epoch. The producer seeks back to the start and tags
+  //   its chunks with the new epoch; the consumer drops chunks of older epochs.
+  class WavStream
+  {
+  public:
+    struct Chunk
+    {
+      // Interleaved, chunk_frames * channels.
+      std::vector<short> samples;
+      int frames = 0;
+      uint32_t epoch = 0;
+      bool end_of_stream = false;
+    };
+
+  private:
+    std::FILE* m_file = nullptr;
+    WavInfo m_info;
+    std::vector<Chunk> m_chunks;
+    SpscQueue<Chunk*> m_free;
+    SpscQueue<Chunk*> m_filled;
+    size_t m_resident_bytes = 0;
+
+    std::atomic<uint32_t> m_requested_epoch { 0 };
+    std::atomic<bool> m_looping { false };
+
+    // Producer state.
+    uint32_t m_producer_epoch = 0;
+    uint64_t m_bytes_left = 0;
+    bool m_producer_done = false;
+
+    // Consumer state.
+    Chunk* m_current = nullptr;
+    int m_read_offset = 0;
+    uint32_t m_consumer_epoch = 0;
+    bool m_consumer_done = false;
+    // Underruns are only counted once the first chunk of an epoch has arrived,
+    //   so the refill delay right after restart() does not show up as one.
+    bool m_consumer_primed = false;
+
+    std::atomic<uint64_t> m_num_underruns { 0 };
+    std::atomic<uint64_t> m_underrun_frames { 0 };
+
+    static size_t round_up_pow2(size_t n)
+    {
+      size_t p = 1;
+      while (p < n)
+        p <<= 1;
+      return p;
+    }
+
+    void rewind()
+    {
+      std::fseek(m_file, static_cast<long>(m_info.data_offset), SEEK_SET);
+      m_bytes_left = m_info.data_bytes;
+    }
+
+    // Reads up to frame_count interleaved frames at the file position.
+    int read_frames(short* dst, int frame_count)
+    {
+      const uint64_t bytes_per_frame = 2ull * m_info.channels;
+      int frames = static_cast<int>(std::min<uint64_t>(frame_count, m_bytes_left / bytes_per_frame));
+      if (frames == 0)
+        return 0;
+      frames = static_cast<int>(std::fread(dst, bytes_per_frame, frames, m_file));
+      m_bytes_left -= frames * bytes_per_frame;
+      return frames;
+    }
+
+  public:
+    WavStream(const std::string& path, const StreamParams& params)
+      : m_free(round_up_pow2((params.prefetch_frames + params.chunk_frames - 1) / params.chunk_frames))
+      , m_filled(m_free.capacity())
+    {
+      m_file = std::fopen(path.c_str(), "rb");
+      if (m_file == nullptr)
+        throw std::runtime_error("Unable to open \"" + path + "\".");
+      try
+      {
+        m_info = read_wav_header(m_file);
+      }
+      catch (...)
+      {
+        std::fclose(m_file);
+        throw;
+      }
+      if (m_info.channels > c_max_buffer_channels)
+      {
+        std::fclose(m_file);
+        throw std::runtime_error("WAVE files with more than " + std::to_string(c_max_buffer_channels)
+                                 + " channels cannot be streamed.");
+      }
+      rewind();
+
+      m_chunks.resize(m_free.capacity());
+      for (auto& chunk : m_chunks)
+      {
+        chunk.samples.resize(static_cast<size_t>(params.chunk_frames) * m_info.channels);
+        m_free.try_push(&chunk);
+      }
+      m_resident_bytes = m_chunks.size() * params.chunk_frames * m_info.channels * sizeof(short);
+    }
+
+    ~WavStream()
+    {
+      if (m_file != nullptr)
+        std::fclose(m_file);
+    }
+
+    WavStream(const WavStream&) = delete;
+    WavStream& operator=(const WavStream&) = delete;
+
+    int get_sample_rate() const { return m_info.sample_rate; }
+
+    int get_channel_count() const { return m_info.channels; }
+
+    uint32_t get_channel_mask() const { return audio::get_channel_mask(m_info); }
+
+    // API thread. Returns the epoch to pass to read().
+    uint32_t restart()
+    {
+      return m_requested_epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    void set_looping(bool looping) { m_looping.store(looping, std::memory_order_relaxed); }
+
+    StreamStats get_stats() const
+    {
+      StreamStats stats;
+      stats.num_underruns = m_num_underruns.load(std::memory_order_relaxed);
+      stats.underrun_frames = m_underrun_frames.load(std::memory_order_relaxed);
+      stats.resident_bytes = m_resident_bytes;
+      return stats;
+    }
+
+    // Refill thread. Fills as many free chunks as are available.
+    void refill()
+    {
+      uint32_t epoch = m_requested_epoch.load(std::memory_order_acquire);
+      if (epoch != m_producer_epoch)
+      {
+        m_producer_epoch = epoch;
+        m_producer_done = false;
+        rewind();
+      }
+      if (m_producer_done || epoch == 0)
+        return;
+
+      Chunk* chunk = nullptr;
+      bool rewound = false;
+      while (!m_producer_done && m_free.try_pop(chunk))
+      {
+        const int capacity = static_cast<int>(chunk->samples.size() / m_info.channels);
+        chunk->frames = 0;
+        chunk->epoch = epoch;
+        chunk->end_of_stream = false;
+        while (chunk->frames < capacity)
+        {
+          int frames = read_frames(chunk->samples.data() + static_cast<size_t>(chunk->frames) * m_info.channels,
+                                   capacity - chunk->frames);
+          chunk->frames += frames;
+          if (frames > 0)
+            rewound = false;
+          else
+          {
+            // Nothing to read right after a rewind means the data is gone, e.g. a read
+            //   error; rewinding again would spin forever.
+            if (m_looping.load(std::memory_order_relaxed) && !rewound && m_info.data_bytes >= 2ull * m_info.channels)
+            {
+              rewind();
+              rewound = true;
+            }
+            else
+            {
+              chunk->end_of_stream = true;
+              m_producer_done = true;
+              break;
+            }
+          }
+        }
+        m_filled.try_push(chunk);
+      }
+    }
+
+    // Mixer callback. Converts frame_count frames of the given epoch into dst, channel c
+    //   starting at dst + c * stride. Missing frames are written as silence; they count as
+    //   an underrun unless the stream has ended. Returns the number of frames past the end
+    //   of the stream.
+    int read(float* dst, int stride, int frame_count, uint32_t epoch)
+    {
+      if (epoch != m_consumer_epoch)
+      {
+        m_consumer_epoch = epoch;
+        m_consumer_done = false;
+        m_consumer_primed = false;
+        if (m_current != nullptr)
+        {
+          m_free.try_push(m_current);
+          m_current = nullptr;
+        }
+      }
+
+      int frames_done = 0;
+      while (frames_done < frame_count && !m_consumer_done)
+      {
+        if (m_current == nullptr)
+        {
+          if (!m_filled.try_pop(m_current))
+            break;
+          m_read_offset = 0;
+          if (m_current->epoch != epoch)
+          {
+            m_free.try_push(m_current);
+            m_current = nullptr;
+            continue;
+          }
+          m_consumer_primed = true;
+        }
+        int run = std::min(frame_count - frames_done, m_current->frames - m_read_offset);
+        kernels::deinterleave_s16_to_f32(m_current->samples.data() + static_cast<size_t>(m_read_offset) * m_info.channels,
+                                         m_info.channels, dst + frames_done, stride, run, 1.f / 32768.f);
+        m_read_offset += run;
+        frames_done += run;
+        if (m_read_offset >= m_current->frames)
+        {
+          m_consumer_done = m_current->end_of_stream;
+          m_free.try_push(m_current);
+          m_current = nullptr;
+        }
+      }
+
+      for (int c = 0; c < m_info.channels; ++c)
+        std::fill(dst + c * stride + frames_done, dst + c * stride + frame_count, 0.f);
+      int missing = frame_count - frames_done;
+      if (missing > 0 && !m_consumer_done)
+      {
+        if (!m_consumer_primed)
+          return 0;
+        m_num_underruns.fetch_add(1, std::memory_order_relaxed);
+        m_underrun_frames.fetch_add(missing, std::memory_order_relaxed);
+        return 0;
+      }
+      return missing;
+    }
+  };
+
+  // Background thread that keeps the rings of all registered streams topped up.
+  //   Without the thread the owner calls refill_now() itself before each mix block, which
+  //   makes streaming deterministic for offline rendering.
+  class WavStreamer
+  {
+    std::vector<std::shared_ptr<WavStream>> m_streams;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_use_thread = true;
+    bool m_quit = false;
+    bool m_wake = false;
+
+    void run()
+    {
+      // Refilled without the lock, so add(), remove() and wake() on the API thread never
+      //   wait for the disk. The copies keep removed streams alive until the pass is over.
+      std::vector<std::shared_ptr<WavStream>> streams;
+      std::unique_lock lock(m_mutex);
+      while (!m_quit)
+      {
+        streams = m_streams;
+        lock.unlock();
+        for (auto& stream : streams)
+          stream->refill();
+        streams.clear();
+        lock.lock();
+        // Wake up regularly even without a request, so chunks freed by the callback get refilled.
+        m_cv.wait_for(lock, std::chrono::milliseconds(5), [this] { return m_quit || m_wake; });
+        m_wake = false;
+      }
+    }
+
+  public:
+    explicit WavStreamer(bool use_thread = true)
+      : m_use_thread(use_thread)
+    {}
+
+    ~WavStreamer()
+    {
+      stop();
+    }
+
+    void add(std::shared_ptr<WavStream> stream)
+    {
+      {
+        std::scoped_lock lock(m_mutex);
+        m_streams.emplace_back(std::move(stream));
+        if (m_use_thread && !m_thread.joinable())
+        {
+          m_quit = false;
+          m_thread = std::thread([this] { run(); });
+        }
+      }
+      wake();
+    }
+
+    // Once this returns the refill thread starts no new refill of the stream. One already
+    //   under way finishes on the thread's own reference.
+    void remove(const WavStream* stream)
+    {
+      std::scoped_lock lock(m_mutex);
+      std::erase_if(m_streams, [stream](const auto& s) { return s.get() == stream; });
+    }
+
+    // Refills every stream on the calling thread. Only for a streamer without a thread.
+    void refill_now()
+    {
+      std::scoped_lock lock(m_mutex);
+      for (auto& stream : m_streams)
+        stream->refill();
+    }
+
+    void wake()
+    {
+      {
+        std::scoped_lock lock(m_mutex);
+        m_wake = true;
+      }
+      m_cv.notify_one();
+    }
+
+    void stop()
+    {
+      {
+        std::scoped_lock lock(m_mutex);
+        m_quit = true;
+      }
+      m_cv.notify_one();
+      if (m_thread.joinable())
+        m_thread.join();
+      m_streams.clear();
+    }
+  };
+
+}
@@ -0,0 +1,155 @@
+//
+//  WavWriter.h
+//  AudioLibSwitcher_libsoundio
+//
+
+#pragma once
+#include "SampleKernels.h"
+#include "BufferFormat.h"
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+
+namespace audio
+{
+
+  // Writes interleaved float frames to a 16-bit PCM or 32-bit float WAVE file.
+  //   The sizes in the header are filled in by close(). More than two channels, or a
+  //   nonzero channel_mask, are written as WAVE_FORMAT_EXTENSIBLE.
+  class WavWriter
+  {
+    std::FILE* m_file = nullptr;
+    SampleType m_sample_type = SampleType::S16;
+    int m_channels = 0;
+    uint64_t m_data_bytes = 0;
+    uint32_t m_data_size_offset = 0;
+    std::vector<int16_t> m_s16;
+    std::vector<float> m_f32;
+
+    void write_bytes(const void* data, size_t size)
+    {
+      if (std::fwrite(data, 1, size, m_file) != size)
+        throw std::runtime_error("Unable to write WAVE file.");
+    }
+
+    void write_u16(uint16_t v)
+    {
+      unsigned char bytes[2] = { uint8_t(v), uint8_t(v >> 8) };
+      write_bytes(bytes, sizeof(bytes));
+    }
+
+    void write_u32(uint32_t v)
+    {
+      unsigned char bytes[4] = { uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24) };
+      write_bytes(bytes, sizeof(bytes));
+    }
+
+  public:
+    // sample_type is SampleType::S16 or SampleType::F32.
+    WavWriter(const std::string& path, int sample_rate, int channels, SampleType sample_type, uint32_t channel_mask = 0)
+      : m_sample_type(sample_type)
+      , m_channels(channels)
+    {
+      if (sample_type != SampleType::S16 && sample_type != SampleType::F32)
+        throw std::runtime_error("WAVE files can only be written as 16-bit PCM or 32-bit float.");
+      if (channels <= 0)
+        throw std::runtime_error("WAVE files need at least one channel.");
+      m_file = std::fopen(path.c_str(), "wb");
+      if (m_file == nullptr)
+        throw std::runtime_error("Unable to open \"" + path + "\" for writing.");
+
+      const uint16_t bits = sample_type == SampleType::S16 ? 16 : 32;
+      const uint16_t block_align = static_cast<uint16_t>(channels * bits / 8);
+      const bool extensible = channels > 2 || channel_mask != 0;
+      const uint16_t format = sample_type == SampleType::S16 ? 1 : 3;
+      try
+      {
+        write_bytes("RIFF", 4);
+        write_u32(0);
+        write_bytes("WAVE", 4);
+        write_bytes("fmt ", 4);
+        write_u32(extensible ? 40 : 16);
+        write_u16(extensible ? 0xFFFE : format);
+        write_u16(static_cast<uint16_t>(channels));
+        write_u32(static_cast<uint32_t>(sample_rate));
+        write_u32(static_cast<uint32_t>(sample_rate) * block_align);
+        write_u16(block_align);
+        write_u16(bits);
+        if (extensible)
+        {
+          // cbSize, valid bits, speaker mask, then the sub-format GUID.
+          static const unsigned char c_guid_tail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+                                                         0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+          write_u16(22);
+          write_u16(bits);
+          write_u32(channel_mask);
+          write_u16(format);
+          write_bytes(c_guid_tail, sizeof(c_guid_tail));
+        }
+        write_bytes("data", 4);
+        m_data_size_offset = static_cast<uint32_t>(std::ftell(m_file));
+        write_u32(0);
+      }
+      catch (...)
+      {
+        std::fclose(m_file);
+        throw;
+      }
+    }
+
+    ~WavWriter()
+    {
+      if (m_file != nullptr)
+        std::fclose(m_file);
+    }
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    // Samples are clipped to [-1, 1] like on a device.
+    void write(const float* frames, int frame_count)
+    {
+      const size_t count = static_cast<size_t>(frame_count) * m_channels;
+      if (m_sample_type == SampleType::S16)
+      {
+        m_s16.resize(count);
+        kernels::convert_f32_to_s16(frames, m_s16.data(), static_cast<int>(count));
+        write_bytes(m_s16.data(), count * sizeof(int16_t));
+        m_data_bytes += count * sizeof(int16_t);
+      }
+      else
+      {
+        m_f32.resize(count);
+        kernels::convert_f32_to_f32(frames, m_f32.data(), static_cast<int>(count));
+        write_bytes(m_f32.data(), count * sizeof(float));
+        m_data_bytes += count * sizeof(float);
+      }
+    }
+
+    // Fills in the chunk sizes and closes the file. Throws if the data exceeds 4 GiB.
+    void close()
+    {
+      if (m_file == nullptr)
+        return;
+      const bool fits = m_data_bytes + m_data_size_offset + 4 <= 0xFFFFFFFFull;
+      if (fits)
+      {
+        // Samples are 2 or 4 bytes, so the data chunk never needs a pad byte.
+        std::fseek(m_file, 4, SEEK_SET);
+        write_u32(static_cast<uint32_t>(m_data_size_offset + 4 + m_data_bytes - 8));
+        std::fseek(m_file, m_data_size_offset, SEEK_SET);
+        write_u32(static_cast<uint32_t>(m_data_bytes));
+      }
+      const bool closed = std::fclose(m_file) == 0;
+      m_file = nullptr;
+      if (!fits)
+        throw std::runtime_error("WAVE file exceeds 4 GiB.");
+      if (!closed)
+        throw std::runtime_error("Unable to write WAVE file.");
+    }
+  };
+
+}
@@ -0,0 +1,1054 @@
+//
+//  libsoundio_bench.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  Performance suite. Prints a table, or JSON in the format of Google Benchmark
+//    (--benchmark_format=json, --benchmark_out=<file>) so the results can be compared and
+//    gated with the usual tooling. Run with --help for the options. Exits with 1 when no
+//    benchmark matches the filter or one reports an error, so CTest can run it as a test.
+//  Mix benchmarks render offline, so they measure the mixer and nothing else. The trigger,
+//    latency and device benchmarks need libsoundio's dummy backend.
+//
+
+#include "AudioLibSwitcher_libsoundio.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+using audio::AudioLibSwitcher_libsoundio;
+using Clock = std::chrono::steady_clock;
+
+namespace bench
+{
+
+  // Thread CPU time where available; the dummy backend and the refill thread run on other threads.
+  inline double get_thread_cpu_seconds()
+  {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+  }
+
+  // Loosely follows benchmark::State: `for (auto _ : state)` runs the timed iterations.
+  class State
+  {
+    uint64_t m_max_iterations = 1;
+    uint64_t m_iterations = 0;
+    Clock::time_point m_start;
+    double m_cpu_start = 0.0;
+    double m_real_seconds = 0.0;
+    double m_cpu_seconds = 0.0;
+    double m_manual_seconds = 0.0;
+    bool m_manual_time = false;
+    bool m_running = false;
+    double m_items = 0.0;
+    double m_bytes = 0.0;
+    std::string m_error;
+
+    void start_timer()
+    {
+      m_running = true;
+      m_cpu_start = get_thread_cpu_seconds();
+      m_start = Clock::now();
+    }
+
+    void stop_timer()
+    {
+      if (!m_running)
+        return;
+      m_real_seconds += std::chrono::duration<double>(Clock::now() - m_start).count();
+      m_cpu_seconds += get_thread_cpu_seconds() - m_cpu_start;
+      m_running = false;
+    }
+
+  public:
+    struct Counter
+    {
+      double value = 0.0;
+      // Divided by the elapsed time when reported, like benchmark::Counter::kIsRate.
+      bool is_rate = false;
+    };
+    std::map<std::string, Counter> counters;
+
+    class Iterator
+    {
+      State* m_state = nullptr;
+      uint64_t m_left = 0;
+
+    public:
+      struct [[maybe_unused]] Value {};
+
+      Iterator(State* state, uint64_t left) : m_state(state), m_left(left) {}
+      Value operator*() const { return {}; }
+      Iterator& operator++()
+      {
+        --m_left;
+        return *this;
+      }
+      bool operator!=(const Iterator&)
+      {
+        if (m_left > 0)
+          return true;
+        m_state->stop_timer();
+        return false;
+      }
+    };
+
+    explicit State(uint64_t max_iterations) : m_max_iterations(max_iterations) {}
+
+    Iterator begin()
+    {
+      m_iterations = m_max_iterations;
+      start_timer();
+      return Iterator(this, m_error.empty() ? m_max_iterations : 0);
+    }
+
+    Iterator end() { return Iterator(this, 0); }
+
+    void pause_timing() { stop_timer(); }
+    void resume_timing() { start_timer(); }
+
+    // Reports the given time for the current iteration instead of the measured one.
+    void set_iteration_time(double seconds)
+    {
+      m_manual_time = true;
+      m_manual_seconds += seconds;
+    }
+
+    void set_items_processed(double items) { m_items = items; }
+    void set_bytes_processed(double bytes) { m_bytes = bytes; }
+
+    void skip_with_error(const std::string& message)
+    {
+      m_error = message;
+      m_max_iterations = 0;
+    }
+
+    uint64_t get_iterations() const { return m_iterations; }
+    double get_real_seconds() const { return m_manual_time ? m_manual_seconds : m_real_seconds; }
+    double get_cpu_seconds() const { return m_manual_time ? m_manual_seconds : m_cpu_seconds; }
+    double get_items() const { return m_items; }
+    double get_bytes() const { return m_bytes; }
+    const std::string& get_error() const { return m_error; }
+  };
+
+  struct Benchmark
+  {
+    std::string name;
+    std::function<void(State&)> func;
+    // Fixed iteration count for benchmarks that are slow per iteration, 0 to grow to min_time.
+    uint64_t iterations = 0;
+  };
+
+  struct Result
+  {
+    std::string name;
+    uint64_t iterations = 0;
+    double real_ns = 0.0;
+    double cpu_ns = 0.0;
+    std::vector<std::pair<std::string, double>> counters;
+    std::string error;
+  };
+
+  inline std::vector<Benchmark>& get_registry()
+  {
+    static std::vector<Benchmark> registry;
+    return registry;
+  }
+
+  inline void add(std::string name, std::function<void(State&)> func, uint64_t iterations = 0)
+  {
+    get_registry().push_back({ std::move(name), std::move(func), iterations });
+  }
+
+  // Grows the iteration count like Google Benchmark until a run takes min_time.
+  inline Result run(const Benchmark& benchmark, double min_time)
+  {
+    uint64_t iterations = benchmark.iterations > 0 ? benchmark.iterations : 1;
+    for (;;)
+    {
+      State state(iterations);
+      benchmark.func(state);
+      const double seconds = state.get_real_seconds();
+      if (state.get_error().empty() && benchmark.iterations == 0 && seconds < min_time && iterations < 1000000000)
+      {
+        double factor = seconds > 0.0 ? std::min(10.0, std::max(1.4 * min_time / seconds, 2.0)) : 10.0;
+        iterations = static_cast<uint64_t>(std::ceil(iterations * factor));
+        continue;
+      }
+
+      Result result;
+      result.name = benchmark.name;
+      result.error = state.get_error();
+      result.iterations = state.get_iterations();
+      if (result.iterations > 0)
+      {
+        result.real_ns = state.get_real_seconds() * 1e9 / result.iterations;
+        result.cpu_ns = state.get_cpu_seconds() * 1e9 / result.iterations;
+      }
+      const double elapsed = state.get_real_seconds();
+      if (state.get_items() > 0.0 && elapsed > 0.0)
+        result.counters.emplace_back("items_per_second", state.get_items() / elapsed);
+      if (state.get_bytes() > 0.0 && elapsed > 0.0)
+        result.counters.emplace_back("bytes_per_second", state.get_bytes() / elapsed);
+      for (const auto& [name, counter] : state.counters)
+        result.counters.emplace_back(name, counter.is_rate && elapsed > 0.0 ? counter.value / elapsed : counter.value);
+      return result;
+    }
+  }
+
+  inline std::string escape_json(const std::string& s)
+  {
+    std::string out;
+    for (char c : s)
+    {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      if (static_cast<unsigned char>(c) < 0x20)
+        continue;
+      out += c;
+    }
+    return out;
+  }
+
+  inline std::string to_json(const std::vector<Result>& results, const std::string& executable)
+  {
+    char date[64] = {};
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    auto number = [](double v)
+    {
+      char buf[64];
+      std::snprintf(buf, sizeof(buf), "%.17g", std::isfinite(v) ? v : 0.0);
+      return std::string(buf);
+    };
+
+    std::string json = "{\n  \"context\": {\n";
+    json += "    \"date\": \"" + std::string(date) + "\",\n";
+    json += "    \"executable\": \"" + escape_json(executable) + "\",\n";
+    json += "    \"num_cpus\": " + std::to_string(std::thread::hardware_concurrency()) + ",\n";
+#if defined(AUDIOLIBSWITCHER_LIBSOUNDIO_AVX2)
+    json += "    \"simd\": \"avx2\",\n";
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_SSE2)
+    json += "    \"simd\": \"sse2\",\n";
+#elif defined(AUDIOLIBSWITCHER_LIBSOUNDIO_NEON)
+    json += "    \"simd\": \"neon\",\n";
+#else
+    json += "    \"simd\": \"none\",\n";
+#endif
+#if defined(NDEBUG)
+    json += "    \"library_build_type\": \"release\"\n";
+#else
+    json += "    \"library_build_type\": \"debug\"\n";
+#endif
+    json += "  },\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+      const auto& r = results[i];
+      json += "    {\n";
+      json += "      \"name\": \"" + escape_json(r.name) + "\",\n";
+      json += "      \"family_index\": " + std::to_string(i) + ",\n";
+      json += "      \"per_family_instance_index\": 0,\n";
+      json += "      \"run_name\": \"" + escape_json(r.name) + "\",\n";
+      json += "      \"run_type\": \"iteration\",\n";
+      json += "      \"repetitions\": 1,\n";
+      json += "      \"repetition_index\": 0,\n";
+      json += "      \"threads\": 1,\n";
+      if (!r.error.empty())
+      {
+        json += "      \"error_occurred\": true,\n";
+        json += "      \"error_message\": \"" + escape_json(r.error) + "\",\n";
+      }
+      json += "      \"iterations\": " + std::to_string(r.iterations) + ",\n";
+      json += "      \"real_time\": " + number(r.real_ns) + ",\n";
+      json += "      \"cpu_time\": " + number(r.cpu_ns) + ",\n";
+      json += "      \"time_unit\": \"ns\"";
+      for (const auto& [name, value] : r.counters)
+        json += ",\n      \"" + escape_json(name) + "\": " + number(value);
+      json += "\n    }" + std::string(i + 1 < results.size() ? "," : "") + "\n";
+    }
+    json += "  ]\n}\n";
+    return json;
+  }
+
+  inline void print_row(const Result& r)
+  {
+    if (!r.error.empty())
+    {
+      std::printf("%-56s ERROR: %s\n", r.name.c_str(), r.error.c_str());
+      return;
+    }
+    std::printf("%-56s %14.0f ns %14.0f ns %12llu", r.name.c_str(), r.real_ns, r.cpu_ns,
+                static_cast<unsigned long long>(r.iterations));
+    for (const auto& [name, value] : r.counters)
+      std::printf(" %s=%.4g", name.c_str(), value);
+    std::printf("\n");
+    std::fflush(stdout);
+  }
+
+}
+
+namespace
+{
+
+  using bench::State;
+
+  constexpr int c_rate = 48000;
+  constexpr int c_block_frames = 512;
+
+  std::vector<short> make_sine(size_t num_samples, int channels = 1)
+  {
+    std::vector<short> samples(num_samples * channels);
+    for (size_t i = 0; i < num_samples; ++i)
+      for (int c = 0; c < channels; ++c)
+        samples[i * channels + c] = static_cast<short>(8000 * std::sin(0.03 * i * (c + 1)));
+    return samples;
+  }
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_offline(size_t max_voices, int sample_rate = c_rate)
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.offline = true;
+    params.sample_rate = sample_rate;
+    params.max_voices = max_voices;
+    params.mix_block_frames = c_block_frames;
+    audio->init(params);
+    return audio;
+  }
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_dummy(const AudioLibSwitcher_libsoundio::InitParams& base = {})
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params = base;
+    params.backend = SoundIoBackendDummy;
+    audio->init(params);
+    return audio;
+  }
+
+  // Renders one mix block per iteration with num_voices looping sources playing.
+  void run_mix(State& state, size_t max_voices, int num_voices, int channels, float pitch,
+               audio::ResamplerQuality quality, float pan, audio::SampleType sample_type = audio::SampleType::S16)
+  {
+    auto audio = make_offline(max_voices);
+    auto buffer = audio->create_buffer();
+    if (sample_type != audio::SampleType::S16)
+      audio->set_buffer_data_compressed(buffer, make_sine(c_rate, channels),
+                                        *soundio_channel_layout_get_default(channels), c_rate, sample_type);
+    else if (channels == 1)
+      audio->set_buffer_data_mono_16(buffer, make_sine(c_rate), c_rate);
+    else
+      audio->set_buffer_data_multichannel(buffer, make_sine(c_rate, channels),
+                                          *soundio_channel_layout_get_default(channels), c_rate);
+    const size_t resident_bytes = audio->get_buffer_resident_bytes(buffer);
+    for (int v = 0; v < num_voices; ++v)
+    {
+      auto source = audio->create_source();
+      audio->attach_buffer_to_source(source, buffer);
+      audio->set_source_looping(source, true);
+      audio->set_source_pitch(source, pitch);
+      audio->set_source_resampler_quality(source, quality);
+      audio->set_source_pan(source, pan);
+      audio->play_source(source);
+    }
+    std::vector<float> out(c_block_frames * 2);
+    audio->render(out.data(), c_block_frames);
+
+    for (auto _ : state)
+      audio->render(out.data(), c_block_frames);
+
+    const double frames = static_cast<double>(state.get_iterations()) * c_block_frames;
+    state.set_items_processed(frames);
+    state.counters["voice_frames_per_second"] = { frames * num_voices, true };
+    // Share of real time one core spends mixing.
+    state.counters["realtime_load"] = { frames > 0 ? state.get_real_seconds() * c_rate / frames : 0.0, false };
+    state.counters["buffer_bytes"] = { static_cast<double>(resident_bytes), false };
+    state.counters["compression_ratio"] = { resident_bytes > 0 ? c_rate * channels * 2.0 / resident_bytes : 0.0, false };
+    audio->finish();
+  }
+
+  const char* get_quality_name(audio::ResamplerQuality quality)
+  {
+    switch (quality)
+    {
+      case audio::ResamplerQuality::Linear: return "linear";
+      case audio::ResamplerQuality::Cubic: return "cubic";
+      case audio::ResamplerQuality::Sinc: return "sinc";
+    }
+    return "?";
+  }
+
+  // ////////////////////////////////////////////////////////////////
+  // Kernels, each against the straightforward scalar loop it replaces.
+
+  void scalar_f32_to_s16(const float* src, int16_t* dst, int count)
+  {
+    for (int i = 0; i < count; ++i)
+      dst[i] = static_cast<int16_t>(std::lrint(std::clamp(src[i], -1.f, 1.f) * 32767.f));
+  }
+
+  void scalar_f32_to_f32(const float* src, float* dst, int count)
+  {
+    for (int i = 0; i < count; ++i)
+      dst[i] = std::clamp(src[i], -1.f, 1.f);
+  }
+
+  void scalar_s16_to_f32(const int16_t* src, float* dst, int count, float gain)
+  {
+    for (int i = 0; i < count; ++i)
+      dst[i] = src[i] * gain;
+  }
+
+  void scalar_complex_multiply_add(const float* a_re, const float* a_im, const float* b_re, const float* b_im,
+                                   float* acc_re, float* acc_im, int count)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i];
+      acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i];
+    }
+  }
+
+  template<typename Func>
+  void run_kernel(State& state, int items_per_call, Func func)
+  {
+    for (auto _ : state)
+      func();
+    state.set_items_processed(static_cast<double>(state.get_iterations()) * items_per_call);
+  }
+
+  void register_kernels()
+  {
+    constexpr int n = 4096;
+    struct Data
+    {
+      std::vector<float> f32 = std::vector<float>(n * 2);
+      std::vector<float> bus = std::vector<float>(n * 2);
+      std::vector<float> planes = std::vector<float>(n * 2);
+      std::vector<int16_t> s16 = std::vector<int16_t>(n * 2);
+      std::vector<int32_t> s32 = std::vector<int32_t>(n * 2);
+      std::vector<double> f64 = std::vector<double>(n * 2);
+      std::vector<uint8_t> mulaw = std::vector<uint8_t>(n * 2);
+      std::vector<uint8_t> adpcm = std::vector<uint8_t>(audio::get_data_bytes(audio::SampleType::ImaAdpcm, n, 1));
+      Data()
+      {
+        for (size_t i = 0; i < f32.size(); ++i)
+          f32[i] = static_cast<float>(std::sin(0.01 * i) * 1.2);
+        audio::kernels::convert_f32_to_s16(f32.data(), s16.data(), n * 2);
+        audio::encode_mulaw(s16.data(), s16.size(), mulaw.data());
+        audio::encode_ima_adpcm(s16.data(), n, 1, adpcm.data());
+      }
+    };
+    auto data = std::make_shared<Data>();
+    const float gains0[2] = { 0.2f, 0.7f };
+    const float gains1[2] = { 0.4f, 0.5f };
+
+    bench::add("BM_Kernel/convert_f32_to_s16", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_f32_to_s16(data->f32.data(), data->s16.data(), n * 2); }); });
+    bench::add("BM_KernelScalar/convert_f32_to_s16", [=](State& s) { run_kernel(s, n * 2, [&] { scalar_f32_to_s16(data->f32.data(), data->s16.data(), n * 2); }); });
+    bench::add("BM_Kernel/convert_f32_to_s32", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_f32_to_s32(data->f32.data(), data->s32.data(), n * 2); }); });
+    bench::add("BM_Kernel/convert_f32_to_f32", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_f32_to_f32(data->f32.data(), data->bus.data(), n * 2); }); });
+    bench::add("BM_KernelScalar/convert_f32_to_f32", [=](State& s) { run_kernel(s, n * 2, [&] { scalar_f32_to_f32(data->f32.data(), data->bus.data(), n * 2); }); });
+    bench::add("BM_Kernel/convert_f32_to_f64", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_f32_to_f64(data->f32.data(), data->f64.data(), n * 2); }); });
+    bench::add("BM_Kernel/convert_s16_to_f32", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_s16_to_f32(data->s16.data(), data->bus.data(), n * 2, 1.f / 32768.f); }); });
+    bench::add("BM_KernelScalar/convert_s16_to_f32", [=](State& s) { run_kernel(s, n * 2, [&] { scalar_s16_to_f32(data->s16.data(), data->bus.data(), n * 2, 1.f / 32768.f); }); });
+    bench::add("BM_Kernel/deinterleave_s16_stereo", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::deinterleave_s16_to_f32(data->s16.data(), 2, data->planes.data(), n, n, 1.f / 32768.f); }); });
+    bench::add("BM_KernelScalar/deinterleave_s16_stereo", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::deinterleave_to_f32_scalar(data->s16.data(), 2, data->planes.data(), n, n, 1.f / 32768.f); }); });
+    bench::add("BM_Kernel/mix_mono_to_stereo", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::mix_mono_to_interleaved(data->f32.data(), data->bus.data(), n, 2, 0.5f); }); });
+    bench::add("BM_KernelScalar/mix_mono_to_stereo", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::mix_mono_to_interleaved_scalar(data->f32.data(), data->bus.data(), n, 2, 0.5f); }); });
+    bench::add("BM_Kernel/mix_mono_to_stereo_ramp", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::mix_mono_to_interleaved_ramp(data->f32.data(), data->bus.data(), n, 2, gains0, gains1); }); });
+    bench::add("BM_Kernel/mix_stereo_to_stereo_ramp", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::mix_stereo_to_stereo_ramp(data->planes.data(), data->planes.data() + n, data->bus.data(), n, gains0, gains1); }); });
+    bench::add("BM_Kernel/convert_mulaw_to_f32", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_mulaw_to_f32(data->mulaw.data(), data->bus.data(), n * 2, 1.f / 32768.f); }); });
+    bench::add("BM_KernelScalar/convert_mulaw_to_f32", [=](State& s) { run_kernel(s, n * 2, [&] { audio::kernels::convert_mulaw_to_f32_scalar(data->mulaw.data(), data->bus.data(), n * 2, 1.f / 32768.f); }); });
+    // Sequential reads of one mix block each, as a voice does.
+    bench::add("BM_Kernel/decode_ima_adpcm", [=](State& s)
+    {
+      audio::AdpcmCursor cursor;
+      size_t frame = 0;
+      run_kernel(s, c_block_frames, [&]
+      {
+        audio::decode_ima_adpcm(data->adpcm.data(), 1, frame, c_block_frames, data->bus.data(), n, 1.f / 32768.f, &cursor);
+        frame = (frame + c_block_frames) % (n - c_block_frames);
+      });
+    });
+    // A flat ramp costs the same and keeps the repeatedly scaled block from decaying into denormals.
+    bench::add("BM_Kernel/apply_gain_ramp", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::apply_gain_ramp(data->planes.data(), n, 1, 1.f, 1.f); }); });
+    bench::add("BM_Kernel/mix_gain_ramp_stereo", [=](State& s) { run_kernel(s, n, [&] { audio::kernels::mix_gain_ramp(data->f32.data(), data->bus.data(), n, 2, 0.5f, 0.25f); }); });
+    // A unity band-pass keeps the repeatedly filtered block at a steady level.
+    const auto coeffs = audio::make_biquad({ audio::FilterType::BandPass, 1000.f, 0.5f }, c_rate);
+    bench::add("BM_Kernel/biquad", [=](State& s)
+    {
+      audio::BiquadState state;
+      run_kernel(s, n, [&] { audio::process_biquad(coeffs, state, data->planes.data(), n); });
+    });
+    bench::add("BM_KernelScalar/biquad", [=](State& s)
+    {
+      audio::BiquadState state;
+      run_kernel(s, n, [&] { audio::process_biquad_scalar(coeffs, state, data->planes.data(), n); });
+    });
+    // The convolution reverb's inner loop over 8 partitions of 257 split complex bins each,
+    //   per bin and partition.
+    constexpr int bins = audio::c_convolution_partition + 1;
+    constexpr int partitions = 8;
+    auto run_partitions = [=](auto kernel)
+    {
+      const float* a = data->f32.data();
+      const float* b = data->planes.data();
+      float* acc = data->bus.data();
+      for (int p = 0; p < partitions; ++p)
+        kernel(a + p * 2 * bins, a + p * 2 * bins + bins, b + p * 2 * bins, b + p * 2 * bins + bins, acc, acc + bins, bins);
+    };
+    bench::add("BM_Kernel/complex_multiply_add", [=](State& s)
+    {
+      run_kernel(s, partitions * bins, [&] { run_partitions(audio::kernels::complex_multiply_add); });
+    });
+    bench::add("BM_KernelScalar/complex_multiply_add", [=](State& s)
+    {
+      run_kernel(s, partitions * bins, [&] { run_partitions(scalar_complex_multiply_add); });
+    });
+    // Forward and inverse transform of one partition pair, per sample.
+    bench::add("BM_Kernel/real_fft_512", [=](State& s)
+    {
+      auto fft = std::make_shared<audio::RealFft>(2 * audio::c_convolution_partition);
+      float* p = data->planes.data();
+      run_kernel(s, fft->get_size(), [&]
+      {
+        fft->forward(data->f32.data(), p, p + bins);
+        fft->inverse(p, p + bins, data->bus.data());
+      });
+    });
+  }
+
+  // ////////////////////////////////////////////////////////////////
+  // Resampler tiers on one channel, per output frame.
+
+  void register_resampler()
+  {
+    for (auto quality : { audio::ResamplerQuality::Linear, audio::ResamplerQuality::Cubic, audio::ResamplerQuality::Sinc })
+      for (double step : { 44100.0 / 48000.0, 1.5 })
+      {
+        std::string name = std::string("BM_Resample/") + get_quality_name(quality) + "/step:" + std::to_string(step).substr(0, 5);
+        bench::add(name, [quality, step](State& state)
+        {
+          audio::ResamplerState resampler;
+          const int frames = c_block_frames;
+          std::vector<float> window(audio::ResamplerState::c_history + static_cast<size_t>(frames * step) + 64, 0.25f);
+          std::vector<float> out(frames);
+          for (auto _ : state)
+          {
+            int input_frames = audio::get_resampler_input_frames(resampler, quality, step, frames);
+            audio::resample(resampler, quality, step, window.data(), input_frames, out.data(), frames);
+          }
+          state.set_items_processed(static_cast<double>(state.get_iterations()) * frames);
+        });
+      }
+  }
+
+  // ////////////////////////////////////////////////////////////////
+  // Mix throughput.
+
+  void register_mix()
+  {
+    // Callback cost against the number of playing voices.
+    for (int voices : { 1, 16, 64, 256, 1024 })
+      bench::add("BM_Mix/mono/voices:" + std::to_string(voices), [voices](State& s)
+      {
+        run_mix(s, std::max<size_t>(voices, 1), voices, 1, 1.f, audio::ResamplerQuality::Cubic, 0.f);
+      });
+    // A few voices playing out of a large pool. Only the active voices are visited, so this
+    //   should cost the same as BM_Mix/mono/voices:16.
+    for (size_t pool : { 256, 4096 })
+      bench::add("BM_MixSparse/voices:16/pool:" + std::to_string(pool), [pool](State& s)
+      {
+        run_mix(s, pool, 16, 1, 1.f, audio::ResamplerQuality::Cubic, 0.f);
+      });
+    for (int channels : { 2, 6 })
+      bench::add("BM_Mix/channels:" + std::to_string(channels) + "/voices:64", [channels](State& s)
+      {
+        run_mix(s, 64, 64, channels, 1.f, audio::ResamplerQuality::Cubic, 0.f);
+      });
+    bench::add("BM_Mix/panned/voices:64", [](State& s)
+    {
+      run_mix(s, 64, 64, 1, 1.f, audio::ResamplerQuality::Cubic, 0.3f);
+    });
+    // Compressed buffers against the 16-bit path: memory in buffer_bytes and
+    //   compression_ratio, decode cost in realtime_load.
+    for (auto [sample_type, name] : { std::pair { audio::SampleType::S16, "s16" }, { audio::SampleType::MuLaw, "mulaw" },
+                                      { audio::SampleType::ImaAdpcm, "adpcm" } })
+      for (float pitch : { 1.f, 1.1f })
+        bench::add(std::string("BM_MixCompressed/") + name + (pitch == 1.f ? "" : "/resampled") + "/voices:64",
+                   [sample_type, pitch](State& s)
+        {
+          run_mix(s, 64, 64, 1, pitch, audio::ResamplerQuality::Cubic, 0.f, sample_type);
+        });
+    // Changing the gain of a group of voices every block, through the source volumes or
+    //   through the bus the group plays on. Commands are posted inside the timed loop.
+    for (bool use_bus : { false, true })
+      bench::add(std::string("BM_GroupGain/") + (use_bus ? "bus" : "source_volume") + "/voices:256", [use_bus](State& state)
+      {
+        auto audio = make_offline(256);
+        auto buffer = audio->create_buffer();
+        audio->set_buffer_data_mono_16(buffer, make_sine(c_rate), c_rate);
+        auto bus = audio->create_bus();
+        std::vector<unsigned int> sources;
+        for (int v = 0; v < 256; ++v)
+        {
+          auto source = audio->create_source();
+          audio->attach_buffer_to_source(source, buffer);
+          audio->set_source_looping(source, true);
+          audio->set_source_bus(source, bus);
+          audio->play_source(source);
+          sources.emplace_back(source);
+        }
+        std::vector<float> out(c_block_frames * 2);
+        audio->render(out.data(), c_block_frames);
+
+        float gain = 0.5f;
+        for (auto _ : state)
+        {
+          gain = gain == 0.5f ? 0.6f : 0.5f;
+          if (use_bus)
+            audio->set_bus_gain(bus, gain);
+          else
+            for (auto source : sources)
+              audio->set_source_volume(source, gain);
+          audio->render(out.data(), c_block_frames);
+        }
+
+        const double frames = static_cast<double>(state.get_iterations()) * c_block_frames;
+        state.set_items_processed(frames);
+        state.counters["realtime_load"] = { frames > 0 ? state.get_real_seconds() * c_rate / frames : 0.0, false };
+        audio->finish();
+      });
+    // CPU per voice for each resampler tier, at a pitch that forces resampling.
+    for (auto quality : { audio::ResamplerQuality::Linear, audio::ResamplerQuality::Cubic, audio::ResamplerQuality::Sinc })
+      bench::add(std::string("BM_MixResampled/") + get_quality_name(quality) + "/voices:64", [quality](State& s)
+      {
+        run_mix(s, 64, 64, 1, 1.1f, quality, 0.f);
+      });
+  }
+
+  // ////////////////////////////////////////////////////////////////
+  // Effects: cost per voice per effect on top of the plain mix, and a reverb shared through a bus.
+
+  // Decaying noise, one channel.
+  std::shared_ptr<const audio::ImpulseResponse> make_reverb_ir(int frames)
+  {
+    std::vector<float> samples(frames);
+    uint32_t seed = 1;
+    for (int i = 0; i < frames; ++i)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      samples[i] = (static_cast<float>(seed >> 8) / 8388608.f - 1.f) * 0.05f * std::exp(-3.f * i / frames);
+    }
+    return audio::make_impulse_response(samples, 1);
+  }
+
+  enum class EffectKind
+  {
+    Dry,
+    LowPass,
+    HighShelf,
+    FilterChain,  // Low-pass into high-pass into high shelf.
+    Reverb,
+    BusReverb,
+  };
+
+  void run_effect(State& state, int num_voices, EffectKind kind, int ir_frames)
+  {
+    auto audio = make_offline(num_voices);
+    auto buffer = audio->create_buffer();
+    audio->set_buffer_data_mono_16(buffer, make_sine(c_rate), c_rate);
+    auto ir = ir_frames > 0 ? make_reverb_ir(ir_frames) : nullptr;
+    auto bus = audio->create_bus();
+    if (kind == EffectKind::BusReverb)
+      audio->set_bus_reverb(bus, 0, ir, 0.3f);
+    for (int v = 0; v < num_voices; ++v)
+    {
+      auto source = audio->create_source();
+      audio->attach_buffer_to_source(source, buffer);
+      audio->set_source_looping(source, true);
+      audio->set_source_bus(source, bus);
+      switch (kind)
+      {
+        case EffectKind::LowPass:
+          audio->set_source_filter(source, 0, audio::FilterType::LowPass, 800.f);
+          break;
+        case EffectKind::HighShelf:
+          audio->set_source_filter(source, 0, audio::FilterType::HighShelf, 4000.f, audio::c_butterworth_q, -6.f);
+          break;
+        case EffectKind::FilterChain:
+          audio->set_source_filter(source, 0, audio::FilterType::LowPass, 8000.f);
+          audio->set_source_filter(source, 1, audio::FilterType::HighPass, 80.f);
+          audio->set_source_filter(source, 2, audio::FilterType::HighShelf, 4000.f, audio::c_butterworth_q, -6.f);
+          break;
+        case EffectKind::Reverb:
+          audio->set_source_reverb(source, 0, ir, 0.3f);
+          break;
+        default:
+          break;
+      }
+      audio->play_source(source);
+    }
+    std::vector<float> out(c_block_frames * 2);
+    audio->render(out.data(), c_block_frames);
+
+    for (auto _ : state)
+      audio->render(out.data(), c_block_frames);
+
+    const double frames = static_cast<double>(state.get_iterations()) * c_block_frames;
+    const double load = frames > 0 ? state.get_real_seconds() * c_rate / frames : 0.0;
+    state.set_items_processed(frames);
+    state.counters["realtime_load"] = { load, false };
+    state.counters["realtime_load_per_voice"] = { load / num_voices, false };
+    audio->finish();
+  }
+
+  void register_effects()
+  {
+    for (auto [kind, name] : { std::pair { EffectKind::Dry, "dry" }, { EffectKind::LowPass, "lowpass" },
+                               { EffectKind::HighShelf, "highshelf" }, { EffectKind::FilterChain, "filters:3" } })
+      bench::add(std::string("BM_Effect/") + name + "/voices:64", [kind](State& s) { run_effect(s, 64, kind, 0); });
+    // The reverb costs one FFT pair per partition plus one complex multiply-add per bin and
+    //   partition of the impulse response.
+    for (int ir_ms : { 100, 500 })
+      bench::add("BM_Effect/reverb_" + std::to_string(ir_ms) + "ms/voices:64", [ir_ms](State& s)
+      {
+        run_effect(s, 64, EffectKind::Reverb, c_rate * ir_ms / 1000);
+      });
+    // One long reverb on the bus all voices play on: a fixed cost however many voices feed it.
+    bench::add("BM_Effect/bus_reverb_2000ms/voices:64", [](State& s)
+    {
+      run_effect(s, 64, EffectKind::BusReverb, c_rate * 2);
+    });
+  }
+
+  // Streaming sources decode from a WAVE file written for the purpose.
+  void register_streaming()
+  {
+    for (int streams : { 1, 8 })
+      bench::add("BM_MixStreaming/streams:" + std::to_string(streams), [streams](State& state)
+      {
+        const std::string path = "libsoundio_bench_stream.wav";
+        {
+          std::vector<float> frames(c_rate * 4 * 2);
+          for (size_t i = 0; i < frames.size(); ++i)
+            frames[i] = static_cast<float>(0.25 * std::sin(0.02 * i));
+          audio::WavWriter writer(path, c_rate, 2, audio::SampleType::S16);
+          writer.write(frames.data(), c_rate * 4);
+          writer.close();
+        }
+        auto audio = make_offline(64);
+        for (int i = 0; i < streams; ++i)
+        {
+          auto source = audio->create_streaming_source(path);
+          audio->set_source_looping(source, true);
+          audio->play_source(source);
+        }
+        std::vector<float> out(c_block_frames * 2);
+        for (auto _ : state)
+          audio->render(out.data(), c_block_frames);
+        state.set_items_processed(static_cast<double>(state.get_iterations()) * c_block_frames);
+        audio->finish();
+        std::remove(path.c_str());
+      });
+  }
+
+  // ////////////////////////////////////////////////////////////////
+  // API thread costs.
+
+  void register_churn()
+  {
+    // One-shot sources: create, attach, play, stop, destroy. The offline renderer drains the
+    //   command queue every 256 sources, as a callback would.
+    bench::add("BM_SourceChurn", [](State& state)
+    {
+      auto audio = make_offline(256);
+      auto buffer = audio->create_buffer();
+      audio->set_buffer_data_mono_16(buffer, make_sine(4800), c_rate);
+      uint64_t n = 0;
+      for (auto _ : state)
+      {
+        auto source = audio->create_source();
+        audio->attach_buffer_to_source(source, buffer);
+        audio->play_source(source);
+        audio->destroy_source(source);
+        if ((++n & 255) == 0)
+          audio->render(nullptr, 0);
+      }
+      state.set_items_processed(static_cast<double>(state.get_iterations()));
+      audio->finish();
+    });
+    bench::add("BM_BufferChurn", [](State& state)
+    {
+      auto audio = make_offline(16);
+      auto samples = make_sine(4800);
+      for (auto _ : state)
+      {
+        auto buffer = audio->create_buffer();
+        audio->set_buffer_data_mono_16(buffer, samples, c_rate);
+        audio->destroy_buffer(buffer);
+      }
+      state.set_items_processed(static_cast<double>(state.get_iterations()));
+      audio->finish();
+    });
+  }
+
+  void register_upload()
+  {
+    for (size_t frames : { 4800, 480000 })
+    {
+      const std::string suffix = "/frames:" + std::to_string(frames);
+      bench::add("BM_Upload/copy" + suffix, [frames](State& state)
+      {
+        auto audio = make_offline(16);
+        auto buffer = audio->create_buffer();
+        auto samples = make_sine(frames);
+        for (auto _ : state)
+          audio->set_buffer_data_mono_16(buffer, samples, c_rate);
+        state.set_bytes_processed(static_cast<double>(state.get_iterations()) * frames * sizeof(short));
+        audio->finish();
+      });
+      bench::add("BM_Upload/move" + suffix, [frames](State& state)
+      {
+        auto audio = make_offline(16);
+        auto buffer = audio->create_buffer();
+        auto samples = make_sine(frames);
+        for (auto _ : state)
+        {
+          state.pause_timing();
+          auto copy = samples;
+          state.resume_timing();
+          audio->set_buffer_data_mono_16(buffer, std::move(copy), c_rate);
+        }
+        state.set_bytes_processed(static_cast<double>(state.get_iterations()) * frames * sizeof(short));
+        audio->finish();
+      });
+      bench::add("BM_Upload/shared" + suffix, [frames](State& state)
+      {
+        auto audio = make_offline(16);
+        auto buffer = audio->create_buffer();
+        auto block = std::make_shared<const std::vector<short>>(make_sine(frames));
+        for (auto _ : state)
+          audio->set_buffer_data_mono_16(buffer, block, c_rate);
+        state.set_bytes_processed(static_cast<double>(state.get_iterations()) * frames * sizeof(short));
+        audio->finish();
+      });
+    }
+  }
+
+  // ////////////////////////////////////////////////////////////////
+  // Device benchmarks on the dummy backend. These run in real time.
+
+  void register_device()
+  {
+    // Time from play_source() until the callback has mixed the first block of the source.
+    //   Reported as the iteration time; command_latency_periods is the mean in callback periods.
+    bench::add("BM_TriggerLatency/dummy", [](State& state)
+    {
+      std::unique_ptr<AudioLibSwitcher_libsoundio> audio;
+      try
+      {
+        audio = make_dummy();
+      }
+      catch (const std::exception& e)
+      {
+        state.skip_with_error(e.what());
+        return;
+      }
+      auto buffer = audio->create_buffer();
+      audio->set_buffer_data_mono_16(buffer, make_sine(c_rate), c_rate);
+      auto source = audio->create_source();
+      audio->attach_buffer_to_source(source, buffer);
+      std::vector<double> latencies;
+      for (auto _ : state)
+      {
+        auto start = Clock::now();
+        audio->play_source(source);
+        while (!audio->get_source_position(source).is_valid)
+          std::this_thread::yield();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        state.set_iteration_time(seconds);
+        latencies.emplace_back(seconds);
+        audio->stop_source(source);
+      }
+      if (!latencies.empty())
+      {
+        std::sort(latencies.begin(), latencies.end());
+        state.counters["p50_ms"] = { latencies[latencies.size() / 2] * 1e3, false };
+        state.counters["p99_ms"] = { latencies[latencies.size() * 99 / 100] * 1e3, false };
+        state.counters["max_ms"] = { latencies.back() * 1e3, false };
+      }
+      state.counters["command_latency_periods"] = { audio->get_command_latency_stats().mean_periods, false };
+      audio->finish();
+    }, 200);
+
+    // Underflows against the requested latency, one second of playback each.
+    for (double target_ms : { 2.0, 5.0, 10.0, 20.0, 50.0 })
+    {
+      char name[64];
+      std::snprintf(name, sizeof(name), "BM_LatencySweep/dummy/target_ms:%g", target_ms);
+      bench::add(name, [target_ms](State& state)
+      {
+        AudioLibSwitcher_libsoundio::InitParams params;
+        params.latency.target_seconds = target_ms * 1e-3;
+        std::unique_ptr<AudioLibSwitcher_libsoundio> audio;
+        try
+        {
+          audio = make_dummy(params);
+        }
+        catch (const std::exception& e)
+        {
+          state.skip_with_error(e.what());
+          return;
+        }
+        auto buffer = audio->create_buffer();
+        audio->set_buffer_data_mono_16(buffer, make_sine(c_rate), c_rate);
+        auto source = audio->create_source();
+        audio->attach_buffer_to_source(source, buffer);
+        audio->set_source_looping(source, true);
+        audio->play_source(source);
+        for (auto _ : state)
+          std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto stats = audio->get_output_stats();
+        auto latency = audio->get_latency_info();
+        state.counters["underflows_per_second"] = { static_cast<double>(stats.num_underflows), true };
+        state.counters["negotiated_ms"] = { latency.negotiated_seconds * 1e3, false };
+        state.counters["measured_ms"] = { latency.smoothed_seconds * 1e3, false };
+        audio->finish();
+      }, 1);
+    }
+
+    // Time select_output_device() blocks while playback moves to a freshly opened stream.
+    bench::add("BM_DeviceSwitch/dummy", [](State& state)
+    {
+      std::unique_ptr<AudioLibSwitcher_libsoundio> audio;
+      try
+      {
+        audio = make_dummy();
+      }
+      catch (const std::exception& e)
+      {
+        state.skip_with_error(e.what());
+        return;
+      }
+      auto buffer = audio->create_buffer();
+      audio->set_buffer_data_mono_16(buffer, make_sine(c_rate), c_rate);
+      auto source = audio->create_source();
+      audio->attach_buffer_to_source(source, buffer);
+      audio->set_source_looping(source, true);
+      audio->play_source(source);
+      const std::string device_id = audio->get_device()->id;
+      for (auto _ : state)
+        audio->select_output_device(device_id);
+      state.counters["still_playing"] = { audio->is_source_playing(source) ? 1.0 : 0.0, false };
+      audio->finish();
+    }, 20);
+  }
+
+  void print_usage(const char* executable)
+  {
+    std::printf("Usage: %s [options]\n"
+                "  --benchmark_filter=<regex>     Run the benchmarks whose name matches.\n"
+                "  --benchmark_min_time=<seconds> Minimum time per benchmark (default 0.5).\n"
+                "  --benchmark_format=console|json\n"
+                "  --benchmark_out=<file>         Also write JSON results to the file.\n"
+                "  --benchmark_list_tests         List the benchmark names and exit.\n",
+                executable);
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  std::string filter = ".";
+  std::string format = "console";
+  std::string out_path;
+  double min_time = 0.5;
+  bool list_only = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    auto value = [&arg](const char* prefix) { return arg.substr(std::strlen(prefix)); };
+    if (arg.rfind("--benchmark_filter=", 0) == 0)
+      filter = value("--benchmark_filter=");
+    else if (arg.rfind("--benchmark_min_time=", 0) == 0)
+      min_time = std::atof(value("--benchmark_min_time=").c_str());
+    else if (arg.rfind("--benchmark_format=", 0) == 0)
+      format = value("--benchmark_format=");
+    else if (arg.rfind("--benchmark_out=", 0) == 0)
+      out_path = value("--benchmark_out=");
+    else if (arg == "--benchmark_list_tests")
+      list_only = true;
+    else
+    {
+      print_usage(argv[0]);
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  register_kernels();
+  register_resampler();
+  register_mix();
+  register_effects();
+  register_streaming();
+  register_churn();
+  register_upload();
+  register_device();
+
+  const std::regex pattern(filter);
+  std::vector<bench::Result> results;
+  if (format == "console" && !list_only)
+    std::printf("%-56s %17s %17s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+  for (const auto& benchmark : bench::get_registry())
+  {
+    if (!std::regex_search(benchmark.name, pattern))
+      continue;
+    if (list_only)
+    {
+      std::printf("%s\n", benchmark.name.c_str());
+      continue;
+    }
+    results.emplace_back(bench::run(benchmark, min_time));
+    if (format == "console")
+      bench::print_row(results.back());
+  }
+  if (list_only)
+    return 0;
+  if (results.empty())
+  {
+    std::fprintf(stderr, "No benchmark matches %s\n", filter.c_str());
+    return 1;
+  }
+
+  const std::string json = bench::to_json(results, argv[0]);
+  if (format == "json")
+    std::fputs(json.c_str(), stdout);
+  if (!out_path.empty())
+  {
+    std::FILE* file = std::fopen(out_path.c_str(), "w");
+    if (file == nullptr)
+    {
+      std::fprintf(stderr, "Unable to write %s\n", out_path.c_str());
+      return 1;
+    }
+    std::fputs(json.c_str(), file);
+    std::fclose(file);
+  }
+  const bool failed = std::any_of(results.begin(), results.end(), [](const bench::Result& r) { return !r.error.empty(); });
+  return failed ? 1 : 0;
+}
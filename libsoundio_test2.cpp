@@ -1,4 +1,5 @@
 #include "AudioLibSwitcher_libsoundio.h"
+#include <cstring>
 
 
 int main(int argc, char **argv)
@@ -25,11 +26,11 @@ int main(int argc, char **argv)
   
   // ////////
   
-  libsoundio.init();
-  
-  auto* soundio = libsoundio.get_soundio();
-  
-  auto* device = libsoundio.get_device();
+  audio::AudioLibSwitcher_libsoundio::InitParams params;
+  for (int i = 1; i + 1 < argc; ++i)
+    if (strcmp(argv[i], "--backend") == 0 && strcmp(argv[i + 1], "dummy") == 0)
+      params.backend = SoundIoBackendDummy;
+  libsoundio.init(params);
   
   unsigned int src_id = libsoundio.create_source();
   unsigned int buf_id = libsoundio.create_buffer();
@@ -42,13 +43,10 @@ int main(int argc, char **argv)
   //for (;;)
   while (libsoundio.is_source_playing(src_id))
   {
-    soundio_flush_events(soundio);
     int c = getc(stdin);
     if (c == 'q')
       break;
   }
-#else
-  soundio_flush_events(soundio);
 #endif
   
   libsoundio.destroy_buffer(buf_id);
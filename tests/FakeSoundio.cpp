@@ -0,0 +1,374 @@
+//
+//  FakeSoundio.cpp
+//  AudioLibSwitcher_libsoundio
+//
+
+#include "FakeSoundio.h"
+#include <soundio/soundio.h>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+  SoundIoChannelLayout g_mono_layout { "Mono", 1, { SoundIoChannelIdFrontCenter } };
+  SoundIoChannelLayout g_stereo_layout { "Stereo", 2, { SoundIoChannelIdFrontLeft, SoundIoChannelIdFrontRight } };
+
+  struct FakeDevice
+  {
+    const char* id;
+    const char* name;
+    SoundIoChannelLayout* layout;
+    SoundIoFormat format;
+    int sample_rate;
+  };
+
+  const FakeDevice c_devices[fake_soundio::c_num_devices] =
+  {
+    { "fake-out-0", "Fake Stereo Output", &g_stereo_layout, SoundIoFormatFloat32NE, 48000 },
+    { "fake-out-1", "Fake Mono Output", &g_mono_layout, SoundIoFormatS16NE, 44100 },
+  };
+
+  struct DeviceStorage
+  {
+    SoundIoDevice device {};
+    SoundIoFormat format = SoundIoFormatInvalid;
+    SoundIoSampleRateRange rate {};
+  };
+
+  struct OutStream
+  {
+    SoundIoOutStream stream {};
+    std::vector<char> buffer;
+    SoundIoChannelArea areas[SOUNDIO_MAX_CHANNELS] {};
+    std::vector<float>* capture = nullptr;
+  };
+
+  // Guards the devices and streams. Recursive, as the write callback calls back into the fake.
+  std::recursive_mutex g_mutex;
+  DeviceStorage g_devices[fake_soundio::c_num_devices];
+  std::vector<std::unique_ptr<OutStream>> g_streams;
+  OutStream* g_started = nullptr;
+  std::atomic<int> g_default_device { 0 };
+  // Reported from soundio_flush_events(), as libsoundio does.
+  std::atomic<bool> g_devices_changed { false };
+
+  std::mutex g_event_mutex;
+  std::condition_variable g_event_cv;
+  uint64_t g_num_wakeups = 0;
+  int g_num_event_waits = 0;
+  bool g_waiting = false;
+  std::atomic<int> g_flush_delay_ms { 0 };
+  std::atomic<bool> g_flushing_before_wait { false };
+
+  void signal_events()
+  {
+    std::scoped_lock lock(g_event_mutex);
+    g_num_wakeups++;
+    g_event_cv.notify_all();
+  }
+
+  OutStream* get_stream(SoundIoOutStream* outstream)
+  {
+    for (auto& out : g_streams)
+      if (&out->stream == outstream)
+        return out.get();
+    return nullptr;
+  }
+
+  float read_sample(const char* ptr, SoundIoFormat format)
+  {
+    switch (format)
+    {
+      case SoundIoFormatS16NE:
+      {
+        int16_t s;
+        std::memcpy(&s, ptr, sizeof(s));
+        return s / 32768.f;
+      }
+      case SoundIoFormatFloat32NE:
+      {
+        float f;
+        std::memcpy(&f, ptr, sizeof(f));
+        return f;
+      }
+      default:
+        return 0.f;
+    }
+  }
+
+}
+
+namespace fake_soundio
+{
+
+  std::vector<float> run_callback(int frame_count)
+  {
+    std::scoped_lock lock(g_mutex);
+    std::vector<float> captured;
+    if (g_started == nullptr)
+      return captured;
+    g_started->capture = &captured;
+    g_started->stream.write_callback(&g_started->stream, 0, frame_count);
+    g_started->capture = nullptr;
+    return captured;
+  }
+
+  std::string get_started_device_id()
+  {
+    std::scoped_lock lock(g_mutex);
+    return g_started != nullptr ? g_started->stream.device->id : "";
+  }
+
+  int get_num_open_streams()
+  {
+    std::scoped_lock lock(g_mutex);
+    return static_cast<int>(g_streams.size());
+  }
+
+  void set_default_device(int index)
+  {
+    if (g_default_device.exchange(index) == index)
+      return;
+    g_devices_changed = true;
+    signal_events();
+  }
+
+  void fail_stream(int err)
+  {
+    std::scoped_lock lock(g_mutex);
+    if (g_started != nullptr && g_started->stream.error_callback != nullptr)
+      g_started->stream.error_callback(&g_started->stream, err);
+  }
+
+  int get_num_event_waits()
+  {
+    std::scoped_lock lock(g_event_mutex);
+    return g_num_event_waits;
+  }
+
+  bool is_waiting_for_events()
+  {
+    std::scoped_lock lock(g_event_mutex);
+    return g_waiting;
+  }
+
+  void set_flush_delay(int milliseconds) { g_flush_delay_ms = milliseconds; }
+
+  bool is_flushing_before_wait() { return g_flushing_before_wait; }
+
+}
+
+extern "C"
+{
+
+  const char* soundio_strerror(int error) { return error == SoundIoErrorNone ? "(no error)" : "fake error"; }
+
+  const char* soundio_backend_name(enum SoundIoBackend backend) { return backend == SoundIoBackendDummy ? "Dummy" : "None"; }
+
+  struct SoundIo* soundio_create(void) { return new SoundIo {}; }
+
+  void soundio_destroy(struct SoundIo* soundio) { delete soundio; }
+
+  int soundio_connect_backend(struct SoundIo* soundio, enum SoundIoBackend backend)
+  {
+    if (backend != SoundIoBackendDummy)
+      return SoundIoErrorBackendUnavailable;
+    std::scoped_lock lock(g_mutex);
+    soundio->current_backend = SoundIoBackendDummy;
+    for (int i = 0; i < fake_soundio::c_num_devices; ++i)
+    {
+      const auto& fake = c_devices[i];
+      auto& storage = g_devices[i];
+      storage.format = fake.format;
+      storage.rate = { fake.sample_rate, fake.sample_rate };
+      auto& device = storage.device;
+      device = {};
+      device.soundio = soundio;
+      device.id = const_cast<char*>(fake.id);
+      device.name = const_cast<char*>(fake.name);
+      device.aim = SoundIoDeviceAimOutput;
+      device.layouts = fake.layout;
+      device.layout_count = 1;
+      device.current_layout = *fake.layout;
+      device.formats = &storage.format;
+      device.format_count = 1;
+      device.current_format = fake.format;
+      device.sample_rates = &storage.rate;
+      device.sample_rate_count = 1;
+      device.sample_rate_current = fake.sample_rate;
+      device.software_latency_min = 0.001;
+      device.software_latency_max = 2.0;
+      device.software_latency_current = 0.02;
+      device.ref_count = 1;
+    }
+    return SoundIoErrorNone;
+  }
+
+  int soundio_connect(struct SoundIo* soundio) { return soundio_connect_backend(soundio, SoundIoBackendDummy); }
+
+  void soundio_disconnect(struct SoundIo* soundio) { soundio->current_backend = SoundIoBackendNone; }
+
+  void soundio_flush_events(struct SoundIo* soundio)
+  {
+    if (g_flush_delay_ms > 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(g_flush_delay_ms));
+    if (g_devices_changed.exchange(false) && soundio->on_devices_change != nullptr)
+      soundio->on_devices_change(soundio);
+  }
+
+  // Flushes, then waits for the next signal, like libsoundio's backends.
+  void soundio_wait_events(struct SoundIo* soundio)
+  {
+    g_flushing_before_wait = true;
+    soundio_flush_events(soundio);
+    g_flushing_before_wait = false;
+    {
+      std::unique_lock lock(g_event_mutex);
+      g_num_event_waits++;
+      g_waiting = true;
+      const uint64_t seen = g_num_wakeups;
+      g_event_cv.wait(lock, [seen] { return g_num_wakeups != seen; });
+      g_waiting = false;
+    }
+    soundio_flush_events(soundio);
+  }
+
+  void soundio_wakeup(struct SoundIo*) { signal_events(); }
+
+  int soundio_output_device_count(struct SoundIo*) { return fake_soundio::c_num_devices; }
+
+  int soundio_default_output_device_index(struct SoundIo*) { return g_default_device; }
+
+  struct SoundIoDevice* soundio_get_output_device(struct SoundIo*, int index)
+  {
+    if (index < 0 || index >= fake_soundio::c_num_devices)
+      return nullptr;
+    std::scoped_lock lock(g_mutex);
+    g_devices[index].device.ref_count++;
+    return &g_devices[index].device;
+  }
+
+  void soundio_device_ref(struct SoundIoDevice* device)
+  {
+    std::scoped_lock lock(g_mutex);
+    device->ref_count++;
+  }
+
+  void soundio_device_unref(struct SoundIoDevice* device)
+  {
+    std::scoped_lock lock(g_mutex);
+    if (device != nullptr)
+      device->ref_count--;
+  }
+
+  bool soundio_device_supports_format(struct SoundIoDevice* device, enum SoundIoFormat format)
+  {
+    return std::find(device->formats, device->formats + device->format_count, format) != device->formats + device->format_count;
+  }
+
+  int soundio_device_nearest_sample_rate(struct SoundIoDevice* device, int)
+  {
+    return device->sample_rate_current;
+  }
+
+  const struct SoundIoChannelLayout* soundio_channel_layout_get_default(int channel_count)
+  {
+    return channel_count == 1 ? &g_mono_layout : channel_count == 2 ? &g_stereo_layout : nullptr;
+  }
+
+  const struct SoundIoChannelLayout* soundio_channel_layout_get_builtin(int index)
+  {
+    return index == SoundIoChannelLayoutIdMono ? &g_mono_layout : &g_stereo_layout;
+  }
+
+  int soundio_channel_layout_find_channel(const struct SoundIoChannelLayout* layout, enum SoundIoChannelId channel)
+  {
+    for (int i = 0; i < layout->channel_count; ++i)
+      if (layout->channels[i] == channel)
+        return i;
+    return -1;
+  }
+
+  struct SoundIoOutStream* soundio_outstream_create(struct SoundIoDevice* device)
+  {
+    std::scoped_lock lock(g_mutex);
+    auto& out = g_streams.emplace_back(std::make_unique<OutStream>());
+    out->stream.device = device;
+    out->stream.volume = 1.f;
+    soundio_device_ref(device);
+    return &out->stream;
+  }
+
+  // Waits for a callback the test is running, as libsoundio joins its callback thread.
+  void soundio_outstream_destroy(struct SoundIoOutStream* outstream)
+  {
+    std::scoped_lock lock(g_mutex);
+    auto* out = get_stream(outstream);
+    if (g_started == out)
+      g_started = nullptr;
+    soundio_device_unref(outstream->device);
+    std::erase_if(g_streams, [out](const auto& s) { return s.get() == out; });
+  }
+
+  int soundio_outstream_open(struct SoundIoOutStream* outstream)
+  {
+    std::scoped_lock lock(g_mutex);
+    auto* device = outstream->device;
+    if (outstream->layout.channel_count == 0)
+      outstream->layout = device->current_layout;
+    if (!soundio_device_supports_format(device, outstream->format))
+      return SoundIoErrorIncompatibleDevice;
+    if (outstream->software_latency <= 0.0)
+      outstream->software_latency = device->software_latency_current;
+    outstream->bytes_per_sample = outstream->format == SoundIoFormatS16NE ? 2 : 4;
+    outstream->bytes_per_frame = outstream->bytes_per_sample * outstream->layout.channel_count;
+    return SoundIoErrorNone;
+  }
+
+  int soundio_outstream_start(struct SoundIoOutStream* outstream)
+  {
+    std::scoped_lock lock(g_mutex);
+    g_started = get_stream(outstream);
+    return SoundIoErrorNone;
+  }
+
+  int soundio_outstream_begin_write(struct SoundIoOutStream* outstream, struct SoundIoChannelArea** areas, int* frame_count)
+  {
+    std::scoped_lock lock(g_mutex);
+    auto* out = get_stream(outstream);
+    out->buffer.assign(static_cast<size_t>(*frame_count) * outstream->bytes_per_frame, 0);
+    for (int c = 0; c < outstream->layout.channel_count; ++c)
+    {
+      out->areas[c].ptr = out->buffer.data() + c * outstream->bytes_per_sample;
+      out->areas[c].step = outstream->bytes_per_frame;
+    }
+    *areas = out->areas;
+    return SoundIoErrorNone;
+  }
+
+  int soundio_outstream_end_write(struct SoundIoOutStream* outstream)
+  {
+    std::scoped_lock lock(g_mutex);
+    auto* out = get_stream(outstream);
+    if (out->capture != nullptr)
+      for (size_t i = 0; i < out->buffer.size(); i += outstream->bytes_per_sample)
+        out->capture->push_back(read_sample(out->buffer.data() + i, outstream->format));
+    return SoundIoErrorNone;
+  }
+
+  int soundio_outstream_get_latency(struct SoundIoOutStream* outstream, double* out_latency)
+  {
+    *out_latency = outstream->software_latency;
+    return SoundIoErrorNone;
+  }
+
+}
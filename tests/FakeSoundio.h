@@ -0,0 +1,54 @@
+//
+//  FakeSoundio.h
+//  AudioLibSwitcher_libsoundio
+//
+//  A scripted stand-in for libsoundio, for tests that need more than the dummy backend's
+//    single output device. It implements the functions the adapter calls, against
+//    libsoundio's own header, and runs the write callback only when the test asks, on the
+//    test's thread, so every run is deterministic. Link it instead of libsoundio.
+//  soundio_wait_events() blocks like libsoundio's: until soundio_wakeup() or a device change,
+//    and a wakeup made while nobody waits is lost. The adapter's event thread may call in
+//    while the test runs callbacks, so the fake is locked throughout.
+//
+
+#pragma once
+#include <string>
+#include <vector>
+
+
+namespace fake_soundio
+{
+
+  // Output device 0, "fake-out-0": stereo Float32NE, 48 kHz only.
+  // Output device 1, "fake-out-1": mono S16NE, 44.1 kHz only.
+  inline constexpr int c_num_devices = 2;
+
+  // Runs the write callback of the started stream for frame_count frames. Returns what it
+  //   wrote, interleaved and converted to float, or nothing if no stream is started.
+  std::vector<float> run_callback(int frame_count);
+
+  // Id of the device of the started stream, empty if there is none.
+  std::string get_started_device_id();
+
+  int get_num_open_streams();
+
+  // Makes output device index the default and reports a device change on the next
+  //   soundio_flush_events(), waking soundio_wait_events().
+  void set_default_device(int index);
+
+  // Reports err through the error callback of the started stream, as a backend would.
+  void fail_stream(int err);
+
+  // Number of soundio_wait_events() calls so far.
+  int get_num_event_waits();
+
+  // True while a thread is blocked in soundio_wait_events().
+  bool is_waiting_for_events();
+
+  // Makes soundio_flush_events() take this long, as a slow device scan would.
+  void set_flush_delay(int milliseconds);
+
+  // True while soundio_wait_events() flushes before it waits. A wakeup made then is lost.
+  bool is_flushing_before_wait();
+
+}
@@ -0,0 +1,87 @@
+//
+//  TestAudio.h
+//  AudioLibSwitcher_libsoundio
+//
+//  Signals and offline rendering shared by the test executables. Offline instances mix
+//    stereo float at c_rate in blocks of c_block_frames, with no device.
+//
+
+#pragma once
+#include "AudioLibSwitcher_libsoundio.h"
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+
+namespace test
+{
+
+  using audio::AudioLibSwitcher_libsoundio;
+
+  constexpr int c_rate = 48000;
+  constexpr int c_block_frames = 512;
+  constexpr double c_pi = 3.14159265358979323846;
+
+  inline std::vector<float> make_noise(size_t count, uint32_t seed, float amplitude = 1.f)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-amplitude, amplitude);
+    std::vector<float> samples(count);
+    for (auto& s : samples)
+      s = dist(rng);
+    return samples;
+  }
+
+  inline std::vector<short> make_sine(size_t num_samples, double frequency, int sample_rate, double amplitude = 8000.0)
+  {
+    std::vector<short> samples(num_samples);
+    for (size_t i = 0; i < num_samples; ++i)
+      samples[i] = static_cast<short>(std::lrint(amplitude * std::sin(2.0 * c_pi * frequency * i / sample_rate)));
+    return samples;
+  }
+
+  inline std::unique_ptr<AudioLibSwitcher_libsoundio> make_offline(size_t max_voices = 64)
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.offline = true;
+    params.sample_rate = c_rate;
+    params.max_voices = max_voices;
+    params.mix_block_frames = c_block_frames;
+    audio->init(params);
+    return audio;
+  }
+
+  // A looping source playing samples, not started.
+  inline unsigned int add_source(AudioLibSwitcher_libsoundio& audio, std::vector<short> samples, int sample_rate,
+                                 float volume = 1.f)
+  {
+    const unsigned int buf_id = audio.create_buffer();
+    audio.set_buffer_data_mono_16(buf_id, std::move(samples), sample_rate);
+    const unsigned int src_id = audio.create_source();
+    audio.attach_buffer_to_source(src_id, buf_id);
+    audio.set_source_looping(src_id, true);
+    audio.set_source_volume(src_id, volume);
+    return src_id;
+  }
+
+  // Interleaved stereo.
+  inline std::vector<float> render(AudioLibSwitcher_libsoundio& audio, int frame_count)
+  {
+    std::vector<float> out(static_cast<size_t>(frame_count) * 2);
+    audio.render(out.data(), frame_count);
+    return out;
+  }
+
+  inline double get_peak(const std::vector<float>& samples)
+  {
+    double peak = 0.0;
+    for (float s : samples)
+      peak = std::max(peak, static_cast<double>(std::abs(s)));
+    return peak;
+  }
+
+}
@@ -0,0 +1,98 @@
+//
+//  TestHarness.h
+//  AudioLibSwitcher_libsoundio
+//
+//  Minimal test registry shared by the CTest executables. CHECK and CHECK_NEAR report a
+//    failure and carry on; an exception ends the test it was thrown from. main() calls
+//    test::run(), which runs the tests whose names match the optional regex argument.
+//
+
+#pragma once
+#include <cstdio>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <regex>
+#include <string>
+#include <vector>
+
+
+namespace test
+{
+
+  struct Test
+  {
+    std::string name;
+    std::function<void()> func;
+  };
+
+  inline std::vector<Test>& get_registry()
+  {
+    static std::vector<Test> registry;
+    return registry;
+  }
+
+  inline int& get_num_failures()
+  {
+    static int num_failures = 0;
+    return num_failures;
+  }
+
+  inline void add(std::string name, std::function<void()> func)
+  {
+    get_registry().push_back({ std::move(name), std::move(func) });
+  }
+
+  inline void fail(const char* file, int line, const std::string& message)
+  {
+    std::printf("%s:%d: FAILED: %s\n", file, line, message.c_str());
+    get_num_failures()++;
+  }
+
+  inline void check_near(double actual, double expected, double tolerance, const char* expression,
+                         const char* file, int line)
+  {
+    if (std::abs(actual - expected) <= tolerance)
+      return;
+    char values[160];
+    std::snprintf(values, sizeof(values), " (%.9g vs %.9g, tolerance %.3g)", actual, expected, tolerance);
+    fail(file, line, expression + std::string(values));
+  }
+
+  // Returns the exit code for main().
+  inline int run(int argc, char** argv)
+  {
+    const std::regex pattern(argc > 1 ? argv[1] : ".");
+    int num_run = 0;
+    int num_failed = 0;
+    for (const auto& test : get_registry())
+    {
+      if (!std::regex_search(test.name, pattern))
+        continue;
+      std::printf("[ RUN    ] %s\n", test.name.c_str());
+      std::fflush(stdout);
+      const int failures_before = get_num_failures();
+      try
+      {
+        test.func();
+      }
+      catch (const std::exception& e)
+      {
+        fail(test.name.c_str(), 0, std::string("unexpected exception: ") + e.what());
+      }
+      const bool ok = get_num_failures() == failures_before;
+      std::printf("[ %s ] %s\n", ok ? "    OK" : "FAILED", test.name.c_str());
+      num_run++;
+      num_failed += ok ? 0 : 1;
+    }
+    std::printf("%d tests, %d failed\n", num_run, num_failed);
+    return num_run > 0 && num_failed == 0 ? 0 : 1;
+  }
+
+}
+
+#define CHECK(condition) \
+  ((condition) ? (void)0 : ::test::fail(__FILE__, __LINE__, #condition))
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+  ::test::check_near((actual), (expected), (tolerance), #actual " ~ " #expected, __FILE__, __LINE__)
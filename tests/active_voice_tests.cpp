@@ -0,0 +1,83 @@
+//
+//  active_voice_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  The packed active-voice table: the mix does not depend on the pool size, and voices that
+//    stop out of the middle of the table leave the others playing as they were.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+
+using namespace test;
+
+namespace
+{
+
+  // Plays the sources whose index is set in mask, each a sine of its own frequency.
+  std::vector<unsigned int> play_sines(AudioLibSwitcher_libsoundio& audio, int count, uint32_t mask = ~0u)
+  {
+    std::vector<unsigned int> src_ids;
+    for (int i = 0; i < count; ++i)
+    {
+      const auto src_id = add_source(audio, make_sine(c_rate, 200.0 + 50.0 * i, c_rate), c_rate, 0.1f);
+      if ((mask >> i) & 1)
+        audio.play_source(src_id);
+      src_ids.push_back(src_id);
+    }
+    return src_ids;
+  }
+
+  void register_active_voices()
+  {
+    test::add("active_voices/pool_size_does_not_change_the_mix", []
+    {
+      auto small = make_offline(16);
+      auto large = make_offline(4096);
+      play_sines(*small, 16);
+      play_sines(*large, 16);
+      const auto out_small = render(*small, 4096);
+      const auto out_large = render(*large, 4096);
+      CHECK(get_peak(out_small) > 0.1);
+      for (size_t i = 0; i < out_small.size(); ++i)
+        CHECK(out_small[i] == out_large[i]);
+      small->finish();
+      large->finish();
+    });
+
+    // Stopping voices 1, 4 and 6 of 8 compacts the table; the other five carry on exactly
+    //   as if they had been playing on their own.
+    test::add("active_voices/stop_from_the_middle", []
+    {
+      constexpr uint32_t c_kept = 0b10101101;
+      auto audio = make_offline();
+      auto reference = make_offline();
+      const auto src_ids = play_sines(*audio, 8);
+      play_sines(*reference, 8, c_kept);
+      render(*audio, 2048);
+      render(*reference, 2048);
+      for (int i = 0; i < 8; ++i)
+        if (!((c_kept >> i) & 1))
+          audio->stop_source(src_ids[i]);
+      // Past the stop ramps.
+      render(*audio, 2048);
+      render(*reference, 2048);
+      const auto out = render(*audio, 4096);
+      const auto expected = render(*reference, 4096);
+      CHECK(get_peak(expected) > 0.1);
+      for (size_t i = 0; i < out.size(); ++i)
+        CHECK_NEAR(out[i], expected[i], 1e-5);
+      for (int i = 0; i < 8; ++i)
+        CHECK(audio->is_source_playing(src_ids[i]) == (((c_kept >> i) & 1) != 0));
+      audio->finish();
+      reference->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_active_voices();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,75 @@
+//
+//  bus_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  Submix buses in offline renders: gain ramps keep the channels of a frame together, and
+//    what a bus lets go of is freed once the mixer is done with it, without waiting for
+//    another bus change.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+
+using namespace test;
+
+namespace
+{
+
+  void register_buses()
+  {
+    // The cleared reverb is retired with the command that stops the mixer using it, and the
+    //   next call that processes events frees it, as for the sources.
+    test::add("buses/cleared_reverb_is_released", []
+    {
+      auto audio = make_offline();
+      const auto src = add_source(*audio, make_sine(c_rate, 440.0, c_rate), c_rate);
+      const auto bus = audio->create_bus();
+      audio->set_source_bus(src, bus);
+      audio->play_source(src);
+
+      std::weak_ptr<const audio::ImpulseResponse> released;
+      {
+        const std::vector<float> taps { 1.f, 0.5f, 0.25f, 0.125f };
+        auto ir = audio::make_impulse_response(taps, 1);
+        released = ir;
+        audio->set_bus_reverb(bus, 0, std::move(ir), 0.5f);
+      }
+      render(*audio, c_block_frames);
+      CHECK(!released.expired());
+
+      audio->clear_bus_effect(bus, 0);
+      CHECK(!released.expired());
+      render(*audio, c_block_frames);
+      CHECK(audio->is_source_playing(src));
+      CHECK(released.expired());
+      audio->finish();
+    });
+
+    // A centred mono source stays centred while the bus gain ramps: both channels of a frame
+    //   get the same gain, on the way into the master bus and on the master bus itself.
+    test::add("buses/gain_ramp_keeps_balance", []
+    {
+      auto audio = make_offline();
+      const auto src = add_source(*audio, make_sine(c_rate, 440.0, c_rate), c_rate);
+      const auto bus = audio->create_bus();
+      audio->set_source_bus(src, bus);
+      audio->play_source(src);
+      render(*audio, c_block_frames);
+
+      audio->set_bus_gain(bus, 0.25f);
+      audio->set_bus_gain(AudioLibSwitcher_libsoundio::c_master_bus, 0.5f);
+      const auto out = render(*audio, c_block_frames);
+      CHECK(get_peak(out) > 0.01);
+      for (size_t f = 0; f < out.size() / 2; ++f)
+        CHECK_NEAR(out[2 * f], out[2 * f + 1], 1e-7);
+      audio->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_buses();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,164 @@
+//
+//  device_switch_test.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  Moves playback between two distinct output devices of the fake backend, stereo float at
+//    48 kHz and mono 16-bit at 44.1 kHz, and checks that voices carry on where they were:
+//    same position, volume and looping. The callbacks run on the test thread, so positions
+//    are exact to the frame.
+//
+
+#include "TestHarness.h"
+#include "FakeSoundio.h"
+#include "AudioLibSwitcher_libsoundio.h"
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+using audio::AudioLibSwitcher_libsoundio;
+
+namespace
+{
+
+  constexpr int c_buffer_rate = 48000;
+  // One second of 0.5 full scale, so the output level is the gain.
+  constexpr int c_buffer_frames = c_buffer_rate;
+  constexpr short c_level = 16384;
+  constexpr float c_volume = 0.5f;
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_audio(const std::string& device_id)
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.backend = SoundIoBackendDummy;
+    params.device_id = device_id;
+    params.event_thread = false;
+    audio->init(params);
+    return audio;
+  }
+
+  unsigned int play_looping(AudioLibSwitcher_libsoundio& audio, float volume)
+  {
+    const auto buf_id = audio.create_buffer();
+    audio.set_buffer_data_mono_16(buf_id, std::vector<short>(c_buffer_frames, c_level), c_buffer_rate);
+    const auto src_id = audio.create_source();
+    audio.attach_buffer_to_source(src_id, buf_id);
+    audio.set_source_looping(src_id, true);
+    audio.set_source_volume(src_id, volume);
+    audio.play_source(src_id);
+    return src_id;
+  }
+
+  // Runs seconds worth of device periods of period_frames and returns the last one.
+  std::vector<float> run_for(double seconds, int sample_rate, int period_frames)
+  {
+    std::vector<float> last;
+    const int num_periods = static_cast<int>(std::lround(seconds * sample_rate / period_frames));
+    for (int i = 0; i < num_periods; ++i)
+      last = fake_soundio::run_callback(period_frames);
+    return last;
+  }
+
+  double get_mean(const std::vector<float>& samples)
+  {
+    double sum = 0.0;
+    for (float s : samples)
+      sum += s;
+    return samples.empty() ? 0.0 : sum / samples.size();
+  }
+
+  // Settled output level of a source at c_volume started right on device_id.
+  double get_reference_level(const std::string& device_id, int sample_rate, int period_frames)
+  {
+    auto audio = make_audio(device_id);
+    play_looping(*audio, c_volume);
+    const double level = get_mean(run_for(0.2, sample_rate, period_frames));
+    audio->finish();
+    return level;
+  }
+
+  void register_switch()
+  {
+    test::add("device_switch/keeps_position_volume_and_looping", []
+    {
+      const double stereo_level = get_reference_level("fake-out-0", 48000, 480);
+      const double mono_level = get_reference_level("fake-out-1", 44100, 441);
+      CHECK(stereo_level > 0.01 && mono_level > 0.01);
+
+      auto audio = make_audio("fake-out-0");
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-0");
+      const auto src_id = play_looping(*audio, c_volume);
+
+      run_for(0.5, 48000, 480);
+      const auto before = audio->get_source_position(src_id);
+      CHECK(before.is_valid);
+      CHECK_NEAR(before.seconds, 0.5, 1e-6);
+      const uint64_t frame_before = audio->get_device_frame();
+
+      audio->select_output_device("fake-out-1");
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-1");
+      CHECK(fake_soundio::get_num_open_streams() == 1);
+      CHECK(audio->get_mix_sample_rate() == 44100);
+      CHECK(audio->is_source_playing(src_id));
+      // Nothing mixed yet on the new device: the source has not moved.
+      CHECK_NEAR(audio->get_source_position(src_id).seconds, 0.5, 1e-6);
+
+      // 0.2 s more at 44.1 kHz continue from 0.5 s of the buffer.
+      auto out = run_for(0.2, 44100, 441);
+      auto after = audio->get_source_position(src_id);
+      CHECK(after.is_valid);
+      CHECK_NEAR(after.seconds, 0.7, 1e-4);
+      CHECK(audio->get_device_frame() == frame_before + 8820);
+      CHECK(out.size() == 441);
+      CHECK_NEAR(get_mean(out), mono_level, 1e-3);
+
+      // Past the end of the one second buffer: still looping.
+      out = run_for(0.4, 44100, 441);
+      after = audio->get_source_position(src_id);
+      CHECK(audio->is_source_playing(src_id));
+      CHECK_NEAR(after.seconds, 0.1, 1e-4);
+      CHECK_NEAR(get_mean(out), mono_level, 1e-3);
+
+      // And back, with a change of volume made while on the other device.
+      audio->set_source_volume(src_id, 2.f * c_volume);
+      audio->select_output_device("fake-out-0");
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-0");
+      CHECK(audio->get_mix_sample_rate() == 48000);
+      out = run_for(0.2, 48000, 480);
+      CHECK_NEAR(audio->get_source_position(src_id).seconds, 0.3, 1e-4);
+      CHECK(out.size() == 2 * 480);
+      CHECK_NEAR(get_mean(out), 2.0 * stereo_level, 1e-3);
+
+      CHECK(audio->get_num_device_switches() == 2);
+      CHECK(audio->check_error().empty());
+      audio->finish();
+      CHECK(fake_soundio::get_num_open_streams() == 0);
+    });
+
+    // With no device named, playback follows the default device.
+    test::add("device_switch/follows_default", []
+    {
+      fake_soundio::set_default_device(0);
+      auto audio = make_audio("");
+      const auto src_id = play_looping(*audio, c_volume);
+      run_for(0.25, 48000, 480);
+
+      fake_soundio::set_default_device(1);
+      audio->poll_device_events();
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-1");
+      run_for(0.25, 44100, 441);
+      CHECK(audio->is_source_playing(src_id));
+      CHECK_NEAR(audio->get_source_position(src_id).seconds, 0.5, 1e-4);
+      audio->finish();
+      fake_soundio::set_default_device(0);
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_switch();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,170 @@
+//
+//  event_thread_test.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  The event thread on the fake backend, which blocks in soundio_wait_events() and loses
+//    wakeups made while nobody waits, like libsoundio. The thread must stay idle in its
+//    wait, and a failed stream, a device request, a change of the default device and
+//    finish() must each get it out.
+//
+
+#include "TestHarness.h"
+#include "FakeSoundio.h"
+#include "AudioLibSwitcher_libsoundio.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using audio::AudioLibSwitcher_libsoundio;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_audio(const std::string& device_id, size_t command_queue_capacity = 4096)
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.backend = SoundIoBackendDummy;
+    params.device_id = device_id;
+    params.command_queue_capacity = command_queue_capacity;
+    audio->init(params);
+    return audio;
+  }
+
+  // Waits up to a second for condition. Returns whether it came true.
+  bool wait_until(const std::function<bool()>& condition)
+  {
+    const auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (!condition())
+    {
+      if (Clock::now() > deadline)
+        return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+
+  void register_events()
+  {
+    // Nothing happens, so the thread stays in its one soundio_wait_events() call.
+    test::add("events/idle_until_woken", []
+    {
+      auto audio = make_audio("fake-out-0");
+      CHECK(wait_until(fake_soundio::is_waiting_for_events));
+      const int num_waits = fake_soundio::get_num_event_waits();
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+      CHECK(fake_soundio::is_waiting_for_events());
+      CHECK(fake_soundio::get_num_event_waits() == num_waits);
+      audio->finish();
+    });
+
+    // Whether the thread is waiting or still busy when finish() wakes it.
+    test::add("events/finish_is_prompt", []
+    {
+      for (int i = 0; i < 50; ++i)
+      {
+        auto audio = make_audio("fake-out-0");
+        if (i % 2 == 0)
+          wait_until(fake_soundio::is_waiting_for_events);
+        const auto start = Clock::now();
+        audio->finish();
+        CHECK(Clock::now() - start < std::chrono::milliseconds(500));
+        CHECK(!fake_soundio::is_waiting_for_events());
+      }
+    });
+
+    // finish() while soundio_wait_events() scans devices before its wait, which loses a
+    //   single wakeup.
+    test::add("events/finish_during_flush", []
+    {
+      auto audio = make_audio("fake-out-0");
+      CHECK(wait_until(fake_soundio::is_waiting_for_events));
+      fake_soundio::set_flush_delay(100);
+      fake_soundio::set_default_device(1);
+      CHECK(wait_until(fake_soundio::is_flushing_before_wait));
+      const auto start = Clock::now();
+      audio->finish();
+      CHECK(Clock::now() - start < std::chrono::milliseconds(500));
+      fake_soundio::set_flush_delay(0);
+      fake_soundio::set_default_device(0);
+    });
+
+    test::add("events/failed_stream_is_replaced", []
+    {
+      auto audio = make_audio("fake-out-0");
+      CHECK(wait_until(fake_soundio::is_waiting_for_events));
+      fake_soundio::fail_stream(SoundIoErrorStreaming);
+      CHECK(wait_until([&] { return audio->get_num_device_switches() == 1; }));
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-0");
+      CHECK(wait_until([] { return fake_soundio::get_num_open_streams() == 1; }));
+      CHECK(!audio->get_output_stats().failed);
+      audio->finish();
+    });
+
+    test::add("events/select_output_device", []
+    {
+      auto audio = make_audio("fake-out-0");
+      CHECK(wait_until(fake_soundio::is_waiting_for_events));
+      audio->select_output_device("fake-out-1");
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-1");
+      CHECK(audio->get_mix_sample_rate() == 44100);
+      // Straight after init, before the thread has reached its first wait.
+      audio->finish();
+      audio = make_audio("fake-out-0");
+      audio->select_output_device("fake-out-1");
+      CHECK(fake_soundio::get_started_device_id() == "fake-out-1");
+      audio->finish();
+    });
+
+    // More commands than the queue holds and no more posted after them: each callback
+    //   makes room and wakes the thread to move the rest on.
+    test::add("events/overflow_moved_on", []
+    {
+      constexpr int c_num_commands = 200;
+      auto audio = make_audio("fake-out-0", 64);
+      const auto buf_id = audio->create_buffer();
+      audio->set_buffer_data_mono_16(buf_id, std::vector<short>(4800, 8192), 48000);
+      const auto src_id = audio->create_source();
+      audio->attach_buffer_to_source(src_id, buf_id);
+      audio->set_source_looping(src_id, true);
+      audio->play_source(src_id);
+      fake_soundio::run_callback(480);
+      const uint64_t num_before = audio->get_command_latency_stats().num_commands;
+
+      for (int i = 1; i <= c_num_commands; ++i)
+        audio->set_source_volume(src_id, i / static_cast<float>(c_num_commands));
+      CHECK(audio->get_command_latency_stats().num_deferred_commands > 0);
+      CHECK(wait_until([&]
+      {
+        fake_soundio::run_callback(480);
+        return audio->get_command_latency_stats().num_commands == num_before + c_num_commands;
+      }));
+      const auto stats = audio->get_command_latency_stats();
+      // Counted from when a command got into the queue, not from when it was posted.
+      CHECK(stats.max_periods <= 1);
+      CHECK(stats.max_deferred_periods > 0);
+      audio->finish();
+    });
+
+    test::add("events/follows_default", []
+    {
+      fake_soundio::set_default_device(0);
+      auto audio = make_audio("");
+      CHECK(wait_until(fake_soundio::is_waiting_for_events));
+      fake_soundio::set_default_device(1);
+      CHECK(wait_until([] { return fake_soundio::get_started_device_id() == "fake-out-1"; }));
+      audio->finish();
+      fake_soundio::set_default_device(0);
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_events();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,344 @@
+//
+//  golden_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  Offline render regressions. Each scene is rendered to a buffer and compared against a
+//    32-bit float WAVE file checked in under tests/golden. Offline output is bit-exact from
+//    run to run; the tolerance only absorbs the rounding differences between the scalar,
+//    SSE and AVX2 kernels and between compilers.
+//
+//  Usage: golden_tests <golden dir> [--update] [filter]
+//    --update rewrites the references from the current output instead of comparing. Listen
+//    to the new files before committing them.
+//
+
+#include "TestHarness.h"
+#include "AudioLibSwitcher_libsoundio.h"
+#include "WavWriter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+using audio::AudioLibSwitcher_libsoundio;
+
+namespace
+{
+
+  constexpr int c_rate = 48000;
+  constexpr int c_block_frames = 256;
+  // Renders are split into chunks of this many frames, not a multiple of the block size,
+  //   so that commands land between render() calls in the middle of a block.
+  constexpr int c_render_chunk_frames = 1000;
+  constexpr int c_scene_frames = 12000;
+  constexpr float c_tolerance = 1e-5f;
+  constexpr double c_pi = 3.14159265358979323846;
+
+  std::string g_golden_dir;
+  bool g_update = false;
+
+  std::vector<short> make_sine(size_t num_samples, double frequency, int sample_rate, double amplitude)
+  {
+    std::vector<short> samples(num_samples);
+    for (size_t i = 0; i < num_samples; ++i)
+      samples[i] = static_cast<short>(std::lrint(amplitude * std::sin(2.0 * c_pi * frequency * i / sample_rate)));
+    return samples;
+  }
+
+  // Deterministic across platforms, unlike the standard distributions.
+  std::vector<short> make_noise(size_t num_samples, uint32_t seed, int amplitude)
+  {
+    std::vector<short> samples(num_samples);
+    for (auto& s : samples)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      s = static_cast<short>(static_cast<int>(seed >> 16) % (2 * amplitude + 1) - amplitude);
+    }
+    return samples;
+  }
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_offline(size_t command_queue_capacity = 4096)
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.offline = true;
+    params.sample_rate = c_rate;
+    params.mix_block_frames = c_block_frames;
+    params.command_queue_capacity = command_queue_capacity;
+    audio->init(params);
+    return audio;
+  }
+
+  unsigned int add_source(AudioLibSwitcher_libsoundio& audio, std::vector<short> samples, int sample_rate,
+                          bool looping = true)
+  {
+    const unsigned int buf_id = audio.create_buffer();
+    audio.set_buffer_data_mono_16(buf_id, std::move(samples), sample_rate);
+    const unsigned int src_id = audio.create_source();
+    audio.attach_buffer_to_source(src_id, buf_id);
+    audio.set_source_looping(src_id, looping);
+    return src_id;
+  }
+
+  // Renders c_scene_frames of interleaved stereo. at_chunk(index) runs before each chunk,
+  //   so a scene can change things as it plays.
+  std::vector<float> render_scene(AudioLibSwitcher_libsoundio& audio, const std::function<void(int)>& at_chunk = {})
+  {
+    std::vector<float> out(2 * static_cast<size_t>(c_scene_frames));
+    for (int frame = 0, chunk = 0; frame < c_scene_frames; frame += c_render_chunk_frames, ++chunk)
+    {
+      if (at_chunk)
+        at_chunk(chunk);
+      audio.render(out.data() + 2 * frame, std::min(c_render_chunk_frames, c_scene_frames - frame));
+    }
+    return out;
+  }
+
+  bool read_reference(const std::string& path, std::vector<float>& samples)
+  {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+      return false;
+    std::vector<unsigned char> bytes;
+    unsigned char chunk[4096];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0; )
+      bytes.insert(bytes.end(), chunk, chunk + n);
+    std::fclose(file);
+
+    auto read_u32 = [&](size_t pos) { uint32_t v; std::memcpy(&v, bytes.data() + pos, 4); return v; };
+    auto read_u16 = [&](size_t pos) { uint16_t v; std::memcpy(&v, bytes.data() + pos, 2); return v; };
+    if (bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 || std::memcmp(bytes.data() + 8, "WAVE", 4) != 0)
+      return false;
+    bool is_stereo_float = false;
+    for (size_t pos = 12; pos + 8 <= bytes.size(); )
+    {
+      const uint32_t size = read_u32(pos + 4);
+      if (pos + 8 + size > bytes.size())
+        return false;
+      if (std::memcmp(bytes.data() + pos, "fmt ", 4) == 0 && size >= 16)
+        is_stereo_float = read_u16(pos + 8) == 3 && read_u16(pos + 10) == 2
+                          && read_u32(pos + 12) == c_rate && read_u16(pos + 22) == 32;
+      else if (std::memcmp(bytes.data() + pos, "data", 4) == 0 && is_stereo_float)
+      {
+        samples.resize(size / sizeof(float));
+        std::memcpy(samples.data(), bytes.data() + pos + 8, samples.size() * sizeof(float));
+        return true;
+      }
+      pos += 8 + size + (size & 1);
+    }
+    return false;
+  }
+
+  // Compares output with tests/golden/<name>.wav, or writes that file in update mode.
+  void check_golden(const std::string& name, const std::vector<float>& output)
+  {
+    const std::string path = g_golden_dir + "/" + name + ".wav";
+    if (g_update)
+    {
+      audio::WavWriter writer(path, c_rate, 2, audio::SampleType::F32);
+      writer.write(output.data(), static_cast<int>(output.size() / 2));
+      writer.close();
+      std::printf("Wrote %s\n", path.c_str());
+      return;
+    }
+
+    std::vector<float> reference;
+    if (!read_reference(path, reference))
+    {
+      test::fail(__FILE__, __LINE__, "missing or unreadable reference " + path + ", run with --update");
+      return;
+    }
+    CHECK(reference.size() == output.size());
+    const size_t count = std::min(reference.size(), output.size());
+    size_t first_mismatch = count;
+    float max_error = 0.f;
+    for (size_t i = 0; i < count; ++i)
+    {
+      // The reference went through WavWriter, which clips like a device.
+      const float error = std::abs(std::clamp(output[i], -1.f, 1.f) - reference[i]);
+      if (error > c_tolerance && first_mismatch == count)
+        first_mismatch = i;
+      max_error = std::max(max_error, error);
+    }
+    if (first_mismatch != count)
+      test::fail(__FILE__, __LINE__, name + " differs from its reference from frame " + std::to_string(first_mismatch / 2)
+                 + ", max error " + std::to_string(max_error));
+  }
+
+  void register_scenes()
+  {
+    // Two sources with different volumes and pans, one changing volume as it plays.
+    test::add("golden/mix_pan_volume", []
+    {
+      auto audio = make_offline();
+      const auto low = add_source(*audio, make_sine(c_rate, 220.0, c_rate, 8000.0), c_rate);
+      const auto high = add_source(*audio, make_sine(c_rate, 1250.0, c_rate, 6000.0), c_rate);
+      audio->set_source_pan(low, -0.6f);
+      audio->set_source_pan(high, 0.8f);
+      audio->set_source_volume(high, 0.7f);
+      audio->play_sources_at({ low, high });
+      check_golden("mix_pan_volume", render_scene(*audio, [&](int chunk)
+      {
+        if (chunk == 4)
+          audio->set_source_volume(low, 0.25f);
+        if (chunk == 8)
+          audio->set_source_pan(high, -0.2f);
+      }));
+      audio->finish();
+    });
+
+    // A 44.1 kHz buffer at a pitch of 1.3 through each resampler, one per scene.
+    const std::pair<const char*, audio::ResamplerQuality> qualities[] =
+    {
+      { "resample_linear", audio::ResamplerQuality::Linear },
+      { "resample_cubic", audio::ResamplerQuality::Cubic },
+      { "resample_sinc", audio::ResamplerQuality::Sinc },
+    };
+    for (const auto& [name, quality] : qualities)
+      test::add(std::string("golden/") + name, [name, quality]
+      {
+        auto audio = make_offline();
+        const auto src = add_source(*audio, make_sine(44100, 3000.0, 44100, 10000.0), 44100);
+        audio->set_source_resampler_quality(src, quality);
+        audio->set_source_pitch(src, 1.3f);
+        audio->play_source(src);
+        check_golden(name, render_scene(*audio));
+        audio->finish();
+      });
+
+    // A fade-in, a crossfade to a second source and a fade-out that stops it.
+    test::add("golden/fades", []
+    {
+      auto audio = make_offline();
+      const auto first = add_source(*audio, make_sine(c_rate, 440.0, c_rate, 9000.0), c_rate);
+      const auto second = add_source(*audio, make_sine(c_rate, 660.0, c_rate, 9000.0), c_rate);
+      audio->play_source_fade_in(first, 0.05f);
+      check_golden("fades", render_scene(*audio, [&](int chunk)
+      {
+        if (chunk == 4)
+          audio->crossfade_sources(first, second, 0.04f);
+        if (chunk == 8)
+          audio->fade_out_source(second, 0.03f, audio::FadeCurve::Exponential);
+      }));
+      CHECK(!audio->is_source_playing(first));
+      CHECK(!audio->is_source_playing(second));
+      audio->finish();
+    });
+
+    // Noise through a source filter into a bus with its own filter, gain and a send.
+    test::add("golden/filters_and_buses", []
+    {
+      auto audio = make_offline();
+      const auto noise = add_source(*audio, make_noise(c_rate, 7, 6000), c_rate);
+      const auto tone = add_source(*audio, make_sine(c_rate, 330.0, c_rate, 5000.0), c_rate);
+      const auto bus = audio->create_bus();
+      const auto send_bus = audio->create_bus();
+      audio->set_source_bus(noise, bus);
+      audio->set_source_bus(tone, bus);
+      audio->set_source_filter(noise, 0, audio::FilterType::LowPass, 2000.f);
+      audio->set_bus_filter(bus, 0, audio::FilterType::HighShelf, 4000.f, audio::c_butterworth_q, -6.f);
+      audio->set_bus_gain(bus, 0.8f);
+      audio->set_bus_filter(send_bus, 0, audio::FilterType::BandPass, 1000.f, 2.f);
+      audio->set_bus_send(bus, send_bus, 0.5f);
+      audio->play_sources_at({ noise, tone });
+      check_golden("filters_and_buses", render_scene(*audio, [&](int chunk)
+      {
+        // Parameter changes keep the filter state.
+        if (chunk == 6)
+          audio->set_source_filter(noise, 0, audio::FilterType::LowPass, 800.f);
+      }));
+      audio->finish();
+    });
+
+    // A short decaying impulse response on a source, long enough to span several partitions.
+    test::add("golden/reverb", []
+    {
+      auto audio = make_offline();
+      std::vector<float> ir(2048);
+      const auto noise = make_noise(ir.size(), 11, 1000);
+      for (size_t i = 0; i < ir.size(); ++i)
+        ir[i] = noise[i] / 1000.f * 0.3f * std::exp(-static_cast<float>(i) / 400.f);
+      ir[0] = 1.f;
+      const auto src = add_source(*audio, make_sine(c_rate / 8, 500.0, c_rate, 12000.0), c_rate, false);
+      audio->set_source_reverb(src, 0, audio::make_impulse_response(ir, 1), 0.5f, 0.8f);
+      audio->play_source(src);
+      check_golden("reverb", render_scene(*audio));
+      audio->finish();
+    });
+
+    // Starts and stops on exact device frames, inside mix blocks.
+    test::add("golden/scheduled", []
+    {
+      auto audio = make_offline();
+      const auto a = add_source(*audio, make_sine(c_rate, 750.0, c_rate, 7000.0), c_rate);
+      const auto b = add_source(*audio, make_sine(c_rate, 1500.0, c_rate, 7000.0), c_rate);
+      audio->play_source_at(a, 1234);
+      audio->stop_source_at(a, 7777);
+      audio->play_source_at(b, 5001);
+      check_golden("scheduled", render_scene(*audio));
+      CHECK(!audio->is_source_playing(a));
+      CHECK(audio->is_source_playing(b));
+      audio->finish();
+    });
+  }
+
+  void register_commands()
+  {
+    // More commands between two render() calls than the queue holds: the rest wait on the
+    //   API side, render() drains them in order instead of deadlocking, and the last one wins.
+    test::add("commands/overflow_between_renders", []
+    {
+      constexpr int c_num_commands = 1000;
+      auto reference = make_offline();
+      const auto ref_src = add_source(*reference, make_sine(c_rate, 440.0, c_rate, 8000.0), c_rate);
+      reference->play_source(ref_src);
+      const auto expected = render_scene(*reference, [&](int chunk)
+      {
+        if (chunk == 2)
+          reference->set_source_volume(ref_src, 0.5f);
+      });
+      reference->finish();
+
+      auto audio = make_offline(64);
+      const auto src = add_source(*audio, make_sine(c_rate, 440.0, c_rate, 8000.0), c_rate);
+      audio->play_source(src);
+      const auto output = render_scene(*audio, [&](int chunk)
+      {
+        if (chunk == 2)
+          for (int i = 1; i <= c_num_commands; ++i)
+            audio->set_source_volume(src, i == c_num_commands ? 0.5f : i / static_cast<float>(c_num_commands));
+      });
+      CHECK(audio->get_command_latency_stats().num_deferred_commands > 0);
+      CHECK(audio->is_source_playing(src));
+      CHECK(output == expected);
+      audio->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "Usage: %s <golden dir> [--update] [filter]\n", argv[0]);
+    return 2;
+  }
+  g_golden_dir = argv[1];
+  std::vector<char*> args = { argv[0] };
+  for (int i = 2; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--update") == 0)
+      g_update = true;
+    else
+      args.push_back(argv[i]);
+  }
+
+  register_scenes();
+  register_commands();
+  return test::run(static_cast<int>(args.size()), args.data());
+}
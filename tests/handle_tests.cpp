@@ -0,0 +1,96 @@
+//
+//  handle_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  Generational handles: stale source and buffer ids are detected instead of reaching
+//    whatever reuses their slot, and live handles survive any amount of churn.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+
+using namespace test;
+
+namespace
+{
+
+  void register_handles()
+  {
+    test::add("handles/slot_map_stale", []
+    {
+      audio::SlotMap<int> map;
+      const auto a = map.insert(1);
+      const auto b = map.insert(2);
+      CHECK(map.erase(a));
+      CHECK(!map.erase(a));
+      const auto c = map.insert(3);
+      CHECK(map.get(a) == nullptr);
+      CHECK(c != a);
+      CHECK(map.get(b) != nullptr && *map.get(b) == 2);
+      CHECK(map.get(c) != nullptr && *map.get(c) == 3);
+      CHECK(map.size() == 2);
+    });
+
+    // Handles, unlike pointers, stay valid while the storage grows and slots are recycled.
+    test::add("handles/slot_map_churn", []
+    {
+      audio::SlotMap<int> map;
+      std::vector<audio::SlotMap<int>::Handle> kept;
+      for (int i = 0; i < 1000; ++i)
+        kept.push_back(map.insert(i));
+      for (int round = 0; round < 50; ++round)
+      {
+        std::vector<audio::SlotMap<int>::Handle> temporary;
+        for (int i = 0; i < 200; ++i)
+          temporary.push_back(map.insert(-1));
+        for (auto handle : temporary)
+          CHECK(map.erase(handle));
+        for (auto handle : temporary)
+          CHECK(map.get(handle) == nullptr);
+      }
+      CHECK(map.size() == kept.size());
+      for (int i = 0; i < 1000; ++i)
+        CHECK(map.get(kept[i]) != nullptr && *map.get(kept[i]) == i);
+    });
+
+    // A destroyed source's id must not reach whichever source reuses its slot.
+    test::add("handles/stale_source_id", []
+    {
+      auto audio = make_offline();
+      const auto stale = audio->create_source();
+      audio->destroy_source(stale);
+      const auto src_id = add_source(*audio, make_sine(c_rate, 440.0, c_rate), c_rate, 0.5f);
+      CHECK(src_id != stale);
+      audio->play_source(src_id);
+      const auto before = render(*audio, 2048);
+      audio->set_source_volume(stale, 0.f);
+      audio->stop_source(stale);
+      audio->destroy_source(stale);
+      CHECK(audio->is_source_playing(src_id));
+      CHECK(!audio->is_source_playing(stale));
+      CHECK_NEAR(get_peak(render(*audio, 2048)), get_peak(before), 1e-3);
+      audio->finish();
+    });
+
+    test::add("handles/stale_buffer_id", []
+    {
+      auto audio = make_offline();
+      const auto stale = audio->create_buffer();
+      audio->destroy_buffer(stale);
+      const auto buf_id = audio->create_buffer();
+      CHECK(buf_id != stale);
+      audio->set_buffer_data_mono_16(buf_id, make_sine(1000, 440.0, c_rate), c_rate);
+      audio->destroy_buffer(stale);
+      CHECK(audio->get_buffer_resident_bytes(buf_id) == 1000 * sizeof(short));
+      CHECK(audio->get_buffer_resident_bytes(stale) == 0);
+      audio->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_handles();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,184 @@
+//
+//  kernel_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  The SIMD sample kernels against their scalar references, at lengths around the vector
+//    widths so every kernel runs both its vector loop and its scalar tail.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+
+using namespace test;
+namespace kernels = audio::kernels;
+
+namespace
+{
+
+  const int c_lengths[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 127, 1027 };
+
+  void register_kernels()
+  {
+    test::add("kernels/convert_s16_to_f32", []
+    {
+      for (int n : c_lengths)
+      {
+        std::vector<int16_t> src(n);
+        for (int i = 0; i < n; ++i)
+          src[i] = static_cast<int16_t>(i * 977 - 32768);
+        std::vector<float> dst(n);
+        kernels::convert_s16_to_f32(src.data(), dst.data(), n, 0.5f / 32768.f);
+        for (int i = 0; i < n; ++i)
+          CHECK(dst[i] == src[i] * (0.5f / 32768.f));
+      }
+    });
+
+    test::add("kernels/convert_f32_to_s16", []
+    {
+      for (int n : c_lengths)
+      {
+        auto src = make_noise(n, 1, 1.5f);
+        std::vector<int16_t> dst(n);
+        kernels::convert_f32_to_s16(src.data(), dst.data(), n);
+        for (int i = 0; i < n; ++i)
+          CHECK(dst[i] == static_cast<int16_t>(std::lrint(std::clamp(src[i], -1.f, 1.f) * 32767.f)));
+      }
+    });
+
+    test::add("kernels/convert_f32_to_s32", []
+    {
+      for (int n : c_lengths)
+      {
+        auto src = make_noise(n, 2, 1.5f);
+        std::vector<int32_t> dst(n);
+        kernels::convert_f32_to_s32(src.data(), dst.data(), n);
+        for (int i = 0; i < n; ++i)
+          CHECK(dst[i] == static_cast<int32_t>(std::lrint(std::clamp(src[i], -1.f, 1.f) * 2147483520.f)));
+      }
+    });
+
+    test::add("kernels/convert_f32_to_f32_and_f64", []
+    {
+      for (int n : c_lengths)
+      {
+        auto src = make_noise(n, 3, 1.5f);
+        std::vector<float> f32(n);
+        std::vector<double> f64(n);
+        kernels::convert_f32_to_f32(src.data(), f32.data(), n);
+        kernels::convert_f32_to_f64(src.data(), f64.data(), n);
+        for (int i = 0; i < n; ++i)
+        {
+          CHECK(f32[i] == std::clamp(src[i], -1.f, 1.f));
+          CHECK(f64[i] == std::clamp(src[i], -1.f, 1.f));
+        }
+      }
+    });
+
+    test::add("kernels/deinterleave_s16_to_f32", []
+    {
+      for (int channels : { 1, 2, 3, 6, 8 })
+        for (int n : c_lengths)
+        {
+          std::vector<int16_t> src(static_cast<size_t>(n) * channels);
+          for (size_t i = 0; i < src.size(); ++i)
+            src[i] = static_cast<int16_t>(i * 331 % 65536 - 32768);
+          const int stride = n + 3;
+          std::vector<float> dst(static_cast<size_t>(stride) * channels, -7.f);
+          kernels::deinterleave_s16_to_f32(src.data(), channels, dst.data(), stride, n, 1.f / 32768.f);
+          for (int c = 0; c < channels; ++c)
+          {
+            for (int f = 0; f < n; ++f)
+              CHECK(dst[c * stride + f] == src[f * channels + c] * (1.f / 32768.f));
+            for (int f = n; f < stride; ++f)
+              CHECK(dst[c * stride + f] == -7.f);
+          }
+        }
+    });
+
+    test::add("kernels/mix_mono_to_interleaved", []
+    {
+      for (int channels : { 1, 2, 6, 8 })
+        for (int n : c_lengths)
+        {
+          auto src = make_noise(n, 4);
+          auto bus = make_noise(static_cast<size_t>(n) * channels, 5);
+          auto expected = bus;
+          kernels::mix_mono_to_interleaved_scalar(src.data(), expected.data(), n, channels, 0.7f);
+          kernels::mix_mono_to_interleaved(src.data(), bus.data(), n, channels, 0.7f);
+          for (size_t i = 0; i < bus.size(); ++i)
+            CHECK_NEAR(bus[i], expected[i], 1e-6);
+        }
+    });
+
+    test::add("kernels/gain_ramps", []
+    {
+      const float gain0[8] = { 0.1f, 0.9f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f };
+      const float gain1[8] = { 0.8f, 0.2f, 0.3f, 0.1f, 0.0f, 1.0f, 0.5f, 0.25f };
+      for (int n : c_lengths)
+      {
+        auto src = make_noise(n, 6);
+        auto right = make_noise(n, 7);
+
+        // Interleaved ramps step once per frame, so the channels of a frame keep their balance.
+        for (int channels : { 1, 2, 3, 6 })
+        {
+          const auto block = make_noise(static_cast<size_t>(n) * channels, 11);
+          auto ramp = block;
+          kernels::apply_gain_ramp(ramp.data(), n, channels, 0.2f, 0.9f);
+          auto mixed = make_noise(block.size(), 8);
+          auto mixed_expected = mixed;
+          kernels::mix_gain_ramp(block.data(), mixed.data(), n, channels, 1.f, 0.5f);
+          for (size_t i = 0; i < block.size(); ++i)
+          {
+            const int f = static_cast<int>(i) / channels;
+            CHECK_NEAR(ramp[i], block[i] * (0.2f + (0.9f - 0.2f) * f / n), 1e-6);
+            CHECK_NEAR(mixed[i], mixed_expected[i] + block[i] * (1.f + (0.5f - 1.f) * f / n), 1e-6);
+          }
+        }
+
+        for (int channels : { 1, 2, 6, 8 })
+        {
+          auto bus = make_noise(static_cast<size_t>(n) * channels, 9);
+          auto expected = bus;
+          kernels::mix_mono_to_interleaved_ramp_scalar(src.data(), expected.data(), n, channels, gain0, gain1);
+          kernels::mix_mono_to_interleaved_ramp(src.data(), bus.data(), n, channels, gain0, gain1);
+          for (size_t i = 0; i < bus.size(); ++i)
+            CHECK_NEAR(bus[i], expected[i], 1e-6);
+        }
+
+        auto bus = make_noise(static_cast<size_t>(n) * 2, 10);
+        auto expected = bus;
+        for (int f = 0; f < n; ++f)
+        {
+          expected[2 * f] += src[f] * (gain0[0] + (gain1[0] - gain0[0]) * f / n);
+          expected[2 * f + 1] += right[f] * (gain0[1] + (gain1[1] - gain0[1]) * f / n);
+        }
+        kernels::mix_stereo_to_stereo_ramp(src.data(), right.data(), bus.data(), n, gain0, gain1);
+        for (size_t i = 0; i < bus.size(); ++i)
+          CHECK_NEAR(bus[i], expected[i], 1e-6);
+      }
+    });
+
+    test::add("kernels/mulaw", []
+    {
+      std::vector<uint8_t> codes(256 + 7);
+      for (size_t i = 0; i < codes.size(); ++i)
+        codes[i] = static_cast<uint8_t>(i * 37);
+      for (int n : c_lengths)
+      {
+        const int count = std::min<int>(n, static_cast<int>(codes.size()));
+        std::vector<float> dst(count);
+        kernels::convert_mulaw_to_f32(codes.data(), dst.data(), count, 0.5f);
+        for (int i = 0; i < count; ++i)
+          CHECK(dst[i] == kernels::decode_mulaw(codes[i], 0.5f));
+      }
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_kernels();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,130 @@
+//
+//  latency_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  The latency policy and its measurement on libsoundio's dummy backend: what is requested
+//    for each policy, and a sweep of targets that records underflows against latency.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+#include <chrono>
+#include <thread>
+
+using namespace test;
+
+namespace
+{
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_dummy(const AudioLibSwitcher_libsoundio::LatencyPolicy& policy)
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.backend = SoundIoBackendDummy;
+    params.event_thread = false;
+    params.mix_block_frames = c_block_frames;
+    params.latency = policy;
+    audio->init(params);
+    return audio;
+  }
+
+  // Checks the request against the policy and waits for a few callbacks to measure the
+  //   latency. expected_periods, if set, overrides expected_seconds.
+  void check_latency_policy(const AudioLibSwitcher_libsoundio::LatencyPolicy& policy, double expected_seconds,
+                            int expected_periods = 0)
+  {
+    auto audio = make_dummy(policy);
+    const auto* device = audio->get_device();
+    CHECK(device != nullptr);
+    if (device != nullptr)
+    {
+      if (expected_periods > 0)
+        expected_seconds = static_cast<double>(expected_periods) * c_block_frames / audio->get_mix_sample_rate();
+      if (expected_seconds > 0.0 && device->software_latency_max > 0.0)
+        expected_seconds = std::clamp(expected_seconds, device->software_latency_min, device->software_latency_max);
+      const auto info = audio->get_latency_info();
+      CHECK_NEAR(info.requested_seconds, expected_seconds, 1e-9);
+      CHECK(info.negotiated_seconds > 0.0);
+
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (audio->get_latency_info().num_measurements == 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      CHECK(audio->get_latency_info().num_measurements > 0);
+      CHECK(audio->get_latency_info().smoothed_seconds >= 0.0);
+    }
+    audio->finish();
+  }
+
+  void register_latency()
+  {
+    test::add("latency/backend_default", []
+    {
+      check_latency_policy({}, 0.0);
+    });
+
+    test::add("latency/target", []
+    {
+      AudioLibSwitcher_libsoundio::LatencyPolicy policy;
+      policy.target_seconds = 0.05;
+      check_latency_policy(policy, 0.05);
+    });
+
+    test::add("latency/min_periods", []
+    {
+      AudioLibSwitcher_libsoundio::LatencyPolicy policy;
+      policy.target_seconds = 0.001;
+      policy.min_periods = 8;
+      check_latency_policy(policy, 0.0, 8);
+    });
+
+    test::add("latency/max_periods", []
+    {
+      AudioLibSwitcher_libsoundio::LatencyPolicy policy;
+      policy.target_seconds = 1.0;
+      policy.max_periods = 4;
+      check_latency_policy(policy, 0.0, 4);
+    });
+
+    // Plays for a while at each target and records the underflow rate. More latency is more
+    //   headroom for the callback, so the rate must not go up as the target does. One
+    //   underflow per second of slack absorbs scheduling noise on a busy machine.
+    test::add("latency/underflow_sweep", []
+    {
+      constexpr double c_seconds = 0.5;
+      constexpr double c_slack_per_second = 1.0;
+      double previous_rate = -1.0;
+      double previous_negotiated = 0.0;
+      std::printf("  %10s %14s %12s %16s\n", "target_ms", "negotiated_ms", "measured_ms", "underflows_per_s");
+      for (double target_ms : { 5.0, 10.0, 20.0, 50.0, 100.0 })
+      {
+        AudioLibSwitcher_libsoundio::LatencyPolicy policy;
+        policy.target_seconds = target_ms * 1e-3;
+        auto audio = make_dummy(policy);
+        audio->play_source(add_source(*audio, make_sine(c_rate, 440.0, c_rate), c_rate, 0.5f));
+
+        const uint64_t underflows_before = audio->get_output_stats().num_underflows;
+        std::this_thread::sleep_for(std::chrono::duration<double>(c_seconds));
+        const auto stats = audio->get_output_stats();
+        const auto info = audio->get_latency_info();
+        const double rate = (stats.num_underflows - underflows_before) / c_seconds;
+        std::printf("  %10g %14.2f %12.2f %16.1f\n", target_ms, info.negotiated_seconds * 1e3,
+                    info.smoothed_seconds * 1e3, rate);
+
+        CHECK(!stats.failed);
+        CHECK(info.negotiated_seconds >= previous_negotiated);
+        if (previous_rate >= 0.0)
+          CHECK(rate <= previous_rate + c_slack_per_second);
+        previous_rate = rate;
+        previous_negotiated = info.negotiated_seconds;
+        audio->finish();
+      }
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_latency();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,153 @@
+//
+//  resampler_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  The resampler tiers: pitch and buffer-to-mix rate conversion keep the frequency right,
+//    and the signal-to-noise ratio of a converted tone orders the tiers by quality.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+#include <string>
+
+using namespace test;
+using audio::ResamplerQuality;
+
+namespace
+{
+
+  const char* get_quality_name(ResamplerQuality quality)
+  {
+    switch (quality)
+    {
+      case ResamplerQuality::Linear: return "linear";
+      case ResamplerQuality::Cubic: return "cubic";
+      case ResamplerQuality::Sinc: return "sinc";
+    }
+    return "?";
+  }
+
+  // Upward zero crossings of the left channel per second.
+  double measure_frequency(const std::vector<float>& stereo, int sample_rate)
+  {
+    int crossings = 0;
+    for (size_t f = 1; f < stereo.size() / 2; ++f)
+      if (stereo[2 * (f - 1)] < 0.f && stereo[2 * f] >= 0.f)
+        crossings++;
+    return crossings * static_cast<double>(sample_rate) / (stereo.size() / 2);
+  }
+
+  // Fits a sine of the given frequency to the left channel by least squares and returns the
+  //   power of the fit over the power of what is left, in dB. Aliases and interpolation
+  //   error make up the remainder.
+  double measure_snr_db(const std::vector<float>& stereo, double frequency, int sample_rate)
+  {
+    const size_t n = stereo.size() / 2;
+    double ss = 0.0, sc = 0.0, cc = 0.0, xs = 0.0, xc = 0.0;
+    for (size_t f = 0; f < n; ++f)
+    {
+      const double phase = 2.0 * c_pi * frequency * f / sample_rate;
+      const double s = std::sin(phase);
+      const double c = std::cos(phase);
+      ss += s * s;
+      sc += s * c;
+      cc += c * c;
+      xs += stereo[2 * f] * s;
+      xc += stereo[2 * f] * c;
+    }
+    const double det = ss * cc - sc * sc;
+    const double a = (xs * cc - xc * sc) / det;
+    const double b = (xc * ss - xs * sc) / det;
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t f = 0; f < n; ++f)
+    {
+      const double phase = 2.0 * c_pi * frequency * f / sample_rate;
+      const double fit = a * std::sin(phase) + b * std::cos(phase);
+      signal += fit * fit;
+      noise += (stereo[2 * f] - fit) * (stereo[2 * f] - fit);
+    }
+    return 10.0 * std::log10(signal / std::max(noise, 1e-30));
+  }
+
+  // Renders one second of a looping tone recorded at buffer_rate, after a short lead-in.
+  std::vector<float> render_tone(ResamplerQuality quality, double frequency, int buffer_rate, float pitch)
+  {
+    auto audio = make_offline();
+    const auto src_id = add_source(*audio, make_sine(buffer_rate, frequency, buffer_rate), buffer_rate, 0.5f);
+    audio->set_source_resampler_quality(src_id, quality);
+    audio->set_source_pitch(src_id, pitch);
+    audio->play_source(src_id);
+    render(*audio, 4096);
+    auto out = render(*audio, c_rate);
+    audio->finish();
+    return out;
+  }
+
+  void register_resampler()
+  {
+    for (auto quality : { ResamplerQuality::Linear, ResamplerQuality::Cubic, ResamplerQuality::Sinc })
+    {
+      const std::string name = get_quality_name(quality);
+
+      // 1 kHz recorded at 22.05 kHz stays 1 kHz at the mix rate, and pitch scales it.
+      for (float pitch : { 1.f, 0.5f, 1.5f })
+        test::add("resampler/" + name + "/pitch_" + std::to_string(pitch).substr(0, 3), [quality, pitch]
+        {
+          const auto out = render_tone(quality, 1000.0, 22050, pitch);
+          CHECK_NEAR(measure_frequency(out, c_rate), 1000.0 * pitch, 2.0);
+          // 8000 / 32768 at volume 0.5, give or take the pan law and interpolation ripple.
+          const double peak = get_peak(out);
+          CHECK(peak > 0.05 && peak < 0.15);
+        });
+    }
+
+    // 5 kHz at 22.05 kHz is a quarter of the way to Nyquist, where interpolation error is
+    //   plain to measure. Each tier must clear its floor and beat the one below it.
+    test::add("resampler/snr_by_tier", []
+    {
+      double snr_db[3] = {};
+      const double floor_db[3] = { 15.0, 22.0, 70.0 };
+      int i = 0;
+      for (auto quality : { ResamplerQuality::Linear, ResamplerQuality::Cubic, ResamplerQuality::Sinc })
+      {
+        snr_db[i] = measure_snr_db(render_tone(quality, 5000.0, 22050, 1.f), 5000.0, c_rate);
+        std::printf("  %-6s %.1f dB\n", get_quality_name(quality), snr_db[i]);
+        CHECK(snr_db[i] > floor_db[i]);
+        i++;
+      }
+      CHECK(snr_db[1] > snr_db[0]);
+      CHECK(snr_db[2] > snr_db[1]);
+    });
+
+    // Unity rate at pitch 1 passes the samples through.
+    test::add("resampler/unity_is_exact", []
+    {
+      auto samples = make_sine(c_rate, 440.0, c_rate);
+      auto audio = make_offline();
+      const auto src_id = add_source(*audio, samples, c_rate);
+      audio->set_source_resampler_quality(src_id, ResamplerQuality::Linear);
+      audio->play_source(src_id);
+      render(*audio, 4096);
+      const auto out = render(*audio, 4096);
+      double ratio = 0.0;
+      for (int f = 0; f < 4096; ++f)
+        if (samples[4096 + f] > 1000)
+        {
+          ratio = out[2 * f] / (samples[4096 + f] / 32768.0);
+          break;
+        }
+      CHECK(ratio > 0.0);
+      for (int f = 0; f < 4096; ++f)
+        CHECK_NEAR(out[2 * f], samples[4096 + f] / 32768.0 * ratio, 1e-5);
+      audio->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_resampler();
+  return test::run(argc, argv);
+}
@@ -0,0 +1,203 @@
+//
+//  upload_alloc_test.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  Counts heap allocations during buffer uploads through a replaced global operator new,
+//    which is why this is an executable of its own. The move, shared and adopt paths must
+//    leave the samples where the caller put them: no allocation as large as the PCM data
+//    and only a couple of small bookkeeping ones.
+//
+
+#include "TestHarness.h"
+#include "AudioLibSwitcher_libsoundio.h"
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <memory>
+#include <span>
+
+using audio::AudioLibSwitcher_libsoundio;
+
+namespace
+{
+
+  struct AllocationCounter
+  {
+    bool enabled = false;
+    size_t num_allocations = 0;
+    size_t num_bytes = 0;
+    size_t largest = 0;
+  };
+
+  AllocationCounter g_counter;
+
+  void* counted_alloc(size_t size)
+  {
+    if (g_counter.enabled)
+    {
+      g_counter.num_allocations++;
+      g_counter.num_bytes += size;
+      g_counter.largest = std::max(g_counter.largest, size);
+    }
+    if (void* ptr = std::malloc(size > 0 ? size : 1))
+      return ptr;
+    throw std::bad_alloc();
+  }
+
+  void* counted_aligned_alloc(size_t size, std::align_val_t alignment)
+  {
+    if (g_counter.enabled)
+    {
+      g_counter.num_allocations++;
+      g_counter.num_bytes += size;
+      g_counter.largest = std::max(g_counter.largest, size);
+    }
+    const size_t align = static_cast<size_t>(alignment);
+    if (void* ptr = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+      return ptr;
+    throw std::bad_alloc();
+  }
+
+  // Counts the allocations func makes.
+  template<typename Func>
+  AllocationCounter count_allocations(Func func)
+  {
+    g_counter = {};
+    g_counter.enabled = true;
+    func();
+    g_counter.enabled = false;
+    return g_counter;
+  }
+
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_aligned_alloc(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_aligned_alloc(size, alignment); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace
+{
+
+  // Two seconds of mono at 48 kHz, far above any bookkeeping allocation.
+  constexpr size_t c_num_samples = 96000;
+  constexpr size_t c_pcm_bytes = c_num_samples * sizeof(short);
+  // Room for the shared-pointer control block and the buffer's bookkeeping, which take three
+  //   allocations and about 300 bytes today.
+  constexpr size_t c_max_allocations = 4;
+  constexpr size_t c_max_bookkeeping_bytes = 1024;
+
+  std::unique_ptr<AudioLibSwitcher_libsoundio> make_offline()
+  {
+    auto audio = std::make_unique<AudioLibSwitcher_libsoundio>();
+    AudioLibSwitcher_libsoundio::InitParams params;
+    params.offline = true;
+    audio->init(params);
+    return audio;
+  }
+
+  void check_no_copy(const AllocationCounter& counter)
+  {
+    CHECK(counter.largest < c_pcm_bytes);
+    CHECK(counter.num_bytes <= c_max_bookkeeping_bytes);
+    CHECK(counter.num_allocations <= c_max_allocations);
+  }
+
+  void register_uploads()
+  {
+    // The existing path copies, which shows the counter sees PCM-sized allocations.
+    test::add("upload/copy_allocates", []
+    {
+      auto audio = make_offline();
+      const auto buf_id = audio->create_buffer();
+      const std::vector<short> samples(c_num_samples, 1000);
+      const auto counter = count_allocations([&] { audio->set_buffer_data_mono_16(buf_id, samples, 48000); });
+      CHECK(counter.num_bytes >= c_pcm_bytes);
+      audio->finish();
+    });
+
+    test::add("upload/move", []
+    {
+      auto audio = make_offline();
+      const auto buf_id = audio->create_buffer();
+      std::vector<short> samples(c_num_samples, 1000);
+      const auto counter = count_allocations([&] { audio->set_buffer_data_mono_16(buf_id, std::move(samples), 48000); });
+      check_no_copy(counter);
+      CHECK(samples.empty());
+      CHECK(audio->get_buffer_resident_bytes(buf_id) == c_pcm_bytes);
+      audio->finish();
+    });
+
+    test::add("upload/shared", []
+    {
+      auto audio = make_offline();
+      const unsigned int buf_ids[] = { audio->create_buffer(), audio->create_buffer(), audio->create_buffer() };
+      auto block = std::make_shared<const std::vector<short>>(c_num_samples, 1000);
+      const auto counter = count_allocations([&]
+      {
+        for (auto buf_id : buf_ids)
+          audio->set_buffer_data_mono_16(buf_id, block, 48000);
+      });
+      CHECK(counter.largest < c_pcm_bytes);
+      CHECK(counter.num_bytes <= 3 * c_max_bookkeeping_bytes);
+      CHECK(counter.num_allocations <= 3 * c_max_allocations);
+      // One reference per buffer plus ours.
+      CHECK(block.use_count() == 4);
+      audio->finish();
+    });
+
+    test::add("upload/adopt", []
+    {
+      auto audio = make_offline();
+      const auto buf_id = audio->create_buffer();
+      std::vector<short> samples(c_num_samples, 1000);
+      int num_releases = 0;
+      const auto counter = count_allocations([&]
+      {
+        audio->set_buffer_data_mono_16(buf_id, std::span<const short>(samples), 48000,
+                                       [&num_releases] { num_releases++; });
+      });
+      check_no_copy(counter);
+      CHECK(num_releases == 0);
+      audio->destroy_buffer(buf_id);
+      CHECK(num_releases == 1);
+      audio->finish();
+      CHECK(num_releases == 1);
+    });
+
+    // Playing from moved data does not copy it either.
+    test::add("upload/move_then_play", []
+    {
+      auto audio = make_offline();
+      const auto buf_id = audio->create_buffer();
+      const auto src_id = audio->create_source();
+      std::vector<float> out(2 * 512);
+      std::vector<short> samples(c_num_samples, 1000);
+      const auto counter = count_allocations([&]
+      {
+        audio->set_buffer_data_mono_16(buf_id, std::move(samples), 48000);
+        audio->attach_buffer_to_source(src_id, buf_id);
+        audio->play_source(src_id);
+        audio->render(out.data(), 512);
+      });
+      CHECK(counter.largest < c_pcm_bytes);
+      CHECK(out[0] != 0.f || out[2 * 511] != 0.f);
+      audio->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_uploads();
+  return test::run(argc, argv);
+}
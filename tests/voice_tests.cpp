@@ -0,0 +1,83 @@
+//
+//  voice_tests.cpp
+//  AudioLibSwitcher_libsoundio
+//
+//  The voice pool: a triggered source is heard from the next mixed block, and an exhausted
+//    pool steals by priority, oldest first.
+//
+
+#include "TestHarness.h"
+#include "TestAudio.h"
+
+using namespace test;
+
+namespace
+{
+
+  bool contains(const std::vector<unsigned int>& ids, unsigned int id)
+  {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+  }
+
+  void register_voices()
+  {
+    // The voice is pre-opened: the block right after play_source() already carries the source.
+    test::add("voices/audible_in_next_block", []
+    {
+      auto audio = make_offline();
+      const auto src_id = add_source(*audio, std::vector<short>(c_rate, 16384), c_rate, 0.5f);
+      render(*audio, c_block_frames);
+      audio->play_source(src_id);
+      const auto out = render(*audio, c_block_frames);
+      CHECK(out[0] != 0.f);
+      CHECK(get_peak(out) > 0.1);
+      const auto position = audio->get_source_position(src_id);
+      CHECK(position.is_valid);
+      CHECK_NEAR(position.seconds, static_cast<double>(c_block_frames) / c_rate, 1e-9);
+      audio->finish();
+    });
+
+    test::add("voices/steal_by_priority", []
+    {
+      auto audio = make_offline(2);
+      auto make = [&audio](int priority)
+      {
+        const auto src_id = add_source(*audio, make_sine(c_rate, 440.0, c_rate), c_rate, 0.1f);
+        audio->set_source_priority(src_id, priority);
+        return src_id;
+      };
+      const auto high = make(1);
+      const auto low_old = make(0);
+      const auto low_new = make(0);
+      const auto lowest = make(-1);
+      const auto highest = make(5);
+
+      audio->play_source(high);
+      audio->play_source(low_old);
+      render(*audio, c_block_frames);
+      // The pool is full: the oldest of the lowest priority sources gives up its voice.
+      audio->play_source(low_new);
+      CHECK(audio->is_source_playing(high));
+      CHECK(!audio->is_source_playing(low_old));
+      CHECK(audio->is_source_playing(low_new));
+      CHECK(contains(audio->fetch_finished_sources(), low_old));
+      // Nothing plays at a priority this low.
+      audio->play_source(lowest);
+      CHECK(!audio->is_source_playing(lowest));
+      CHECK(audio->is_source_playing(high) && audio->is_source_playing(low_new));
+      audio->play_source(highest);
+      CHECK(audio->is_source_playing(highest));
+      CHECK(audio->is_source_playing(high));
+      CHECK(!audio->is_source_playing(low_new));
+      CHECK(get_peak(render(*audio, 2048)) > 0.0);
+      audio->finish();
+    });
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+  register_voices();
+  return test::run(argc, argv);
+}